@@ -17,9 +17,9 @@ class ByteBuffer{
 
 public:
 
-	ByteBuffer(size_t size):buffer(size),refCount(1){}
+	ByteBuffer(size_t size):buffer(size),refCount(1),pooled(false){}
 
-	ByteBuffer(const ByteBuffer& o):buffer(o.buffer.capacity()),refCount(1){
+	ByteBuffer(const ByteBuffer& o):buffer(o.buffer.capacity()),refCount(1),pooled(false){
 		memcpy((void*)&buffer[0],(void*)&o.buffer[0],o.buffer.capacity());
 	}
 
@@ -40,13 +40,39 @@ public:
 		return this;
 	}
 
+	//another packet,possibly on another thread,holds this buffer too
+	bool Shared() const{
+		return refCount > 1;
+	}
+
 	void DecRef(){
 #ifdef _WIN
 		if(InterlockedDecrement(&refCount) <= 0)
 #else
 		if(__sync_sub_and_fetch(&refCount,1) <=0 )
 #endif
-			delete this;		
+		{
+			if(pooled)
+				recycle(this);
+			else
+				delete this;		
+		}
+	}
+
+	//a buffer from New goes to a free list of the thread dropping its last
+	//reference,a buffer released on another worker just changes hands
+	static ByteBuffer *New(size_t size){
+		std::vector<ByteBuffer*> *list = freelist();
+		if(!list->empty()){
+			ByteBuffer *b = list->back();
+			list->pop_back();
+			b->refCount = 1;
+			b->Reserve(size);
+			return b;
+		}
+		ByteBuffer *b = new ByteBuffer(size);
+		b->pooled = true;
+		return b;
 	}
 
 	void WriteUint8(size_t pos,unsigned char v){
@@ -73,14 +99,19 @@ public:
 		write<float>(pos,v);
 	}
 
-	void WriteBin(size_t pos,void *v,size_t size){
+	//room for at least size bytes,what is there is kept.the accessors bound
+	//on capacity(),so size() is always kept equal to it:growing a vector
+	//only copies its size() elements
+	void Reserve(size_t size){
 		size_t cap = buffer.capacity();
-		if (cap < pos + size){
-			if(cap >= size)	
-				buffer.resize(cap*2);
-			else
-				buffer.resize(cap+size);
-		}
+		if(cap < size)
+			buffer.resize(size > cap*2 ? size : cap*2);
+		if(buffer.size() != buffer.capacity())
+			buffer.resize(buffer.capacity());
+	}
+
+	void WriteBin(size_t pos,void *v,size_t size){
+		Reserve(pos + size);
 		memcpy((void*)&buffer[pos],v,size);
 	}
 
@@ -138,13 +169,7 @@ private:
 
 	template<typename T>
 	void write(size_t pos,const T &v){
-		size_t cap = buffer.capacity();
-		if (cap <= pos + sizeof(T)){
-			if(cap >= sizeof(T))	
-				buffer.resize(cap*2);
-			else
-				buffer.resize(cap+sizeof(T));
-		}
+		Reserve(pos + sizeof(T));
 		(*((T*)&buffer[pos])) = v;
 	}
 
@@ -155,10 +180,27 @@ private:
 		return (*((T*)&buffer[pos]));
 	}
 
+	static std::vector<ByteBuffer*> *freelist(){
+		static __thread std::vector<ByteBuffer*> *list = NULL;
+		if(!list) list = new std::vector<ByteBuffer*>;
+		return list;
+	}
+
+	static void recycle(ByteBuffer *b){
+		static const size_t max_free  = 256;
+		static const size_t max_bytes = 65536;
+		std::vector<ByteBuffer*> *list = freelist();
+		if(list->size() < max_free && b->buffer.capacity() <= max_bytes)
+			list->push_back(b);
+		else
+			delete b;
+	}
+
 	ByteBuffer& operator = (const ByteBuffer&);
 	~ByteBuffer(){}
 	std::vector<char> buffer;
 	volatile long refCount;
+	bool          pooled;
 };
 
 }
@@ -0,0 +1,312 @@
+#include <string.h>
+#include "ChaCha20Poly1305.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace net{
+
+static inline uint32_t load32(const unsigned char *p){
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void store32(unsigned char *p,uint32_t v){
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+#define ROTL32(v,n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QUARTERROUND(a,b,c,d)\
+	a += b; d ^= a; d = ROTL32(d,16);\
+	c += d; b ^= c; b = ROTL32(b,12);\
+	a += b; d ^= a; d = ROTL32(d,8);\
+	c += d; b ^= c; b = ROTL32(b,7);
+
+static void chachaInit(uint32_t state[16],const uint32_t key[8],const uint32_t nonce[3],uint32_t counter){
+	//"expand 32-byte k"
+	state[0] = 0x61707865;
+	state[1] = 0x3320646e;
+	state[2] = 0x79622d32;
+	state[3] = 0x6b206574;
+	memcpy(&state[4],key,32);
+	state[12] = counter;
+	state[13] = nonce[0];
+	state[14] = nonce[1];
+	state[15] = nonce[2];
+}
+
+static void chachaBlock(const uint32_t state[16],unsigned char out[64]){
+	uint32_t x[16];
+	memcpy(x,state,sizeof(x));
+	for(int i = 0; i < 10; ++i){
+		QUARTERROUND(x[0],x[4],x[8], x[12])
+		QUARTERROUND(x[1],x[5],x[9], x[13])
+		QUARTERROUND(x[2],x[6],x[10],x[14])
+		QUARTERROUND(x[3],x[7],x[11],x[15])
+		QUARTERROUND(x[0],x[5],x[10],x[15])
+		QUARTERROUND(x[1],x[6],x[11],x[12])
+		QUARTERROUND(x[2],x[7],x[8], x[13])
+		QUARTERROUND(x[3],x[4],x[9], x[14])
+	}
+	for(int i = 0; i < 16; ++i)
+		store32(out + 4*i,x[i] + state[i]);
+}
+
+#ifdef __SSE2__
+#define ROTL128(v,n) _mm_or_si128(_mm_slli_epi32(v,n),_mm_srli_epi32(v,32 - (n)))
+#define QUARTERROUND128(a,b,c,d)\
+	a = _mm_add_epi32(a,b); d = _mm_xor_si128(d,a); d = ROTL128(d,16);\
+	c = _mm_add_epi32(c,d); b = _mm_xor_si128(b,c); b = ROTL128(b,12);\
+	a = _mm_add_epi32(a,b); d = _mm_xor_si128(d,a); d = ROTL128(d,8);\
+	c = _mm_add_epi32(c,d); b = _mm_xor_si128(b,c); b = ROTL128(b,7);
+
+//xor 256 bytes with blocks counter..counter+3,lane i of every vector is block i
+static void chachaXor4(const uint32_t state[16],unsigned char *data){
+	__m128i s[16],x[16];
+	for(int i = 0; i < 16; ++i)
+		s[i] = _mm_set1_epi32((int)state[i]);
+	s[12] = _mm_add_epi32(s[12],_mm_set_epi32(3,2,1,0));
+	for(int i = 0; i < 16; ++i)
+		x[i] = s[i];
+	for(int i = 0; i < 10; ++i){
+		QUARTERROUND128(x[0],x[4],x[8], x[12])
+		QUARTERROUND128(x[1],x[5],x[9], x[13])
+		QUARTERROUND128(x[2],x[6],x[10],x[14])
+		QUARTERROUND128(x[3],x[7],x[11],x[15])
+		QUARTERROUND128(x[0],x[5],x[10],x[15])
+		QUARTERROUND128(x[1],x[6],x[11],x[12])
+		QUARTERROUND128(x[2],x[7],x[8], x[13])
+		QUARTERROUND128(x[3],x[4],x[9], x[14])
+	}
+	for(int i = 0; i < 16; ++i)
+		x[i] = _mm_add_epi32(x[i],s[i]);
+	//transpose each group of 4 words into 16 bytes of each block
+	for(int k = 0; k < 4; ++k){
+		__m128i t0 = _mm_unpacklo_epi32(x[4*k],x[4*k + 1]);
+		__m128i t1 = _mm_unpacklo_epi32(x[4*k + 2],x[4*k + 3]);
+		__m128i t2 = _mm_unpackhi_epi32(x[4*k],x[4*k + 1]);
+		__m128i t3 = _mm_unpackhi_epi32(x[4*k + 2],x[4*k + 3]);
+		__m128i b[4];
+		b[0] = _mm_unpacklo_epi64(t0,t1);
+		b[1] = _mm_unpackhi_epi64(t0,t1);
+		b[2] = _mm_unpacklo_epi64(t2,t3);
+		b[3] = _mm_unpackhi_epi64(t2,t3);
+		for(int j = 0; j < 4; ++j){
+			__m128i *p = (__m128i*)(data + 64*j + 16*k);
+			_mm_storeu_si128(p,_mm_xor_si128(_mm_loadu_si128(p),b[j]));
+		}
+	}
+}
+#endif
+
+void ChaCha20Poly1305::Xor(const uint32_t key[8],const uint32_t nonce[3],uint32_t counter,
+	unsigned char *data,size_t len){
+	uint32_t state[16];
+	chachaInit(state,key,nonce,counter);
+#ifdef __SSE2__
+	while(len >= 256){
+		chachaXor4(state,data);
+		state[12] += 4;
+		data += 256;
+		len  -= 256;
+	}
+#endif
+	unsigned char block[64];
+	while(len > 0){
+		chachaBlock(state,block);
+		++state[12];
+		size_t n = len < 64 ? len : 64;
+		for(size_t i = 0; i < n; ++i)
+			data[i] ^= block[i];
+		data += n;
+		len  -= n;
+	}
+}
+
+//poly1305 in 26 bit limbs(poly1305-donna 32)
+class Poly1305{
+public:
+	Poly1305(const unsigned char key[32]):left(0){
+		r[0] = (load32(key + 0))      & 0x3ffffff;
+		r[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+		r[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+		r[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+		r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+		for(int i = 0; i < 5; ++i) h[i] = 0;
+		for(int i = 0; i < 4; ++i) pad[i] = load32(key + 16 + 4*i);
+	}
+
+	void Update(const unsigned char *m,size_t len){
+		if(left){
+			size_t n = 16 - left;
+			if(n > len) n = len;
+			memcpy(buf + left,m,n);
+			left += n;
+			m    += n;
+			len  -= n;
+			if(left < 16) return;
+			blocks(buf,16,1 << 24);
+			left = 0;
+		}
+		size_t full = len & ~(size_t)15;
+		if(full){
+			blocks(m,full,1 << 24);
+			m   += full;
+			len -= full;
+		}
+		if(len){
+			memcpy(buf,m,len);
+			left = len;
+		}
+	}
+
+	//zeros up to a multiple of 16 bytes,as the AEAD pads aad and ciphertext
+	void Pad(){
+		if(left){
+			memset(buf + left,0,16 - left);
+			blocks(buf,16,1 << 24);
+			left = 0;
+		}
+	}
+
+	void Finish(unsigned char tag[16]){
+		if(left){
+			buf[left] = 1;
+			memset(buf + left + 1,0,15 - left);
+			blocks(buf,16,0);
+		}
+		uint32_t h0 = h[0],h1 = h[1],h2 = h[2],h3 = h[3],h4 = h[4],c;
+		c = h1 >> 26; h1 &= 0x3ffffff;
+		h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+		h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+		h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+		h0 += c*5; c = h0 >> 26; h0 &= 0x3ffffff;
+		h1 += c;
+		//h - p
+		uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+		uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+		uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+		uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+		uint32_t g4 = h4 + c - (1 << 26);
+		uint32_t mask = (g4 >> 31) - 1;
+		g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+		mask = ~mask;
+		h0 = (h0 & mask) | g0;
+		h1 = (h1 & mask) | g1;
+		h2 = (h2 & mask) | g2;
+		h3 = (h3 & mask) | g3;
+		h4 = (h4 & mask) | g4;
+		h0 = h0 | (h1 << 26);
+		h1 = (h1 >> 6) | (h2 << 20);
+		h2 = (h2 >> 12) | (h3 << 14);
+		h3 = (h3 >> 18) | (h4 << 8);
+		uint64_t f;
+		f = (uint64_t)h0 + pad[0];             h0 = (uint32_t)f;
+		f = (uint64_t)h1 + pad[1] + (f >> 32); h1 = (uint32_t)f;
+		f = (uint64_t)h2 + pad[2] + (f >> 32); h2 = (uint32_t)f;
+		f = (uint64_t)h3 + pad[3] + (f >> 32); h3 = (uint32_t)f;
+		store32(tag + 0,h0);
+		store32(tag + 4,h1);
+		store32(tag + 8,h2);
+		store32(tag + 12,h3);
+	}
+
+private:
+	void blocks(const unsigned char *m,size_t len,uint32_t hibit){
+		uint32_t r0 = r[0],r1 = r[1],r2 = r[2],r3 = r[3],r4 = r[4];
+		uint32_t s1 = r1*5,s2 = r2*5,s3 = r3*5,s4 = r4*5;
+		uint32_t h0 = h[0],h1 = h[1],h2 = h[2],h3 = h[3],h4 = h[4];
+		while(len >= 16){
+			h0 += (load32(m + 0))      & 0x3ffffff;
+			h1 += (load32(m + 3) >> 2) & 0x3ffffff;
+			h2 += (load32(m + 6) >> 4) & 0x3ffffff;
+			h3 += (load32(m + 9) >> 6) & 0x3ffffff;
+			h4 += (load32(m + 12) >> 8) | hibit;
+			uint64_t d0 = (uint64_t)h0*r0 + (uint64_t)h1*s4 + (uint64_t)h2*s3 + (uint64_t)h3*s2 + (uint64_t)h4*s1;
+			uint64_t d1 = (uint64_t)h0*r1 + (uint64_t)h1*r0 + (uint64_t)h2*s4 + (uint64_t)h3*s3 + (uint64_t)h4*s2;
+			uint64_t d2 = (uint64_t)h0*r2 + (uint64_t)h1*r1 + (uint64_t)h2*r0 + (uint64_t)h3*s4 + (uint64_t)h4*s3;
+			uint64_t d3 = (uint64_t)h0*r3 + (uint64_t)h1*r2 + (uint64_t)h2*r1 + (uint64_t)h3*r0 + (uint64_t)h4*s4;
+			uint64_t d4 = (uint64_t)h0*r4 + (uint64_t)h1*r3 + (uint64_t)h2*r2 + (uint64_t)h3*r1 + (uint64_t)h4*r0;
+			uint32_t c;
+			c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & 0x3ffffff;
+			d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & 0x3ffffff;
+			d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & 0x3ffffff;
+			d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & 0x3ffffff;
+			d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & 0x3ffffff;
+			h0 += c*5; c = h0 >> 26; h0 &= 0x3ffffff;
+			h1 += c;
+			m   += 16;
+			len -= 16;
+		}
+		h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3; h[4] = h4;
+	}
+
+	uint32_t      r[5];
+	uint32_t      h[5];
+	uint32_t      pad[4];
+	unsigned char buf[16];
+	size_t        left;
+};
+
+ChaCha20Poly1305::ChaCha20Poly1305(const unsigned char key[KEYLEN]){
+	for(int i = 0; i < 8; ++i)
+		m_key[i] = load32(key + 4*i);
+}
+
+ChaCha20Poly1305::~ChaCha20Poly1305(){
+	//don't leave the key in freed memory
+	volatile uint32_t *p = m_key;
+	for(int i = 0; i < 8; ++i) p[i] = 0;
+}
+
+//the one time poly1305 key is the first half of block 0,the data is
+//encrypted from block 1 on
+void ChaCha20Poly1305::mac(const uint32_t nonce[3],const unsigned char *aad,size_t alen,
+	const unsigned char *data,size_t len,unsigned char tag[TAGLEN]){
+	uint32_t state[16];
+	unsigned char block[64];
+	chachaInit(state,m_key,nonce,0);
+	chachaBlock(state,block);
+	Poly1305 poly(block);
+	memset(block,0,sizeof(block));
+	if(alen){
+		poly.Update(aad,alen);
+		poly.Pad();
+	}
+	if(len){
+		poly.Update(data,len);
+		poly.Pad();
+	}
+	unsigned char lens[16];
+	for(int i = 0; i < 8; ++i){
+		lens[i]     = (unsigned char)((uint64_t)alen >> (8*i));
+		lens[8 + i] = (unsigned char)((uint64_t)len >> (8*i));
+	}
+	poly.Update(lens,16);
+	poly.Finish(tag);
+}
+
+void ChaCha20Poly1305::Seal(const unsigned char nonce[NONCELEN],const unsigned char *aad,size_t alen,
+	unsigned char *data,size_t len,unsigned char tag[TAGLEN]){
+	uint32_t n[3] = {load32(nonce),load32(nonce + 4),load32(nonce + 8)};
+	Xor(m_key,n,1,data,len);
+	mac(n,aad,alen,data,len,tag);
+}
+
+bool ChaCha20Poly1305::Open(const unsigned char nonce[NONCELEN],const unsigned char *aad,size_t alen,
+	unsigned char *data,size_t len,const unsigned char tag[TAGLEN]){
+	uint32_t n[3] = {load32(nonce),load32(nonce + 4),load32(nonce + 8)};
+	unsigned char expect[TAGLEN];
+	mac(n,aad,alen,data,len,expect);
+	//constant time compare
+	unsigned char diff = 0;
+	for(size_t i = 0; i < TAGLEN; ++i)
+		diff |= expect[i] ^ tag[i];
+	if(diff) return false;
+	Xor(m_key,n,1,data,len);
+	return true;
+}
+
+}
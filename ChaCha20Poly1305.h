@@ -0,0 +1,44 @@
+#ifndef _CHACHA20POLY1305_H
+#define _CHACHA20POLY1305_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace net{
+
+//RFC 8439 AEAD.data is encrypted and decrypted in place,aad is only
+//authenticated.the keystream is made 4 blocks at a time with SSE2 when the
+//compiler targets it
+class ChaCha20Poly1305{
+public:
+	static const size_t KEYLEN   = 32;
+	static const size_t NONCELEN = 12;
+	static const size_t TAGLEN   = 16;
+
+	explicit ChaCha20Poly1305(const unsigned char key[KEYLEN]);
+	~ChaCha20Poly1305();
+
+	void Seal(const unsigned char nonce[NONCELEN],const unsigned char *aad,size_t alen,
+		unsigned char *data,size_t len,unsigned char tag[TAGLEN]);
+
+	//false on a wrong tag,data is left as it was
+	bool Open(const unsigned char nonce[NONCELEN],const unsigned char *aad,size_t alen,
+		unsigned char *data,size_t len,const unsigned char tag[TAGLEN]);
+
+	//the bare cipher:xor len bytes with the keystream from block counter on
+	static void Xor(const uint32_t key[8],const uint32_t nonce[3],uint32_t counter,
+		unsigned char *data,size_t len);
+
+private:
+	ChaCha20Poly1305(const ChaCha20Poly1305&);
+	ChaCha20Poly1305& operator = (const ChaCha20Poly1305&);
+
+	void mac(const uint32_t nonce[3],const unsigned char *aad,size_t alen,
+		const unsigned char *data,size_t len,unsigned char tag[TAGLEN]);
+
+	uint32_t m_key[8];
+};
+
+}
+
+#endif
@@ -11,6 +11,16 @@ public:
 	Decoder(){}
 	virtual Packet *unpack(char *buf,size_t pos,size_t size,size_t max,size_t &pklen,int &err) = 0;
 	virtual ~Decoder(){};
+	//packets the decoder answers with on its own(a handshake,a pong),the
+	//socket takes them after every unpack and sends them as they are
+	virtual Packet *Reply(){
+		return NULL;
+	}
+	//for a protocol framing what is sent:head goes out first and body in
+	//place of wpk.false to send wpk as it is
+	virtual bool Frame(Packet *wpk,Packet *&head,Packet *&body){
+		return false;
+	}
 private:
 	Decoder(const Decoder&);
 	Decoder& operator = (const Decoder &o);
@@ -48,6 +58,63 @@ public:
 	}
 };
 
+//produce the decoder of each socket,a socket gives its decoder back with Put
+//when it is closed.factories are refcounted,every bound socket holds a ref
+class DecoderFactory{
+public:
+	DecoderFactory():refCount(1){}
+
+	virtual Decoder *Get() = 0;
+
+	virtual void Put(Decoder*) = 0;
+
+	DecoderFactory* IncRef(){
+#ifdef _WIN
+		InterlockedIncrement(&refCount);
+#else
+		__sync_add_and_fetch(&refCount,1);
+#endif
+		return this;
+	}
+
+	void DecRef(){
+#ifdef _WIN
+		if(InterlockedDecrement(&refCount) <= 0)
+#else
+		if(__sync_sub_and_fetch(&refCount,1) <=0 )
+#endif
+			delete this;
+	}
+
+protected:
+	virtual ~DecoderFactory(){}
+private:
+	DecoderFactory(const DecoderFactory&);
+	DecoderFactory& operator = (const DecoderFactory &o);
+	volatile long refCount;
+};
+
+//decoders without state between two unpack calls,one instance serves every socket
+template<typename T>
+class SharedDecoderFactory : public DecoderFactory{
+public:
+	static DecoderFactory *Default(){
+		static DecoderFactory *factory = new SharedDecoderFactory<T>;
+		return factory;
+	}
+
+	Decoder *Get(){
+		return &decoder;
+	}
+
+	void Put(Decoder*){}
+private:
+	T decoder;
+};
+
+typedef SharedDecoderFactory<PacketDecoder>    PacketDecoderFactory;
+typedef SharedDecoderFactory<RawBinaryDecoder> RawBinaryDecoderFactory;
+
 }
 
 
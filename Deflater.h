@@ -0,0 +1,162 @@
+#ifndef _DEFLATER_H
+#define _DEFLATER_H
+
+#include <zlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#ifndef _WIN
+#include <strings.h>
+#else
+#define strncasecmp _strnicmp
+#endif
+#include "RawBinPacket.h"
+
+namespace net{
+
+enum{
+	ENCODING_IDENTITY = 0,
+	ENCODING_GZIP,
+	ENCODING_DEFLATE,
+};
+
+//the Content-Encoding token of encoding,NULL for identity
+static inline const char *EncodingName(int encoding){
+	switch(encoding){
+		case ENCODING_GZIP:return "gzip";
+		case ENCODING_DEFLATE:return "deflate";
+		default:return NULL;
+	}
+}
+
+static inline int EncodingByName(const char *name){
+	if(!name) return ENCODING_IDENTITY;
+	if(strcmp(name,"gzip") == 0) return ENCODING_GZIP;
+	if(strcmp(name,"deflate") == 0) return ENCODING_DEFLATE;
+	return ENCODING_IDENTITY;
+}
+
+//the encoding an Accept-Encoding value asks for:gzip over deflate at the same
+//q,a coding with q=0 is refused
+static inline int NegotiateEncoding(const char *value,size_t len){
+	int    best  = ENCODING_IDENTITY;
+	double bestq = 0;
+	size_t i = 0;
+	while(i < len){
+		while(i < len && (value[i] == ' ' || value[i] == ',')) ++i;
+		size_t end = i;
+		while(end < len && value[end] != ',') ++end;
+		size_t tend = i;
+		while(tend < end && value[tend] != ';' && value[tend] != ' ') ++tend;
+		double q = 1;
+		const char *semi = (const char*)memchr(value + tend,';',end - tend);
+		if(semi){
+			const char *qs = semi + 1;
+			while(qs < value + end && *qs == ' ') ++qs;
+			if(qs + 2 <= value + end && (qs[0] == 'q' || qs[0] == 'Q') && qs[1] == '=')
+				q = atof(std::string(qs + 2,value + end - qs - 2).c_str());
+		}
+		int encoding = ENCODING_IDENTITY;
+		if(tend - i == 4 && strncasecmp(value + i,"gzip",4) == 0) encoding = ENCODING_GZIP;
+		else if(tend - i == 7 && strncasecmp(value + i,"deflate",7) == 0) encoding = ENCODING_DEFLATE;
+		if(encoding != ENCODING_IDENTITY && q > 0 && (q > bestq || (q == bestq && encoding < best))){
+			best  = encoding;
+			bestq = q;
+		}
+		i = end;
+	}
+	return best;
+}
+
+//a zlib deflate stream writing gzip or zlib(http "deflate") framed output
+//into pooled ByteBuffers
+class Deflater{
+public:
+	Deflater(int encoding,int level = Z_DEFAULT_COMPRESSION):m_ok(false){
+		memset(&m_stream,0,sizeof(m_stream));
+		int bits = encoding == ENCODING_GZIP ? 15 + 16 : 15;
+		m_ok = deflateInit2(&m_stream,level,Z_DEFLATED,bits,8,Z_DEFAULT_STRATEGY) == Z_OK;
+	}
+
+	~Deflater(){
+		if(m_ok) deflateEnd(&m_stream);
+	}
+
+	bool Ok(){
+		return m_ok;
+	}
+
+	//compress len bytes of data into buffer from pos on,growing it as needed.
+	//flush is Z_NO_FLUSH,Z_SYNC_FLUSH or Z_FINISH.returns the end of the output
+	size_t Write(ByteBuffer *buffer,size_t pos,const char *data,size_t len,int flush){
+		std::vector<char> &buf = buffer->Buf();
+		m_stream.next_in  = (Bytef*)data;
+		m_stream.avail_in = (uInt)len;
+		for(;;){
+			if(buf.size() < pos + 64)
+				buffer->Reserve(pos + 64 + (len > 4096 ? len/2 : 4096));
+			m_stream.next_out  = (Bytef*)&buf[pos];
+			m_stream.avail_out = (uInt)(buf.size() - pos);
+			int ret = deflate(&m_stream,flush);
+			pos = buf.size() - m_stream.avail_out;
+			if(ret == Z_STREAM_END || ret == Z_STREAM_ERROR)
+				break;
+			//all input taken and flushed once deflate leaves output space unused
+			if(flush != Z_FINISH && m_stream.avail_out > 0)
+				break;
+		}
+		return pos;
+	}
+
+	//compress data as the next piece of a streamed body,framed as one chunk of
+	//chunked transfer-encoding with chunked.flush is Z_NO_FLUSH(more follows at
+	//once),Z_SYNC_FLUSH or Z_FINISH to end the stream(and the chunked body).
+	//NULL when there is nothing to send yet
+	Packet *Chunk(const char *data,size_t len,int flush,bool chunked){
+		bool finish = flush == Z_FINISH;
+		static const size_t head = 10;//"%08x\r\n",leading zeros are allowed
+		ByteBuffer *buffer = ByteBuffer::New(len/2 + 256);
+		size_t start = chunked ? head : 0;
+		size_t end   = Write(buffer,start,data,len,flush);
+		size_t size  = end - start;
+		if(chunked){
+			if(size){
+				char hex[16];
+				snprintf(hex,sizeof(hex),"%08x\r\n",(unsigned int)size);
+				buffer->WriteBin(0,hex,head);
+				buffer->WriteBin(end,(void*)"\r\n",2);
+				end += 2;
+			}else
+				end = 0;
+			if(finish){
+				buffer->WriteBin(end,(void*)"0\r\n\r\n",5);
+				end += 5;
+			}
+		}
+		Packet *packet = end ? new RawBinPacket(buffer,end) : NULL;
+		buffer->DecRef();
+		return packet;
+	}
+
+	//a stream of this thread,reset for a body compressed in one go
+	static Deflater *Shared(int encoding,int level){
+		static __thread Deflater *shared[2][10];
+		if(level < 0 || level > 9) level = 6;
+		Deflater *&d = shared[encoding == ENCODING_GZIP ? 0 : 1][level];
+		if(!d) d = new Deflater(encoding,level);
+		else deflateReset(&d->m_stream);
+		return d;
+	}
+
+private:
+	Deflater(const Deflater&);
+	Deflater& operator = (const Deflater&);
+
+	z_stream m_stream;
+	bool     m_ok;
+};
+
+}
+
+#endif
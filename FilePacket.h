@@ -0,0 +1,159 @@
+#ifndef _FILEPACKET_H
+#define _FILEPACKET_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifndef _WIN
+#include <unistd.h>
+#else
+#include <io.h>
+#include <BaseTsd.h>
+typedef SSIZE_T ssize_t;
+#endif
+#include "Packet.h"
+
+namespace net{
+
+//the content of an opened file:copied into memory(the fd is closed right
+//away) or kept open for sendfile.shared by the cache and the packets in flight.
+//a copy,unlike a mapping,can't fault when the file is cut short or rewritten
+//on disk while it is being sent
+class FileBody{
+public:
+	//takes fd,with copy the whole file is read in.a file that comes up
+	//short is kept open instead
+	static FileBody *Open(int fd,size_t size,bool copy){
+		FileBody *file = new FileBody(size);
+		file->m_fd = fd;
+		if(copy && size > 0){
+			ByteBuffer *data = ByteBuffer::New(size);
+			size_t got = 0;
+			while(got < size){
+				ssize_t n = file->Read(got,&data->Buf()[got],size - got);
+				if(n <= 0) break;
+				got += (size_t)n;
+			}
+			if(got == size){
+				file->m_data = data;
+				file->m_fd   = -1;
+				::close(fd);
+			}else
+				data->DecRef();
+		}
+		return file;
+	}
+
+	FileBody *IncRef(){
+#ifdef _WIN
+		InterlockedIncrement(&refCount);
+#else
+		__sync_add_and_fetch(&refCount,1);
+#endif
+		return this;
+	}
+
+	void DecRef(){
+#ifdef _WIN
+		if(InterlockedDecrement(&refCount) <= 0)
+#else
+		if(__sync_sub_and_fetch(&refCount,1) <=0 )
+#endif
+			delete this;
+	}
+
+	const char *Data() const{return m_data ? &m_data->Buf()[0] : NULL;}
+	int  Fd() const{return m_fd;}
+	size_t Size() const{return m_size;}
+
+	//copy len bytes at off into buf,for a platform without sendfile
+	ssize_t Read(size_t off,char *buf,size_t len){
+		if(m_data){
+			if(off >= m_size) return 0;
+			if(len > m_size - off) len = m_size - off;
+			memcpy(buf,&m_data->Buf()[off],len);
+			return (ssize_t)len;
+		}
+#ifdef _WIN
+		if(_lseeki64(m_fd,off,SEEK_SET) < 0) return -1;
+		if(len > 0x7fffffff) len = 0x7fffffff;
+		return _read(m_fd,buf,(unsigned int)len);
+#else
+		return ::pread(m_fd,buf,len,off);
+#endif
+	}
+
+private:
+	FileBody(size_t size):refCount(1),m_data(NULL),m_fd(-1),m_size(size){}
+	FileBody(const FileBody&);
+	FileBody& operator = (const FileBody&);
+	~FileBody(){
+		if(m_data) m_data->DecRef();
+		if(m_fd >= 0) ::close(m_fd);
+	}
+
+	volatile long refCount;
+	ByteBuffer   *m_data;
+	int           m_fd;
+	size_t        m_size;
+};
+
+//len bytes of a file from off on.a copied file goes out with the gathering
+//write like any packet,an open one with sendfile
+class FilePacket : public Packet{
+public:
+	FilePacket(FileBody *file,size_t off,size_t len):Packet(FILEPACKET,NULL),
+		m_file(file->IncRef()),m_off(off),m_len(len){}
+
+	FilePacket(const FilePacket &o):Packet(FILEPACKET,NULL),
+		m_file(o.m_file->IncRef()),m_off(o.m_off),m_len(o.m_len){}
+
+	~FilePacket(){
+		m_file->DecRef();
+	}
+
+	const char *Data(size_t pos){
+		return m_file->Data() ? m_file->Data() + m_off + pos : NULL;
+	}
+
+	FileBody *File(){return m_file;}
+
+	size_t Offset(){return m_off;}
+
+	//the first n bytes were sent
+	void Skip(size_t n){
+		m_off += n;
+		m_len -= n;
+	}
+
+	Packet *Clone(){
+		return new FilePacket(*this);
+	}
+
+	Packet *MakeWritePacket(){
+		return NULL;
+	}
+
+	Packet *MakeReadPacket(){
+		return NULL;
+	}
+
+	size_t PkLen(){
+		return m_len;
+	}
+
+	size_t PkTotal(){
+		return m_len;
+	}
+
+private:
+	FilePacket& operator = (const FilePacket&);
+
+	FileBody *m_file;
+	size_t    m_off;
+	size_t    m_len;
+};
+
+}
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef _HTTPCONNPOOL_H
+#define _HTTPCONNPOOL_H
+
+#include <map>
+#include <list>
+#include <string>
+#include "Socket.h"
+#include "Reactor.h"
+#include "SysTime.h"
+#include "LuaSocket.h"
+
+namespace net{
+
+//keep-alive connections of an http client,grouped by host:port.an idle
+//connection stays in the reactor unbound but keeps its decoder,if the server
+//closes it or it idles longer than idletimeout it is dropped from the pool.
+//the idle ones of every host are swept once a second
+class HttpConnPool{
+
+	struct idleconn{
+		Socket   *s;
+		uint64_t  since;
+		idleconn(Socket *s,uint64_t since):s(s),since(since){}
+	};
+
+	struct hostpool{
+		std::string          host;
+		int                  port;
+		size_t               total;//idle,in use and connecting
+		std::list<idleconn>  idle;
+		std::list<luaRef>    waiters;
+		TlsContext          *tls;
+		SSL_SESSION         *session;//resumed by the next connection
+		hostpool(const std::string &host,int port,TlsContext *tls):host(host),port(port),total(0),
+			tls(tls ? tls->IncRef() : NULL),session(NULL){}
+		~hostpool(){
+			if(session) SSL_SESSION_free(session);
+			if(tls) tls->DecRef();
+		}
+	};
+
+public:
+	HttpConnPool(Reactor *reactor,size_t maxidle,size_t maxperhost,uint32_t idletimeout)
+		:reactor(reactor),maxidle(maxidle),maxperhost(maxperhost > 0 ? maxperhost : 1),
+		idletimeout(idletimeout){
+		reactor->AddTimer(on_sweep,this,1000);
+	}
+
+	~HttpConnPool(){
+		reactor->RemoveTimer(this);
+		std::map<Socket*,hostpool*>::iterator it = owned.begin();
+		for(; it != owned.end(); ++it)
+			it->first->SetCloseHook(NULL,NULL);
+		std::map<std::string,hostpool*>::iterator h = hosts.begin();
+		for(; h != hosts.end(); ++h){
+			std::list<idleconn> &idle = h->second->idle;
+			for(std::list<idleconn>::iterator i = idle.begin(); i != idle.end(); ++i)
+				i->s->Close();
+			delete h->second;
+		}
+	}
+
+	//cb(s,success):an idle connection is handed over at once,a new one is
+	//connected while the host is under maxperhost,else cb waits for a Release.
+	//with tls the connections are TLS ones,pooled apart from plain ones
+	void Acquire(const char *host,int port,luaRef cb,TlsContext *tls = NULL){
+		hostpool *hp = getpool(host,port,tls);
+		Socket   *s  = popIdle(hp);
+		if(s)
+			call(cb,s);
+		else if(hp->total < maxperhost)
+			connect(hp,std::move(cb));
+		else
+			hp->waiters.push_back(std::move(cb));
+	}
+
+	//hand the connection back after a complete response,without keepalive it is closed
+	void Release(Socket *s,bool keepalive){
+		std::map<Socket*,hostpool*>::iterator it = owned.find(s);
+		if(it == owned.end()) return;
+		hostpool *hp = it->second;
+		if(hp->tls)
+			keepSession(hp,s);
+		if(!keepalive || s->State() != establish){
+			s->Close();
+		}else if(!hp->waiters.empty()){
+			luaRef cb(std::move(hp->waiters.front()));
+			hp->waiters.pop_front();
+			call(cb,s);
+		}else if(hp->idle.size() >= maxidle){
+			s->Close();
+		}else{
+			s->Unbind();
+			hp->idle.push_back(idleconn(s,GetSystemMs64()));
+		}
+	}
+
+private:
+	HttpConnPool(const HttpConnPool&);
+	HttpConnPool& operator = (const HttpConnPool&);
+
+	hostpool *getpool(const char *host,int port,TlsContext *tls){
+		char key[320];
+		//one pool per context,the verification differs
+		if(tls)
+			snprintf(key,sizeof(key),"%s:%d/%p",host,port,(void*)tls);
+		else
+			snprintf(key,sizeof(key),"%s:%d",host,port);
+		std::map<std::string,hostpool*>::iterator it = hosts.find(key);
+		if(it != hosts.end()) return it->second;
+		hostpool *hp = new hostpool(host,port,tls);
+		hosts[key] = hp;
+		return hp;
+	}
+
+	//by the end of a response a tls 1.3 server has sent its tickets too
+	void keepSession(hostpool *hp,Socket *s){
+		TlsStream *t = s->Tls();
+		SSL_SESSION *session = t ? t->Session() : NULL;
+		if(!session) return;
+		if(!SSL_SESSION_is_resumable(session)){
+			SSL_SESSION_free(session);
+			return;
+		}
+		if(hp->session) SSL_SESSION_free(hp->session);
+		hp->session = session;
+	}
+
+	//close the connections idle longer than idletimeout,the oldest are in front
+	void expire(hostpool *hp,uint64_t now){
+		while(!hp->idle.empty() && now - hp->idle.front().since >= idletimeout){
+			Socket *s = hp->idle.front().s;
+			hp->idle.pop_front();
+			s->Close();
+		}
+	}
+
+	static void on_sweep(void *ud){
+		HttpConnPool *pool = (HttpConnPool*)ud;
+		uint64_t now = GetSystemMs64();
+		std::map<std::string,hostpool*>::iterator h = pool->hosts.begin();
+		for(; h != pool->hosts.end(); ++h)
+			pool->expire(h->second,now);
+	}
+
+	//the most recently used connection is the one least likely closed by the server
+	Socket *popIdle(hostpool *hp){
+		expire(hp,GetSystemMs64());
+		if(hp->idle.empty()) return NULL;
+		Socket *s = hp->idle.back().s;
+		hp->idle.pop_back();
+		return s;
+	}
+
+	void connect(hostpool *hp,luaRef cb){
+		Socket *s = new Socket(AF_INET,SOCK_STREAM,IPPROTO_TCP);
+		owned[s] = hp;
+		++hp->total;
+		s->SetCloseHook(on_close,this);
+		if(hp->tls)
+			s->ConnectTLS(hp->tls,hp->host.c_str(),hp->session);
+		luaRef keep(cb);
+		if(!s->Connect(reactor,hp->host.c_str(),hp->port,std::move(cb))){
+			s->Close();
+			call(keep,NULL);
+		}
+	}
+
+	static void call(luaRef &cb,Socket *s){
+		lua_State *L = cb.GetLState();
+		if(!L) return;
+		int oldtop = lua_gettop(L);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, cb.GetIndex());
+		if(s)
+			push_luaSocket(L,s);
+		else
+			lua_pushnil(L);
+		lua_pushboolean(L,s ? 1 : 0);
+		if(0 != lua_pcall(L, 2, 0, 0))
+			printf("%s\n",lua_tostring(L,-1));
+		lua_settop(L, oldtop);
+	}
+
+	static void on_close(Socket *s,void *ud){
+		((HttpConnPool*)ud)->onClose(s);
+	}
+
+	void onClose(Socket *s){
+		std::map<Socket*,hostpool*>::iterator it = owned.find(s);
+		if(it == owned.end()) return;
+		hostpool *hp = it->second;
+		owned.erase(it);
+		--hp->total;
+		for(std::list<idleconn>::iterator i = hp->idle.begin(); i != hp->idle.end(); ++i){
+			if(i->s == s){
+				hp->idle.erase(i);
+				break;
+			}
+		}
+		if(!hp->waiters.empty() && hp->total < maxperhost){
+			luaRef cb(std::move(hp->waiters.front()));
+			hp->waiters.pop_front();
+			connect(hp,std::move(cb));
+		}
+	}
+
+	Reactor                          *reactor;
+	size_t                            maxidle;
+	size_t                            maxperhost;
+	uint32_t                          idletimeout;
+	std::map<std::string,hostpool*>   hosts;
+	std::map<Socket*,hostpool*>       owned;
+};
+
+}
+
+#endif
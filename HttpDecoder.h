@@ -2,10 +2,14 @@
 #define _HTTPDECODER_H
 
 
+#include <limits.h>
 #include "HttpPacket.h"
 #include "Decoder.h"
 #include "http-parser/http_parser.h"
 
+//not exported by the header of http_parser 2.3
+extern "C" int http_message_needs_eof(const http_parser *parser);
+
 namespace net{
 
 class HttpDecoder : public Decoder{
@@ -21,7 +25,21 @@ struct luahttp_parser{
 };
 
 public:
-	HttpDecoder(int maxsize):m_packet(NULL),status(0),maxsize(maxsize > 65535 ? 65535 : maxsize),m_size(0){
+	//the arena of a HttpPacket is addressed with 32 bit offsets,a buffered
+	//message stays well below that
+	static const size_t MAXBUFFERED = 0x7fffffff;
+
+	//maxheader bounds the start line and headers,maxbody the body.0 is no
+	//limit with stream,a message with a body then comes out as a PART_HEAD
+	//packet,a PART_BODY packet for every piece of body received and a
+	//PART_END.a buffered body is never over MAXBUFFERED
+	HttpDecoder(size_t maxheader,size_t maxbody,bool stream = false,HttpRouter *router = NULL)
+		:m_packet(NULL),status(0),maxheader(maxheader),maxbody(maxbody),m_size(0),m_bodysize(0),
+		stream(stream),streaming(false),router(router){
+		if(this->maxheader > MAXBUFFERED/2)
+			this->maxheader = MAXBUFFERED/2;
+		if(!stream && (this->maxbody == 0 || this->maxbody > MAXBUFFERED/2))
+			this->maxbody = MAXBUFFERED/2;
 		m_parser.settings.on_message_begin = on_message_begin;
 		m_parser.settings.on_url = on_url;
 		m_parser.settings.on_status = on_status;
@@ -36,84 +54,186 @@ public:
 
 	virtual ~HttpDecoder(){ if(m_packet) delete m_packet;}
 
+	void Reset(){
+		if(m_packet){
+			delete m_packet;
+			m_packet = NULL;
+		}
+		status    = 0;
+		m_size    = 0;
+		m_bodysize = 0;
+		streaming = false;
+		http_parser_init((http_parser*)&m_parser,HTTP_BOTH);
+	}
+
 	Packet *unpack(char *buf,size_t pos,size_t size,size_t _,size_t &pklen,int &err){
 		Packet *ret = NULL;
 		pklen       = 0;
 		err         = 0;		
 		size_t nparsed = http_parser_execute((http_parser*)&m_parser,&m_parser.settings,&buf[pos],size);
-		if(nparsed > 0){
-			m_size += nparsed;
-			pklen = nparsed;
-		}
+		pklen = nparsed;
 		if(status == PACKET_COMPLETE){
+			//the parser stopped right after this packet,resuming it parses the
+			//rest on the following call
+			http_parser_pause((http_parser*)&m_parser,0);
 			status    = 0;
 			ret       = m_packet;
 			m_packet  = NULL;
-			http_parser_init((http_parser*)&m_parser,HTTP_BOTH);			
-		}else{
-			if(m_size >= maxsize) err = -1;
-			if(nparsed != size) err = -1;
-		}
+		}else if(nparsed != size)
+			err = -1;
 		return ret;
 	}
 
 private:
+	//the decoder stops after every packet it completes
+	void complete(){
+		status = PACKET_COMPLETE;
+		http_parser_pause((http_parser*)&m_parser,1);
+	}
+
+	int head(size_t length){
+		m_size += length;
+		return m_size > maxheader ? -1 : 0;
+	}
+
+	//whether a body follows the headers,as http_parser decides in s_headers_done
+	static bool hasBody(http_parser *parser){
+		if(parser->upgrade || (parser->flags & F_SKIPBODY)) return false;
+		if(parser->flags & F_CHUNKED) return true;
+		if(parser->content_length != ULLONG_MAX) return parser->content_length > 0;
+		return parser->type == HTTP_RESPONSE && http_message_needs_eof(parser);
+	}
+
 	static int on_message_begin (http_parser *_parser){
 		HttpDecoder *decoder = ((luahttp_parser*)_parser)->decoder;
 		if(decoder->m_packet) return -1;
-		decoder->m_packet = new HttpPacket;
+		decoder->m_packet   = new HttpPacket;
+		decoder->m_size     = 0;
+		decoder->m_bodysize = 0;
 		return 0;
 	}
 
 	static int on_url(http_parser *_parser, const char *at, size_t length){	
 		HttpDecoder *decoder = ((luahttp_parser*)_parser)->decoder;
 		decoder->m_packet->Append(URL,at,length);
-		return 0;
+		return decoder->head(length);
 	}
 
 	static int on_status(http_parser *_parser, const char *at, size_t length){
 		HttpDecoder *decoder = ((luahttp_parser*)_parser)->decoder;
 		decoder->m_packet->Append(STATUS,at,length);
-		return 0;			
+		return decoder->head(length);
 	}
 
 	static int on_header_field(http_parser *_parser, const char *at, size_t length){
 		HttpDecoder *decoder = ((luahttp_parser*)_parser)->decoder;
 		decoder->m_packet->Append(HEADER_FIELD,at,length);
-		return 0;			
+		return decoder->head(length);
 	}
 
 	static int on_header_value(http_parser *_parser, const char *at, size_t length){
 		HttpDecoder *decoder = ((luahttp_parser*)_parser)->decoder;
 		decoder->m_packet->Append(HEADER_VALUE,at,length);
-		return 0;			
+		return decoder->head(length);
 	}
 
 	static int on_headers_complete(http_parser *_parser){
 		HttpDecoder *decoder = ((luahttp_parser*)_parser)->decoder;
-		decoder->m_packet->SetMethod(_parser->method);
+		HttpPacket  *packet  = decoder->m_packet;
+		packet->HeadersComplete();
+		packet->SetMethod(_parser->method);
+		packet->SetVersion(_parser->http_major,_parser->http_minor);
+		packet->SetKeepAlive(http_should_keep_alive(_parser) != 0);
+		if(decoder->router)
+			packet->Route(decoder->router);
+		//refuse a body known to be too large before any of it arrives
+		uint64_t length = _parser->content_length;
+		if(length != ULLONG_MAX && decoder->maxbody && length > decoder->maxbody)
+			return -1;
+		if(decoder->stream && hasBody(_parser)){
+			packet->SetPart(PART_HEAD);
+			decoder->streaming = true;
+			decoder->complete();
+		}else if(length != ULLONG_MAX && length > 0)
+			packet->Reserve(length);
 		return 0;		
 	}
 
 	static int on_body(http_parser *_parser, const char *at, size_t length){
 		HttpDecoder *decoder = ((luahttp_parser*)_parser)->decoder;
-		decoder->m_packet->Append(BODY,at,length);
+		decoder->m_bodysize += length;
+		if(decoder->maxbody && decoder->m_bodysize > decoder->maxbody)
+			return -1;
+		if(decoder->streaming){
+			decoder->m_packet = new HttpPacket(PART_BODY);
+			decoder->m_packet->Append(BODY,at,length);
+			decoder->complete();
+		}else
+			decoder->m_packet->Append(BODY,at,length);
 		return 0;					
 	}
 
 	static int on_message_complete(http_parser *_parser){	
 		HttpDecoder *decoder = ((luahttp_parser*)_parser)->decoder;
-		decoder->status = PACKET_COMPLETE;
-		return -1;							
+		if(decoder->streaming){
+			decoder->streaming = false;
+			decoder->m_packet  = new HttpPacket(PART_END);
+			decoder->m_packet->SetKeepAlive(http_should_keep_alive(_parser) != 0);
+		}
+		decoder->complete();
+		return 0;							
 	}	
 
 private:
 	struct luahttp_parser m_parser;
 	HttpPacket           *m_packet;
 	int                   status;
-	size_t                maxsize;
-	size_t  			  m_size;	                
+	size_t                maxheader;
+	size_t                maxbody;
+	size_t                m_size;//start line and headers
+	size_t                m_bodysize;
+	bool                  stream;
+	bool                  streaming;//between the PART_HEAD and PART_END of a message
+	HttpRouter           *router;
+
+};
 
+//keep the decoders of closed sockets for the next accepted ones
+class HttpDecoderFactory : public DecoderFactory{
+public:
+	//requests decoded with a router come out already matched against it
+	HttpDecoderFactory(size_t maxheader,size_t maxbody,bool stream = false,HttpRouter *router = NULL,size_t maxfree = 256)
+		:maxheader(maxheader),maxbody(maxbody),stream(stream),maxfree(maxfree),router(router ? router->IncRef() : NULL){}
+
+	Decoder *Get(){
+		if(freelist.empty())
+			return new HttpDecoder(maxheader,maxbody,stream,router);
+		HttpDecoder *d = freelist.back();
+		freelist.pop_back();
+		return d;
+	}
+
+	void Put(Decoder *d){
+		HttpDecoder *decoder = (HttpDecoder*)d;
+		if(freelist.size() < maxfree){
+			decoder->Reset();
+			freelist.push_back(decoder);
+		}else
+			delete decoder;
+	}
+
+private:
+	~HttpDecoderFactory(){
+		for(size_t i = 0; i < freelist.size(); ++i)
+			delete freelist[i];
+		if(router) router->DecRef();
+	}
+	size_t                     maxheader;
+	size_t                     maxbody;
+	bool                       stream;
+	size_t                     maxfree;
+	HttpRouter                *router;
+	std::vector<HttpDecoder*>  freelist;
 };
 
 }
@@ -3,6 +3,7 @@
 
 #include "Packet.h"
 #include "LuaUtil.h"
+#include "HttpRouter.h"
 
 enum{
 	URL = 1,
@@ -12,42 +13,64 @@ enum{
 	BODY,
 };
 
+//what a packet of a streaming HttpDecoder carries
+enum{
+	PART_MESSAGE = 0,//a whole message
+	PART_HEAD,//the headers,the body follows in PART_BODY packets
+	PART_BODY,//the next piece of the body
+	PART_END,//the body is complete
+};
+
 namespace net{
 
+//the url,status,headers and body all live in one pooled arena buffer,the
+//packet only keeps offsets into it,so parsing a request costs no per-field
+//allocation and a Clone shares the arena
 class HttpPacket : public Packet{
 private:
+	struct slice{
+		uint32_t off;
+		uint32_t len;
+	};
+
+	struct header{
+		slice field;
+		slice value;
+	};
+
+	//headers looked up by nearly every handler,indexed while parsing
+	enum{
+		KNOWN_CONTENT_LENGTH = 0,
+		KNOWN_CONNECTION,
+		KNOWN_HOST,
+		KNOWN_COUNT,
+	};
 
 public:
-	HttpPacket():Packet(HTTPPACKET,NULL),m_method(-1),m_bodysize(0){
+	HttpPacket(int part = PART_MESSAGE):Packet(HTTPPACKET,NULL),m_method(-1),m_major(0),m_minor(0),m_keepalive(false),m_used(0),m_last(0),
+		m_router(NULL),m_route(NULL),m_part(part){
+		for(int i = 0; i < KNOWN_COUNT; ++i)
+			m_known[i] = -1;
+		memset(&m_url,0,sizeof(m_url));
+		memset(&m_status,0,sizeof(m_status));
+		memset(&m_body,0,sizeof(m_body));
 	}
 
-	~HttpPacket(){}
+	~HttpPacket(){
+		if(m_router) m_router->DecRef();
+	}
 
-	HttpPacket(const HttpPacket &o):Packet(HTTPPACKET,NULL){
-			m_header_field = o.m_header_field;
-			m_header_value = o.m_header_value;
-			m_status = o.m_status;
-			m_url    = o.m_url;
-			m_bodysize = o.m_bodysize;
-			if(o.m_buffer){
-				m_buffer = o.m_buffer;
-				m_buffer->IncRef();
-			}
-			m_method = o.m_method;
+	HttpPacket(const HttpPacket &o):Packet(HTTPPACKET,o.m_buffer),m_router(NULL){
+		copy(o);
 	}
 
 	HttpPacket& operator = (const HttpPacket &o){
 		if(&o != this){
-			m_header_field = o.m_header_field;
-			m_header_value = o.m_header_value;
-			m_status = o.m_status;
-			m_url    = o.m_url;
-			m_method = o.m_method;
-			m_bodysize = o.m_bodysize;			
-			if(o.m_buffer){
-				m_buffer = o.m_buffer;
-				m_buffer->IncRef();
-			}			
+			if(o.m_buffer) o.m_buffer->IncRef();
+			if(m_buffer) m_buffer->DecRef();
+			m_buffer = o.m_buffer;
+			if(m_router) m_router->DecRef();
+			copy(o);
 		}	
 		return *this;
 	} 		
@@ -60,8 +83,17 @@ public:
 		return NULL;
 	}
 
+	//the copy may be posted to another worker:the route and its handler belong
+	//to the lua state and the thread of this one,so they are left behind
 	Packet *MakeReadPacket(){
-		return Clone();
+		HttpPacket *rpk = new HttpPacket(*this);
+		if(rpk->m_router){
+			rpk->m_router->DecRef();
+			rpk->m_router = NULL;
+		}
+		rpk->m_route = NULL;
+		rpk->m_params.clear();
+		return rpk;
 	}	
 
 	size_t PkLen(){
@@ -80,65 +112,235 @@ public:
 		return m_method;
 	}
 
+	void SetVersion(int major,int minor){
+		m_major = major;
+		m_minor = minor;
+	}
+
+	//http/1.1 is 1,1,0,0 when unknown
+	void GetVersion(int &major,int &minor){
+		major = m_major;
+		minor = m_minor;
+	}
+
+	void SetPart(int part){
+		m_part = part;
+	}
+
+	int  GetPart(){
+		return m_part;
+	}
+
+	//make room for size more bytes,for a body of known length.at most 64K up
+	//front,the rest grows as the body arrives:a peer may declare more than
+	//it sends
+	void Reserve(size_t size){
+		if(size > 65536) size = 65536;
+		if(!m_buffer) m_buffer = ByteBuffer::New(m_used + size);
+		else m_buffer->Reserve(m_used + size);
+	}
+
+	//the connection may carry another message after this one
+	void SetKeepAlive(bool keepalive){
+		m_keepalive = keepalive;
+	}
+
+	bool KeepAlive(){
+		return m_keepalive;
+	}
+
+	//the parser may hand a field over in pieces,they arrive back to back
+	//so a piece just extends the slice of the field it belongs to
 	void Append(int type,const char *str,size_t len){
+		if(!m_buffer) m_buffer = ByteBuffer::New(1024);
+		uint32_t pos = m_used;
+		m_buffer->WriteBin(pos,(void*)str,len);
+		m_used += len;
 		if(type == URL){
-			for(size_t i = 0;i < len;++i)
-				m_url.push_back(str[i]);
+			extend(m_url,pos,len);
 		}else if(type == STATUS){
-			for(size_t i = 0;i < len;++i)
-				m_status.push_back(str[i]);		
+			extend(m_status,pos,len);
 		}else if(type == BODY){
-			if(!m_buffer) m_buffer = new ByteBuffer(1024);
-			m_buffer->WriteBin(m_bodysize,(void*)(str),len);
-			m_bodysize += len;						
+			extend(m_body,pos,len);
 		}else if(type == HEADER_FIELD){
-			if(m_header_field.size() == m_header_value.size()){
-				m_header_field.push_back(std::string(""));
+			if(m_last != HEADER_FIELD){
+				if(m_headers.empty()) m_headers.reserve(16);
+				m_headers.push_back(header());
+				memset(&m_headers.back(),0,sizeof(header));
 			}
-			std::string *ptr = &m_header_field[m_header_field.size()-1];
-			for(size_t i = 0;i < len;++i)
-				ptr->push_back(str[i]);			
+			extend(m_headers.back().field,pos,len);
 		}else if(type == HEADER_VALUE){
-			if(m_header_field.size() != m_header_value.size()){
-				m_header_value.push_back(std::string(""));
-			}			
-			std::string *ptr = &m_header_value[m_header_value.size()-1];
-			for(size_t i = 0;i < len;++i)
-				ptr->push_back(str[i]);				
-		}			
+			if(m_headers.empty()) return;
+			endField();
+			extend(m_headers.back().value,pos,len);
+		}
+		m_last = type;
 	}
 
-	const char *GetUrl(){
-		return m_url.c_str();
+	const char *GetUrl(size_t &len){
+		return get(m_url,len);
 	}
 
-	const char *GetStatus(){
-		return m_status.c_str();
+	const char *GetStatus(size_t &len){
+		return get(m_status,len);
 	}
 
 	const char *GetBody(size_t &len){
-		if(!m_buffer) return NULL;
-		len = m_bodysize;
-		return &m_buffer->Buf()[0];
+		return get(m_body,len);
+	}
+
+	//a last header with an empty value gets no HEADER_VALUE to end its field
+	void HeadersComplete(){
+		endField();
+	}
+
+	//value of the first header called name(case insensitive),false if there is none
+	bool GetHeader(const char *name,size_t nlen,const char *&value,size_t &len){
+		int i = knownIndex(name,nlen);
+		if(i >= 0)
+			i = m_known[i];
+		else{
+			for(size_t j = 0; j < m_headers.size(); ++j){
+				const slice &field = m_headers[j].field;
+				if(field.len == nlen && equal(&m_buffer->Buf()[field.off],name,nlen)){
+					i = (int)j;
+					break;
+				}
+			}
+		}
+		if(i < 0) return false;
+		value = get(m_headers[i].value,len);
+		if(!value) value = "";
+		return true;
+	}
+
+	//match the url against router,called once the headers are parsed
+	void Route(HttpRouter *router){
+		if(m_router){
+			m_router->DecRef();
+			m_router = NULL;
+		}
+		m_params.clear();
+		size_t len;
+		const char *url = GetUrl(len);
+		m_route = router->Match(m_method,url ? url : "",len,this);
+		if(m_route) m_router = router->IncRef();
+	}
+
+	//the route matched by Route,NULL if none did
+	const HttpRouter::route *GetRoute(){
+		return m_route;
+	}
+
+	//a decoded path capture of the matched route,kept in the arena
+	void AddParam(const char *value,size_t len){
+		if(!m_buffer) m_buffer = ByteBuffer::New(1024);
+		slice s = {m_used,(uint32_t)len};
+		m_buffer->WriteBin(m_used,(void*)value,len);
+		m_used += len;
+		m_params.push_back(s);
+	}
+
+	//{name = value} of the route captures
+	void PushParams(lua_State *L){
+		lua_newtable(L);
+		if(!m_route) return;
+		for(size_t i = 0; i < m_params.size() && i < m_route->names.size(); ++i){
+			size_t len;
+			const char *str = get(m_params[i],len);
+			lua_pushstring(L, m_route->names[i].c_str());
+			lua_pushlstring(L, str ? str : "", len);
+			lua_rawset(L, -3);
+		}
 	}
 
 	void PushHeaders(lua_State *L){
 		lua_newtable(L);
-		size_t size = m_header_value.size();
+		size_t size = m_headers.size();
 		for(size_t i = 0; i < size; ++i){
-			lua_pushstring(L, m_header_field[i].c_str());
-			lua_pushstring(L, m_header_value[i].c_str());
+			size_t len;
+			const char *str = get(m_headers[i].field,len);
+			lua_pushlstring(L, str ? str : "", len);
+			str = get(m_headers[i].value,len);
+			lua_pushlstring(L, str ? str : "", len);
 			lua_rawset(L, -3);
 		}
 	}
 	
 private:
-	std::vector<std::string> m_header_field;
-	std::vector<std::string> m_header_value;	
-	std::string              m_url;
-	std::string              m_status;
+	static bool equal(const char *a,const char *b,size_t len){
+		for(size_t i = 0; i < len; ++i){
+			char x = a[i],y = b[i];
+			if(x >= 'A' && x <= 'Z') x += 'a' - 'A';
+			if(y >= 'A' && y <= 'Z') y += 'a' - 'A';
+			if(x != y) return false;
+		}
+		return true;
+	}
+
+	static int knownIndex(const char *name,size_t len){
+		static const char *names[KNOWN_COUNT] = {"content-length","connection","host"};
+		static const size_t lens[KNOWN_COUNT] = {14,10,4};
+		for(int i = 0; i < KNOWN_COUNT; ++i)
+			if(len == lens[i] && equal(name,names[i],len))
+				return i;
+		return -1;
+	}
+
+	void endField(){
+		if(m_last != HEADER_FIELD) return;
+		const slice &field = m_headers.back().field;
+		size_t i = m_headers.size() - 1;
+		int known = knownIndex(&m_buffer->Buf()[field.off],field.len);
+		if(known >= 0 && m_known[known] < 0)
+			m_known[known] = (int)i;
+	}
+
+	void copy(const HttpPacket &o){
+		for(int i = 0; i < KNOWN_COUNT; ++i)
+			m_known[i] = o.m_known[i];
+		m_headers   = o.m_headers;
+		m_params    = o.m_params;
+		m_route     = o.m_route;
+		m_part      = o.m_part;
+		m_router    = o.m_router ? o.m_router->IncRef() : NULL;
+		m_url       = o.m_url;
+		m_status    = o.m_status;
+		m_body      = o.m_body;
+		m_method    = o.m_method;
+		m_major     = o.m_major;
+		m_minor     = o.m_minor;
+		m_keepalive = o.m_keepalive;
+		m_used      = o.m_used;
+		m_last      = o.m_last;
+	}
+
+	static void extend(slice &s,uint32_t pos,size_t len){
+		if(s.len == 0) s.off = pos;
+		s.len += len;
+	}
+
+	const char *get(const slice &s,size_t &len){
+		len = s.len;
+		if(!m_buffer || s.len == 0) return NULL;
+		return &m_buffer->Buf()[s.off];
+	}
+
+	std::vector<header>      m_headers;
+	slice                    m_url;
+	slice                    m_status;
+	slice                    m_body;
 	int                      m_method;
-	size_t                   m_bodysize;
+	int                      m_major;
+	int                      m_minor;
+	bool                     m_keepalive;
+	uint32_t                 m_used;
+	int                      m_last;//type of the last Append
+	int                      m_known[KNOWN_COUNT];//header index or -1
+	HttpRouter              *m_router;
+	const HttpRouter::route *m_route;
+	std::vector<slice>       m_params;
+	int                      m_part;
 };
 
 }
@@ -0,0 +1,228 @@
+#ifndef _HTTPRESPONSE_H
+#define _HTTPRESPONSE_H
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include "RawBinPacket.h"
+#include "Deflater.h"
+
+namespace net{
+
+//writes an http/1.1 response straight into a pooled ByteBuffer:the status
+//line,then headers,then Build adds Date,Connection,Content-Length and the body
+//and hands the buffer to a RawBinPacket without copying it
+class HttpResponse{
+public:
+	HttpResponse(int status,const char *phrase = NULL):m_buffer(ByteBuffer::New(512)),m_size(0),m_status(status){
+		size_t len;
+		const char *line = statusLine(status,len);
+		//"HTTP/1.1 200 " is 13 bytes,the phrase runs up to the "\r\n"
+		if(line && (!phrase || (strlen(phrase) == len - 15 && memcmp(line + 13,phrase,len - 15) == 0)))
+			append(line,len);
+		else{
+			char buf[256];
+			int n = snprintf(buf,sizeof(buf),"HTTP/1.1 %d %s",status,phrase ? phrase : "");
+			if(n >= (int)sizeof(buf) - 2) n = sizeof(buf) - 3;
+			//a phrase can't end the status line early
+			for(int i = 9; i < n; ++i)
+				if(buf[i] == '\r' || buf[i] == '\n') buf[i] = ' ';
+			buf[n++] = '\r';
+			buf[n++] = '\n';
+			append(buf,n);
+		}
+	}
+
+	~HttpResponse(){
+		if(m_buffer) m_buffer->DecRef();
+	}
+
+	bool Built(){
+		return m_buffer == NULL;
+	}
+
+	//false for a name or value holding CR or LF,nothing is added then:a value
+	//taken from a request could otherwise start headers or a body of its own
+	bool AddHeader(const char *name,size_t nlen,const char *value,size_t vlen){
+		if(hasLineBreak(name,nlen) || hasLineBreak(value,vlen)) return false;
+		append(name,nlen);
+		append(": ",2);
+		append(value,vlen);
+		append("\r\n",2);
+		return true;
+	}
+
+	//a complete "Name: value" line
+	bool AddHeader(const char *line,size_t len){
+		if(hasLineBreak(line,len)) return false;
+		append(line,len);
+		append("\r\n",2);
+		return true;
+	}
+
+	//the response is finished,only the destructor may be called afterwards.
+	//with an encoding the body is compressed by a deflate stream of the thread
+	Packet *Build(const char *body,size_t len,bool keepalive,int encoding = ENCODING_IDENTITY,int level = 6){
+		ByteBuffer *out = NULL;
+		if(encoding != ENCODING_IDENTITY){
+			Deflater *deflater = Deflater::Shared(encoding,level);
+			if(deflater->Ok()){
+				out  = ByteBuffer::New(len/2 + 64);
+				len  = deflater->Write(out,0,body ? body : "",len,Z_FINISH);
+				body = &out->Buf()[0];
+				contentEncoding(encoding);
+			}
+		}
+		common(keepalive);
+		if(bodiless()){
+			append("\r\n",2);
+			if(out) out->DecRef();
+			return finish();
+		}
+		char buf[64];
+		int n = snprintf(buf,sizeof(buf),"Content-Length: %u\r\n\r\n",(unsigned int)len);
+		append(buf,n);
+		if(len) append(body,len);
+		if(out) out->DecRef();
+		return finish();
+	}
+
+	//the head of a response whose length bytes of body are sent as their own
+	//packets(a file),or that has none(HEAD,304)
+	Packet *BuildHead(size_t length,bool keepalive){
+		common(keepalive);
+		if(bodiless()){
+			append("\r\n",2);
+			return finish();
+		}
+		char buf[64];
+		int n = snprintf(buf,sizeof(buf),"Content-Length: %llu\r\n\r\n",(unsigned long long)length);
+		append(buf,n);
+		return finish();
+	}
+
+	//the head of a response whose body follows in Chunk packets,without chunked
+	//(an http/1.0 peer) the body is sent as is and ends with the connection
+	Packet *BuildStream(bool keepalive,bool chunked,int encoding = ENCODING_IDENTITY){
+		common(keepalive && chunked);
+		if(encoding != ENCODING_IDENTITY)
+			contentEncoding(encoding);
+		if(chunked)
+			append("Transfer-Encoding: chunked\r\n\r\n",30);
+		else
+			append("\r\n",2);
+		return finish();
+	}
+
+	//one piece of a chunked body,an empty one ends the body
+	static Packet *Chunk(const char *data,size_t len){
+		if(len == 0) return new RawBinPacket("0\r\n\r\n",5);
+		char head[32];
+		int n = snprintf(head,sizeof(head),"%x\r\n",(unsigned int)len);
+		ByteBuffer *buffer = ByteBuffer::New(n + len + 2);
+		buffer->WriteBin(0,head,n);
+		buffer->WriteBin(n,(void*)data,len);
+		buffer->WriteBin(n + len,(void*)"\r\n",2);
+		Packet *packet = new RawBinPacket(buffer,n + len + 2);
+		buffer->DecRef();
+		return packet;
+	}
+
+private:
+	HttpResponse(const HttpResponse&);
+	HttpResponse& operator = (const HttpResponse&);
+
+	//1xx and 204 have no body and must not announce one
+	bool bodiless(){
+		return (m_status >= 100 && m_status < 200) || m_status == 204;
+	}
+
+	static bool hasLineBreak(const char *data,size_t len){
+		return memchr(data,'\r',len) != NULL || memchr(data,'\n',len) != NULL;
+	}
+
+	void common(bool keepalive){
+		size_t dlen;
+		const char *date = dateHeader(dlen);
+		append(date,dlen);
+		if(keepalive)
+			append("Connection: keep-alive\r\n",24);
+		else
+			append("Connection: close\r\n",19);
+	}
+
+	void contentEncoding(int encoding){
+		const char *name = EncodingName(encoding);
+		append("Content-Encoding: ",18);
+		append(name,strlen(name));
+		append("\r\nVary: Accept-Encoding\r\n",25);
+	}
+
+	Packet *finish(){
+		Packet *packet = new RawBinPacket(m_buffer,m_size);
+		m_buffer->DecRef();
+		m_buffer = NULL;
+		return packet;
+	}
+
+	void append(const char *data,size_t len){
+		m_buffer->WriteBin(m_size,(void*)data,len);
+		m_size += len;
+	}
+
+	static const char *statusLine(int status,size_t &len){
+		#define STATUS_LINE(CODE,TEXT) case CODE:{\
+			static const char line[] = "HTTP/1.1 " #CODE " " TEXT "\r\n";\
+			len = sizeof(line) - 1;\
+			return line;}
+		switch(status){
+			STATUS_LINE(200,"OK")
+			STATUS_LINE(201,"Created")
+			STATUS_LINE(204,"No Content")
+			STATUS_LINE(206,"Partial Content")
+			STATUS_LINE(301,"Moved Permanently")
+			STATUS_LINE(302,"Found")
+			STATUS_LINE(304,"Not Modified")
+			STATUS_LINE(400,"Bad Request")
+			STATUS_LINE(401,"Unauthorized")
+			STATUS_LINE(403,"Forbidden")
+			STATUS_LINE(404,"Not Found")
+			STATUS_LINE(405,"Method Not Allowed")
+			STATUS_LINE(413,"Payload Too Large")
+			STATUS_LINE(416,"Range Not Satisfiable")
+			STATUS_LINE(500,"Internal Server Error")
+			STATUS_LINE(502,"Bad Gateway")
+			STATUS_LINE(503,"Service Unavailable")
+			default:return NULL;
+		}
+		#undef STATUS_LINE
+	}
+
+	//"Date: ...\r\n",formatted at most once a second per thread
+	static const char *dateHeader(size_t &len){
+		static __thread time_t last = 0;
+		static __thread char   line[64];
+		static __thread size_t size = 0;
+		time_t now = time(NULL);
+		if(now != last){
+			struct tm tm;
+#ifdef _WIN
+			gmtime_s(&tm,&now);
+#else
+			gmtime_r(&now,&tm);
+#endif
+			size = strftime(line,sizeof(line),"Date: %a, %d %b %Y %H:%M:%S GMT\r\n",&tm);
+			last = now;
+		}
+		len = size;
+		return line;
+	}
+
+	ByteBuffer *m_buffer;
+	size_t      m_size;
+	int         m_status;
+};
+
+}
+
+#endif
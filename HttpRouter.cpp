@@ -0,0 +1,155 @@
+#include "HttpRouter.h"
+#include "HttpPacket.h"
+
+namespace net{
+
+static inline int hexvalue(char c){
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+size_t UrlDecode(const char *src,size_t len,char *dst,bool plus){
+	size_t n = 0;
+	for(size_t i = 0; i < len; ++i){
+		char c = src[i];
+		if(c == '%' && i + 2 < len && hexvalue(src[i+1]) >= 0 && hexvalue(src[i+2]) >= 0){
+			c  = (char)(hexvalue(src[i+1]) << 4 | hexvalue(src[i+2]));
+			i += 2;
+		}else if(c == '+' && plus)
+			c = ' ';
+		dst[n++] = c;
+	}
+	return n;
+}
+
+HttpRouter::node::~node(){
+	std::map<std::string,node*>::iterator it = children.begin();
+	for(; it != children.end(); ++it)
+		delete it->second;
+	std::map<int,route*>::iterator r = routes.begin();
+	for(; r != routes.end(); ++r)
+		delete r->second;
+	delete param;
+	delete rest;
+}
+
+bool HttpRouter::Add(int method,const char *pattern,luaRef handler){
+	if(!pattern || pattern[0] != '/') return false;
+	std::vector<std::string> names;
+	node *n = root;
+	const char *p = pattern;
+	while(*p){
+		while(*p == '/') ++p;
+		const char *end = p;
+		while(*end && *end != '/') ++end;
+		if(end == p) break;
+		std::string seg(p,end - p);
+		if(seg[0] == ':'){
+			if(!n->param) n->param = new node;
+			n = n->param;
+			names.push_back(seg.substr(1));
+		}else if(seg[0] == '*'){
+			//the rest of the path,nothing may follow it
+			if(*end) return false;
+			if(!n->rest) n->rest = new node;
+			n = n->rest;
+			names.push_back(seg.substr(1));
+		}else{
+			node *&child = n->children[seg];
+			if(!child) child = new node;
+			n = child;
+		}
+		p = end;
+	}
+	route *&r = n->routes[method];
+	if(!r)
+		r = new route(std::move(handler));
+	else
+		r->handler = std::move(handler);
+	r->names = names;
+	return true;
+}
+
+static inline HttpRouter::route *findroute(std::map<int,HttpRouter::route*> &routes,int method){
+	std::map<int,HttpRouter::route*>::iterator it = routes.find(method);
+	if(it == routes.end()) it = routes.find(-1);
+	return it == routes.end() ? NULL : it->second;
+}
+
+const HttpRouter::route *HttpRouter::match(node *n,size_t i,int method){
+	if(i == segments.size()){
+		route *r = findroute(n->routes,method);
+		if(!r && n->rest && (r = findroute(n->rest->routes,method))){
+			//"/files/*path" also matches "/files"
+			segment empty = {path.size(),0};
+			captures.push_back(empty);
+		}
+		return r;
+	}
+	const segment &seg = segments[i];
+	if(!n->children.empty()){
+		std::map<std::string,node*>::iterator it = n->children.find(path.substr(seg.off,seg.len));
+		if(it != n->children.end()){
+			const route *r = match(it->second,i + 1,method);
+			if(r) return r;
+		}
+	}
+	if(n->param){
+		captures.push_back(seg);
+		const route *r = match(n->param,i + 1,method);
+		if(r) return r;
+		captures.pop_back();
+	}
+	if(n->rest){
+		route *r = findroute(n->rest->routes,method);
+		if(r){
+			segment rest = {seg.off,path.size() - seg.off};
+			captures.push_back(rest);
+			return r;
+		}
+	}
+	return NULL;
+}
+
+const HttpRouter::route *HttpRouter::Match(int method,const char *url,size_t len,HttpPacket *packet){
+	size_t plen = 0;
+	while(plen < len && url[plen] != '?' && url[plen] != '#') ++plen;
+	//an absolute form url,skip the scheme and host
+	if(plen > 0 && url[0] != '/'){
+		const char *p = (const char*)memchr(url,':',plen);
+		if(!p || p + 3 > url + plen || p[1] != '/' || p[2] != '/') return NULL;
+		p = (const char*)memchr(p + 3,'/',url + plen - (p + 3));
+		if(!p) p = url + plen;
+		plen -= p - url;
+		url  = p;
+	}
+	path.resize(plen);
+	segments.clear();
+	captures.clear();
+	size_t n = 0;
+	size_t i = 0;
+	while(i < plen){
+		while(i < plen && url[i] == '/') ++i;
+		size_t end = i;
+		while(end < plen && url[end] != '/') ++end;
+		if(end == i) break;
+		if(!segments.empty()) path[n++] = '/';
+		segment seg;
+		seg.off = n;
+		seg.len = UrlDecode(url + i,end - i,&path[n],false);
+		n += seg.len;
+		segments.push_back(seg);
+		i = end;
+	}
+	path.resize(n);
+	const route *r = match(root,0,method);
+	if(r && packet){
+		for(size_t j = 0; j < captures.size(); ++j)
+			packet->AddParam(path.data() + captures[j].off,captures[j].len);
+	}
+	return r;
+}
+
+}
@@ -0,0 +1,92 @@
+#ifndef _HTTPROUTER_H
+#define _HTTPROUTER_H
+
+#include <map>
+#include <vector>
+#include <string>
+#include "LuaUtil.h"
+
+#ifdef _WIN
+#include <Windows.h>
+#endif
+
+namespace net{
+
+class HttpPacket;
+
+//percent-decode len bytes of src into dst(at most len bytes),with plus a '+'
+//becomes a space as in a query string.returns the decoded size
+size_t UrlDecode(const char *src,size_t len,char *dst,bool plus);
+
+//a trie of path segments:"users" matches itself,":id" matches any one segment
+//and "*path" the rest of the path.static segments win over ":" and ":" over
+//"*".the router is used by the reactor that owns it,every HttpDecoderFactory
+//and matched HttpPacket holds a ref
+class HttpRouter{
+public:
+	struct route{
+		luaRef                    handler;
+		std::vector<std::string>  names;//capture names in path order
+		route(luaRef handler):handler(std::move(handler)){}
+	};
+
+	HttpRouter():refCount(1),root(new node){}
+
+	HttpRouter *IncRef(){
+#ifdef _WIN
+		InterlockedIncrement(&refCount);
+#else
+		__sync_add_and_fetch(&refCount,1);
+#endif
+		return this;
+	}
+
+	void DecRef(){
+#ifdef _WIN
+		if(InterlockedDecrement(&refCount) <= 0)
+#else
+		if(__sync_sub_and_fetch(&refCount,1) <=0 )
+#endif
+			delete this;
+	}
+
+	//method is an http_parser method,-1 for any.a second Add replaces the handler
+	bool Add(int method,const char *pattern,luaRef handler);
+
+	//match the path of url,the decoded captures are added to packet in path order
+	const route *Match(int method,const char *url,size_t len,HttpPacket *packet);
+
+private:
+	struct node{
+		std::map<std::string,node*>  children;
+		node                        *param;
+		node                        *rest;
+		std::map<int,route*>         routes;
+		node():param(NULL),rest(NULL){}
+		~node();
+	};
+
+	struct segment{
+		size_t off;
+		size_t len;
+	};
+
+	HttpRouter(const HttpRouter&);
+	HttpRouter& operator = (const HttpRouter&);
+	~HttpRouter(){
+		delete root;
+	}
+
+	const route *match(node *n,size_t i,int method);
+
+	volatile long         refCount;
+	node                 *root;
+	//scratch space of Match:the decoded path,its segments and captures
+	std::string           path;
+	std::vector<segment>  segments;
+	std::vector<segment>  captures;
+};
+
+}
+
+#endif
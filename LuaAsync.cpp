@@ -0,0 +1,153 @@
+#include "LuaAsync.h"
+#include "ThreadPool.h"
+#include "Md5.h"
+#include "Deflater.h"
+#include <map>
+
+static bool task_md5(const std::string &args,std::string &result){
+	result = net::Md5::Hex(args.data(),args.size());
+	return true;
+}
+
+//args compressed in one go,the deflater is the pool thread's own
+static bool compress(int encoding,const std::string &args,std::string &result){
+	net::Deflater *deflater = net::Deflater::Shared(encoding,6);
+	if(!deflater->Ok()){
+		result = "deflate init failed";
+		return false;
+	}
+	net::ByteBuffer *buffer = net::ByteBuffer::New(args.size()/2 + 64);
+	size_t len = deflater->Write(buffer,0,args.data(),args.size(),Z_FINISH);
+	result.assign(&buffer->Buf()[0],len);
+	buffer->DecRef();
+	return true;
+}
+
+static bool task_gzip(const std::string &args,std::string &result){
+	return compress(net::ENCODING_GZIP,args,result);
+}
+
+static bool task_deflate(const std::string &args,std::string &result){
+	return compress(net::ENCODING_DEFLATE,args,result);
+}
+
+//for tests and benchmarks:blocks a pool thread for args ms
+static bool task_sleep(const std::string &args,std::string &result){
+	int ms = atoi(args.c_str());
+#ifdef _WIN
+	Sleep(ms);
+#else
+	usleep(ms*1000);
+#endif
+	result = args;
+	return true;
+}
+
+static std::map<std::string,AsyncTaskFunc> builtin_tasks(){
+	std::map<std::string,AsyncTaskFunc> tasks;
+	tasks["md5"]     = task_md5;
+	tasks["gzip"]    = task_gzip;
+	tasks["deflate"] = task_deflate;
+	tasks["sleep"]   = task_sleep;
+	return tasks;
+}
+
+//filled once before any lookup,read only while workers run
+static std::map<std::string,AsyncTaskFunc> &async_tasks(){
+	static std::map<std::string,AsyncTaskFunc> tasks = builtin_tasks();
+	return tasks;
+}
+
+void RegAsyncTask(const char *name,AsyncTaskFunc func){
+	async_tasks()[name] = func;
+}
+
+class AsyncJob : public net::Job{
+public:
+	AsyncJob(AsyncTaskFunc func,const char *args,size_t len,luaRef &&cb)
+		:func(func),args(args,len),cb(std::move(cb)),ok(false){}
+
+	void Work(){
+		ok = func(args,result);
+	}
+
+	void Do(net::Reactor*){
+		lua_State *L = cb.GetLState();
+		if(!L) return;
+		int oldtop = lua_gettop(L);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, cb.GetIndex());
+		if(ok){
+			lua_pushlstring(L,result.data(),result.size());
+			lua_pushnil(L);
+		}else{
+			lua_pushnil(L);
+			lua_pushlstring(L,result.data(),result.size());
+		}
+		if(0 != lua_pcall(L, 2, 0, 0))
+			printf("%s\n",lua_tostring(L,-1));
+		lua_settop(L, oldtop);
+	}
+
+private:
+	AsyncTaskFunc func;
+	std::string   args;
+	std::string   result;
+	luaRef        cb;
+	bool          ok;
+};
+
+//C.Async(taskName,args[,function(result,err) end]):args is a string(or number),
+//the callback runs during the C.Run of the calling state once the task is done
+static int Async(lua_State *L){
+	const char *name = luaL_checkstring(L,1);
+	std::map<std::string,AsyncTaskFunc>::iterator it = async_tasks().find(name);
+	if(it == async_tasks().end())
+		return luaL_error(L,"unknown async task %s",name);
+	size_t len = 0;
+	const char *args = lua_isnoneornil(L,2) ? "" : luaL_checklstring(L,2,&len);
+	luaRef cb(L,3);
+	net::Reactor *reactor = (net::Reactor*)lua_touserdata(L,lua_upvalueindex(1));
+	net::ThreadPool::Default()->Submit(reactor,new AsyncJob(it->second,args,len,std::move(cb)));
+	return 0;
+}
+
+//C.Task(taskName,args):runs the task of C.Async on the calling thread and
+//returns result,err.for inputs too small to be worth a trip to the pool
+static int Task(lua_State *L){
+	const char *name = luaL_checkstring(L,1);
+	std::map<std::string,AsyncTaskFunc>::iterator it = async_tasks().find(name);
+	if(it == async_tasks().end())
+		return luaL_error(L,"unknown async task %s",name);
+	size_t len = 0;
+	const char *args = lua_isnoneornil(L,2) ? "" : luaL_checklstring(L,2,&len);
+	std::string result;
+	if(it->second(std::string(args,len),result)){
+		lua_pushlstring(L,result.data(),result.size());
+		lua_pushnil(L);
+	}else{
+		lua_pushnil(L);
+		lua_pushlstring(L,result.data(),result.size());
+	}
+	return 2;
+}
+
+//C.StartAsync(n):size the pool before the first C.Async,returns the pool size
+static int StartAsync(lua_State *L){
+	lua_pushinteger(L,net::ThreadPool::Default(lua_tointeger(L,1))->Size());
+	return 1;
+}
+
+void RegLuaAsync(lua_State *L,net::Reactor *reactor){
+	lua_pushstring(L,"Async");
+	lua_pushlightuserdata(L,reactor);
+	lua_pushcclosure(L,Async,1);
+	lua_settable(L, -3);
+
+	lua_pushstring(L,"Task");
+	lua_pushcfunction(L,Task);
+	lua_settable(L, -3);
+
+	lua_pushstring(L,"StartAsync");
+	lua_pushcfunction(L,StartAsync);
+	lua_settable(L, -3);
+}
@@ -0,0 +1,21 @@
+#ifndef _LUAASYNC_H
+#define _LUAASYNC_H
+
+extern "C"{
+#include <lua.h>  
+#include <lauxlib.h>  
+#include <lualib.h>
+}
+
+#include <string>
+#include "Reactor.h"
+
+//a task run by C.Async on a pool thread,it must not touch any lua_State.
+//return false to pass result to the callback as the error
+typedef bool (*AsyncTaskFunc)(const std::string &args,std::string &result);
+
+//register a native task,do it before any worker starts
+void RegAsyncTask(const char *name,AsyncTaskFunc func);
+void RegLuaAsync(lua_State *L,net::Reactor *reactor);
+
+#endif // _LUAASYNC_H
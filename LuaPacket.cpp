@@ -4,6 +4,8 @@
 #include "WPacket.h"
 #include "HttpPacket.h"
 #include "RawBinPacket.h"
+#include "HttpResponse.h"
+#include "StaticFiles.h"
 
 enum{
 	L_TABLE = 1,
@@ -22,12 +24,20 @@ enum{
 
 typedef struct{
 	 net::Packet* packet;
+	 int          borrowed;//packet is owned by the native caller,only valid inside the callback
 }lua_packet,*lua_packet_t;
 
 #define LUARPACKET_METATABLE    "luarpacket_metatable"
 #define LUAWPACKET_METATABLE    "luawpacket_metatable"
 #define LUAHTTPPACKET_METATABLE "luahttppacket_metatable"
 #define LUARAWPACKET_METATABLE  "luarawpacket_metatable"
+#define LUAHTTPRESPONSE_METATABLE "luahttpresponse_metatable"
+#define LUAFILEPACKET_METATABLE "luafilepacket_metatable"
+#define LUASTATICFILES_METATABLE "luastaticfiles_metatable"
+#define LUADEFLATER_METATABLE "luadeflater_metatable"
+
+//registry key of the table holding one reusable packet handle per packet type
+static char tmppacket_pool;
 
 #define VAILD_KEY_TYPE(TYPE) (TYPE == LUA_TSTRING || TYPE == LUA_TNUMBER)
 #define VAILD_VAILD_TYPE(TYPE) (TYPE == LUA_TSTRING || TYPE == LUA_TNUMBER || TYPE == LUA_TTABLE || TYPE == LUA_TBOOLEAN)
@@ -234,6 +244,26 @@ inline static lua_packet_t lua_getluapacket(lua_State *L, int index) {
 	return (lua_packet_t)lua_touserdata(L,index);//luaL_checkudata(L, index, LUARPACKET_METATABLE);
 }
 
+static const char *packet_metatable(int type){
+	switch(type){
+		case WPACKET:return LUAWPACKET_METATABLE;
+		case RPACKET:return LUARPACKET_METATABLE;
+		case HTTPPACKET:return LUAHTTPPACKET_METATABLE;
+		case RAWBINARY:return LUARAWPACKET_METATABLE;
+		case FILEPACKET:return LUAFILEPACKET_METATABLE;
+		default:return NULL;
+	}
+}
+
+static lua_packet_t new_luapacket(lua_State *L,const char *metatable,net::Packet *packet){
+	lua_packet_t p = (lua_packet_t)lua_newuserdata(L, sizeof(*p));
+	luaL_getmetatable(L, metatable);
+	lua_setmetatable(L, -2);
+	p->packet   = packet;
+	p->borrowed = 0;
+	return p;
+}
+
 
 static int ReadUint8(lua_State *L){
 	lua_packet_t p = lua_getluapacket(L,1);
@@ -484,20 +514,14 @@ static int NewWPacket(lua_State *L){
 		if(len < 64) {
 			len = 64;
 		}
-		lua_packet_t p = (lua_packet_t)lua_newuserdata(L, sizeof(*p));
-		luaL_getmetatable(L, LUAWPACKET_METATABLE);
-		lua_setmetatable(L, -2);
-		p->packet = new net::WPacket(len);
+		new_luapacket(L,LUAWPACKET_METATABLE,new net::WPacket(len));
 		return 1;
 	} else if(argtype ==  LUA_TUSERDATA) {
 		lua_packet_t o = lua_getluapacket(L,1);
 		if(!o || !o->packet || o->packet->Type() != RPACKET) {
 			return luaL_error(L,"invaild opration for arg1");
 		}
-		lua_packet_t p = (lua_packet_t)lua_newuserdata(L, sizeof(*p));
-		luaL_getmetatable(L, LUAWPACKET_METATABLE);
-		lua_setmetatable(L, -2);
-		p->packet = new net::WPacket(*dynamic_cast<net::RPacket*>(o->packet));
+		new_luapacket(L,LUAWPACKET_METATABLE,new net::WPacket(*dynamic_cast<net::RPacket*>(o->packet)));
 		return 1;
 	} else if(argtype == LUA_TTABLE) {
 		net::WPacket* wpk = new net::WPacket(512);
@@ -505,10 +529,7 @@ static int NewWPacket(lua_State *L){
 			delete wpk;
 			return luaL_error(L,"table should not hava metatable");	
 		}else{
-			lua_packet_t p = (lua_packet_t)lua_newuserdata(L, sizeof(*p));
-			luaL_getmetatable(L, LUAWPACKET_METATABLE);
-			lua_setmetatable(L, -2);
-			p->packet = wpk;
+			new_luapacket(L,LUAWPACKET_METATABLE,wpk);
 		}
 		return 1;
 	} else {
@@ -522,10 +543,7 @@ static int NewRPacket(lua_State *L){
 		if(!o || !o->packet || o->packet->Type() != RPACKET) {
 			return luaL_error(L,"invaild opration for arg1");
 		}
-		lua_packet_t p = (lua_packet_t)lua_newuserdata(L, sizeof(*p));
-		luaL_getmetatable(L, LUARPACKET_METATABLE);
-		lua_setmetatable(L, -2);
-		p->packet = new net::RPacket(*dynamic_cast<net::RPacket*>(o->packet));
+		new_luapacket(L,LUARPACKET_METATABLE,new net::RPacket(*dynamic_cast<net::RPacket*>(o->packet)));
 		return 1;
 	} else {
 		return luaL_error(L,"invaild opration for arg1");
@@ -538,20 +556,14 @@ static int NewRawPacket(lua_State *L){
 		const char *str;
 		size_t len;
 		str = lua_tolstring(L,1,&len);
-		lua_packet_t p = (lua_packet_t)lua_newuserdata(L, sizeof(*p));
-		luaL_getmetatable(L, LUARAWPACKET_METATABLE);
-		lua_setmetatable(L, -2);
-		p->packet = new net::RawBinPacket(str,len);
+		new_luapacket(L,LUARAWPACKET_METATABLE,new net::RawBinPacket(str,len));
 		return 1;		
 	}else if(argtype == LUA_TUSERDATA){
 		lua_packet_t o = lua_getluapacket(L,1);
 		if(!o || !o->packet || o->packet->Type() != RAWBINARY) {
 			return luaL_error(L,"invaild opration for arg1");
 		}
-		lua_packet_t p = (lua_packet_t)lua_newuserdata(L, sizeof(*p));
-		luaL_getmetatable(L, LUARAWPACKET_METATABLE);
-		lua_setmetatable(L, -2);
-		p->packet = o->packet->Clone();
+		new_luapacket(L,LUARAWPACKET_METATABLE,o->packet->Clone());
 		return 1;
 	}else{
 		return luaL_error(L,"invaild opration for arg1");
@@ -575,27 +587,83 @@ static int ReadBinary(lua_State *L){
 
 static int destroy_luapacket(lua_State *L) {
 	lua_packet_t p = lua_getluapacket(L,1);
-	if(p->packet){
+	if(p->packet && !p->borrowed){
 		delete p->packet;
 	}
     return 0;
 }
 
-void push_luaPacket(lua_State *L,net::Packet *rpk){
-	lua_packet_t p = (lua_packet_t)lua_newuserdata(L, sizeof(*p));
-	switch(rpk->Type()){
-		case WPACKET:luaL_getmetatable(L, LUAWPACKET_METATABLE);break;
-		case RPACKET:luaL_getmetatable(L, LUARPACKET_METATABLE);break;
-		case HTTPPACKET:luaL_getmetatable(L, LUAHTTPPACKET_METATABLE);break;
-		case RAWBINARY:luaL_getmetatable(L, LUARAWPACKET_METATABLE);break;
-		default:{
-			assert(0);
+//detach a borrowed handle from the callback:the packet is cloned so the handle
+//stays valid after the callback returns,and it is no longer reused by the pool
+static int Retain(lua_State *L){
+	lua_packet_t p = lua_getluapacket(L,1);
+	if (!p || !p->packet) return luaL_error(L,"invaild opration");
+	if(p->borrowed){
+		int type = p->packet->Type();
+		p->packet   = p->packet->Clone();
+		p->borrowed = 0;
+		lua_rawgetp(L,LUA_REGISTRYINDEX,&tmppacket_pool);
+		lua_rawgeti(L,-1,type);
+		if(lua_rawequal(L,-1,1)){
 			lua_pushnil(L);
-			return;
+			lua_rawseti(L,-3,type);
 		}
 	}
-	lua_setmetatable(L, -2);
-	p->packet = rpk->Clone();	
+	lua_settop(L,1);
+	return 1;
+}
+
+//free the native packet now instead of waiting for the gc
+static int Release(lua_State *L){
+	lua_packet_t p = lua_getluapacket(L,1);
+	if(p && p->packet && !p->borrowed){
+		delete p->packet;
+		p->packet = NULL;
+	}
+	return 0;
+}
+
+void push_luaPacket(lua_State *L,net::Packet *rpk){
+	const char *metatable = packet_metatable(rpk->Type());
+	if(!metatable){
+		assert(0);
+		lua_pushnil(L);
+		return;
+	}
+	new_luapacket(L,metatable,rpk->Clone());
+}
+
+void push_tmpLuaPacket(lua_State *L,net::Packet *rpk){
+	int type = rpk->Type();
+	const char *metatable = packet_metatable(type);
+	if(!metatable){
+		assert(0);
+		lua_pushnil(L);
+		return;
+	}
+	lua_rawgetp(L,LUA_REGISTRYINDEX,&tmppacket_pool);
+	lua_rawgeti(L,-1,type);
+	lua_packet_t p = lua_getluapacket(L,-1);
+	if(!p){
+		//first use of this type,cache the handle
+		lua_pop(L,1);
+		p = new_luapacket(L,metatable,NULL);
+		lua_pushvalue(L,-1);
+		lua_rawseti(L,-3,type);
+	}else if(p->packet){
+		//cached handle still in use by an outer callback
+		lua_pop(L,1);
+		p = new_luapacket(L,metatable,NULL);
+	}
+	lua_remove(L,-2);
+	p->packet   = rpk;
+	p->borrowed = 1;
+}
+
+void release_tmpLuaPacket(lua_State *L,int index){
+	lua_packet_t p = lua_getluapacket(L,index);
+	if(p && p->borrowed)
+		p->packet = NULL;
 }
 
 net::Packet *toLuaPacket(lua_State *L,int index){
@@ -610,9 +678,10 @@ static int GetUrl(lua_State *L){
 	lua_packet_t p = lua_getluapacket(L,1);
 	if (!p || !p->packet) return luaL_error(L,"invaild opration");
 	net::HttpPacket *rpk = dynamic_cast<net::HttpPacket*>(p->packet);
-	const char *url = rpk->GetUrl();
+	size_t len;
+	const char *url = rpk->GetUrl(len);
 	if(url)
-		lua_pushstring(L,url);
+		lua_pushlstring(L,url,len);
 	else
 		lua_pushnil(L);
 	return 1;	
@@ -622,9 +691,10 @@ static int GetStatus(lua_State *L){
 	lua_packet_t p = lua_getluapacket(L,1);
 	if (!p || !p->packet) return luaL_error(L,"invaild opration");
 	net::HttpPacket *rpk = dynamic_cast<net::HttpPacket*>(p->packet);
-	const char *status = rpk->GetStatus();
+	size_t len;
+	const char *status = rpk->GetStatus(len);
 	if(status)
-		lua_pushstring(L,status);
+		lua_pushlstring(L,status,len);
 	else
 		lua_pushnil(L);
 	return 1;	
@@ -660,6 +730,90 @@ static int GetHeaders(lua_State *L){
 	return 1;	
 }
 
+//req:GetHeader(name),nil when the header is missing
+static int GetHeader(lua_State *L){
+	lua_packet_t p = lua_getluapacket(L,1);
+	if (!p || !p->packet) return luaL_error(L,"invaild opration");
+	net::HttpPacket *rpk = dynamic_cast<net::HttpPacket*>(p->packet);
+	size_t nlen,len;
+	const char *name = luaL_checklstring(L,2,&nlen);
+	const char *value;
+	if(rpk->GetHeader(name,nlen,value,len))
+		lua_pushlstring(L,value,len);
+	else
+		lua_pushnil(L);
+	return 1;
+}
+
+int push_httpRoute(lua_State *L,net::HttpPacket *rpk){
+	net::HttpRouter::route *route = (net::HttpRouter::route*)rpk->GetRoute();
+	if(!route){
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, route->handler.GetIndex());
+	rpk->PushParams(L);
+	return 2;
+}
+
+//req:Route(),the handler and captures matched by the router of the decoder
+static int Route(lua_State *L){
+	lua_packet_t p = lua_getluapacket(L,1);
+	if (!p || !p->packet) return luaL_error(L,"invaild opration");
+	return push_httpRoute(L,dynamic_cast<net::HttpPacket*>(p->packet));
+}
+
+static void push_urldecoded(lua_State *L,const char *str,size_t len){
+	char buf[256];
+	if(len <= sizeof(buf)){
+		lua_pushlstring(L,buf,net::UrlDecode(str,len,buf,true));
+		return;
+	}
+	std::string tmp(len,0);
+	lua_pushlstring(L,&tmp[0],net::UrlDecode(str,len,&tmp[0],true));
+}
+
+//req:GetQuery(),{name = value} of the query string,percent-decoded
+static int GetQuery(lua_State *L){
+	lua_packet_t p = lua_getluapacket(L,1);
+	if (!p || !p->packet) return luaL_error(L,"invaild opration");
+	net::HttpPacket *rpk = dynamic_cast<net::HttpPacket*>(p->packet);
+	size_t len;
+	const char *url = rpk->GetUrl(len);
+	const char *end = url + len;
+	const char *q   = url ? (const char*)memchr(url,'?',len) : NULL;
+	lua_newtable(L);
+	if(!q) return 1;
+	const char *hash = (const char*)memchr(q,'#',end - q);
+	if(hash) end = hash;
+	for(const char *pair = q + 1; pair < end;){
+		const char *amp = (const char*)memchr(pair,'&',end - pair);
+		if(!amp) amp = end;
+		const char *eq = (const char*)memchr(pair,'=',amp - pair);
+		const char *kend = eq ? eq : amp;
+		if(kend > pair){
+			push_urldecoded(L,pair,kend - pair);
+			if(eq)
+				push_urldecoded(L,eq + 1,amp - eq - 1);
+			else
+				lua_pushstring(L,"");
+			lua_rawset(L,-3);
+		}
+		pair = amp + 1;
+	}
+	return 1;
+}
+
+//"message","head","body" or "end",see HttpDecoder
+static int Part(lua_State *L){
+	static const char *parts[] = {"message","head","body","end"};
+	lua_packet_t p = lua_getluapacket(L,1);
+	if (!p || !p->packet) return luaL_error(L,"invaild opration");
+	net::HttpPacket *rpk = dynamic_cast<net::HttpPacket*>(p->packet);
+	lua_pushstring(L,parts[rpk->GetPart()]);
+	return 1;
+}
+
 static int GetMethod(lua_State *L){
 	lua_packet_t p = lua_getluapacket(L,1);
 	if (!p || !p->packet) return luaL_error(L,"invaild opration");
@@ -673,6 +827,258 @@ static int GetMethod(lua_State *L){
 	return 1;
 }
 
+//req:AcceptEncoding(),"gzip","deflate" or nil as Accept-Encoding allows
+static int AcceptEncoding(lua_State *L){
+	lua_packet_t p = lua_getluapacket(L,1);
+	if (!p || !p->packet) return luaL_error(L,"invaild opration");
+	net::HttpPacket *rpk = dynamic_cast<net::HttpPacket*>(p->packet);
+	const char *value;
+	size_t len;
+	const char *name = NULL;
+	if(rpk->GetHeader("Accept-Encoding",15,value,len))
+		name = net::EncodingName(net::NegotiateEncoding(value,len));
+	if(name)
+		lua_pushstring(L,name);
+	else
+		lua_pushnil(L);
+	return 1;
+}
+
+//req:GetVersion(),major,minor
+static int GetVersion(lua_State *L){
+	lua_packet_t p = lua_getluapacket(L,1);
+	if (!p || !p->packet) return luaL_error(L,"invaild opration");
+	net::HttpPacket *rpk = dynamic_cast<net::HttpPacket*>(p->packet);
+	int major,minor;
+	rpk->GetVersion(major,minor);
+	lua_pushinteger(L,major);
+	lua_pushinteger(L,minor);
+	return 2;
+}
+
+static int KeepAlive(lua_State *L){
+	lua_packet_t p = lua_getluapacket(L,1);
+	if (!p || !p->packet) return luaL_error(L,"invaild opration");
+	net::HttpPacket *rpk = dynamic_cast<net::HttpPacket*>(p->packet);
+	lua_pushboolean(L,rpk->KeepAlive());
+	return 1;
+}
+
+//httpresponse
+
+static net::HttpResponse *lua_gethttpresponse(lua_State *L,int index){
+	net::HttpResponse **p = (net::HttpResponse**)luaL_testudata(L,index,LUAHTTPRESPONSE_METATABLE);
+	if(!p || !*p || (*p)->Built()) return NULL;
+	return *p;
+}
+
+static void push_httpresponse(lua_State *L,net::HttpResponse *res){
+	net::HttpResponse **p = (net::HttpResponse**)lua_newuserdata(L, sizeof(*p));
+	*p = res;
+	luaL_getmetatable(L, LUAHTTPRESPONSE_METATABLE);
+	lua_setmetatable(L, -2);
+}
+
+//C.HttpResponse(status[,phrase])
+static int NewHttpResponse(lua_State *L){
+	int status = (int)luaL_checkinteger(L,1);
+	const char *phrase = lua_isstring(L,2) ? lua_tostring(L,2) : NULL;
+	push_httpresponse(L,new net::HttpResponse(status,phrase));
+	return 1;
+}
+
+//res:Header(name,value) or res:Header("Name: value"),an error for CR or LF in either
+static int ResponseHeader(lua_State *L){
+	net::HttpResponse *res = lua_gethttpresponse(L,1);
+	if(!res) return luaL_error(L,"invaild opration");
+	size_t nlen,vlen;
+	const char *name = luaL_checklstring(L,2,&nlen);
+	bool ok;
+	if(lua_isnoneornil(L,3))
+		ok = res->AddHeader(name,nlen);
+	else{
+		const char *value = luaL_checklstring(L,3,&vlen);
+		ok = res->AddHeader(name,nlen,value,vlen);
+	}
+	if(!ok) return luaL_error(L,"invaild header:CR or LF");
+	return 0;
+}
+
+//res:Build([body,keepalive,encoding,level]),returns a rawpacket sharing the
+//response buffer.encoding "gzip" or "deflate" compresses the body
+static int ResponseBuild(lua_State *L){
+	net::HttpResponse *res = lua_gethttpresponse(L,1);
+	if(!res) return luaL_error(L,"invaild opration");
+	size_t len = 0;
+	const char *body = lua_isnoneornil(L,2) ? NULL : luaL_checklstring(L,2,&len);
+	bool keepalive = lua_toboolean(L,3) ? true : false;
+	int encoding   = net::EncodingByName(lua_isstring(L,4) ? lua_tostring(L,4) : NULL);
+	int level      = (int)luaL_optinteger(L,5,6);
+	new_luapacket(L,LUARAWPACKET_METATABLE,res->Build(body,len,keepalive,encoding,level));
+	return 1;
+}
+
+//res:BuildHead(length[,keepalive]),the head of a response whose body goes out
+//as a packet of its own
+static int ResponseBuildHead(lua_State *L){
+	net::HttpResponse *res = lua_gethttpresponse(L,1);
+	if(!res) return luaL_error(L,"invaild opration");
+	size_t length  = (size_t)luaL_checkinteger(L,2);
+	bool keepalive = lua_toboolean(L,3) ? true : false;
+	new_luapacket(L,LUARAWPACKET_METATABLE,res->BuildHead(length,keepalive));
+	return 1;
+}
+
+//res:BuildStream([keepalive,chunked,encoding]),the head of a response whose
+//body is sent after it,in C.HttpChunk packets when chunked or through a
+//C.Deflater of the same encoding
+static int ResponseBuildStream(lua_State *L){
+	net::HttpResponse *res = lua_gethttpresponse(L,1);
+	if(!res) return luaL_error(L,"invaild opration");
+	bool keepalive = lua_toboolean(L,2) ? true : false;
+	bool chunked   = lua_toboolean(L,3) ? true : false;
+	int encoding   = net::EncodingByName(lua_isstring(L,4) ? lua_tostring(L,4) : NULL);
+	new_luapacket(L,LUARAWPACKET_METATABLE,res->BuildStream(keepalive,chunked,encoding));
+	return 1;
+}
+
+//deflater
+
+static net::Deflater *lua_getdeflater(lua_State *L,int index){
+	net::Deflater **p = (net::Deflater**)luaL_testudata(L,index,LUADEFLATER_METATABLE);
+	return p ? *p : NULL;
+}
+
+//C.Deflater(encoding[,level]),the compression stage of a streamed body
+static int NewDeflater(lua_State *L){
+	int encoding = net::EncodingByName(luaL_checkstring(L,1));
+	if(encoding == net::ENCODING_IDENTITY) return luaL_error(L,"unknown encoding");
+	int level = (int)luaL_optinteger(L,2,6);
+	net::Deflater **p = (net::Deflater**)lua_newuserdata(L, sizeof(*p));
+	*p = new net::Deflater(encoding,level);
+	luaL_getmetatable(L, LUADEFLATER_METATABLE);
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+static int deflater_chunk(lua_State *L,bool finish){
+	net::Deflater *d = lua_getdeflater(L,1);
+	if(!d || !d->Ok()) return luaL_error(L,"invaild opration");
+	size_t len = 0;
+	const char *data = finish ? NULL : luaL_checklstring(L,2,&len);
+	bool chunked = lua_toboolean(L,finish ? 2 : 3) ? true : false;
+	int flush = Z_FINISH;
+	if(!finish)
+		flush = lua_isnoneornil(L,4) || lua_toboolean(L,4) ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+	net::Packet *packet = d->Chunk(data ? data : "",len,flush,chunked);
+	if(packet)
+		new_luapacket(L,LUARAWPACKET_METATABLE,packet);
+	else
+		lua_pushnil(L);
+	return 1;
+}
+
+//d:Chunk(data[,chunked,flush]),the compressed data so far,nil if none.with
+//flush false the data may wait in the stream for the next chunk
+static int DeflaterChunk(lua_State *L){
+	return deflater_chunk(L,false);
+}
+
+//d:Finish([chunked]),the rest of the stream(and the last chunk)
+static int DeflaterFinish(lua_State *L){
+	return deflater_chunk(L,true);
+}
+
+static int destroy_deflater(lua_State *L){
+	net::Deflater **p = (net::Deflater**)luaL_testudata(L,1,LUADEFLATER_METATABLE);
+	if(p && *p){
+		delete *p;
+		*p = NULL;
+	}
+	return 0;
+}
+
+//C.HttpChunk([data]),one chunk of a chunked body,nil or "" is the last chunk
+static int NewHttpChunk(lua_State *L){
+	size_t len = 0;
+	const char *data = lua_isnoneornil(L,1) ? NULL : luaL_checklstring(L,1,&len);
+	new_luapacket(L,LUARAWPACKET_METATABLE,net::HttpResponse::Chunk(data,len));
+	return 1;
+}
+
+static int destroy_httpresponse(lua_State *L){
+	net::HttpResponse **p = (net::HttpResponse**)luaL_testudata(L,1,LUAHTTPRESPONSE_METATABLE);
+	if(p && *p){
+		delete *p;
+		*p = NULL;
+	}
+	return 0;
+}
+
+//staticfiles
+
+static net::StaticFiles *lua_getstaticfiles(lua_State *L,int index){
+	net::StaticFiles **p = (net::StaticFiles**)luaL_testudata(L,index,LUASTATICFILES_METATABLE);
+	return p ? *p : NULL;
+}
+
+static size_t optfield(lua_State *L,int index,const char *name,size_t def){
+	if(!lua_istable(L,index)) return def;
+	lua_getfield(L,index,name);
+	size_t v = lua_isnumber(L,-1) ? (size_t)lua_tointeger(L,-1) : def;
+	lua_pop(L,1);
+	return v;
+}
+
+//C.StaticFiles(root[,{cache=,maxfile=,compress=}]),files up to maxfile bytes
+//(256KB) are cached,cache bytes(64MB) in all.cached text files of at least
+//compress bytes(1024,0 for never) are sent compressed when the client accepts
+static int NewStaticFiles(lua_State *L){
+	const char *root   = luaL_checkstring(L,1);
+	size_t cachesize   = optfield(L,2,"cache",64*1024*1024);
+	size_t maxfile     = optfield(L,2,"maxfile",256*1024);
+	size_t compressmin = optfield(L,2,"compress",1024);
+	net::StaticFiles **p = (net::StaticFiles**)lua_newuserdata(L, sizeof(*p));
+	*p = new net::StaticFiles(root,cachesize,maxfile,compressmin);
+	luaL_getmetatable(L, LUASTATICFILES_METATABLE);
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+//files:Respond(req[,path]),status,response,body,length:the response head is
+//finished with res:BuildHead(length,keepalive),body is nil or a packet to
+//send after it
+static int StaticFilesRespond(lua_State *L){
+	net::StaticFiles *files = lua_getstaticfiles(L,1);
+	if(!files) return luaL_error(L,"invaild opration");
+	lua_packet_t p = lua_getluapacket(L,2);
+	net::HttpPacket *req = p && p->packet ? dynamic_cast<net::HttpPacket*>(p->packet) : NULL;
+	if(!req) return luaL_error(L,"invaild request");
+	size_t plen = 0;
+	const char *path = lua_isstring(L,3) ? lua_tolstring(L,3,&plen) : NULL;
+	net::HttpResponse *res;
+	net::Packet *body;
+	size_t length;
+	int status = files->Respond(req,path,plen,res,body,length);
+	lua_pushinteger(L,status);
+	push_httpresponse(L,res);
+	if(body)
+		new_luapacket(L,packet_metatable(body->Type()),body);
+	else
+		lua_pushnil(L);
+	lua_pushinteger(L,(lua_Integer)length);
+	return 4;
+}
+
+static int destroy_staticfiles(lua_State *L){
+	net::StaticFiles **p = (net::StaticFiles**)luaL_testudata(L,1,LUASTATICFILES_METATABLE);
+	if(p && *p){
+		delete *p;
+		*p = NULL;
+	}
+	return 0;
+}
+
 #define SET_FUNCTION(L,NAME,FUNC) do{\
 	lua_pushstring(L,NAME);\
 	lua_pushcfunction(L,FUNC);\
@@ -686,6 +1092,9 @@ void RegLuaPacket(lua_State *L) {
         {NULL, NULL}
     };
 
+    lua_newtable(L);
+    lua_rawsetp(L,LUA_REGISTRYINDEX,&tmppacket_pool);
+
     luaL_Reg rpacket_methods[] = {
         {"ReadU8",  ReadUint8},
         {"ReadU16", ReadUint16},
@@ -696,6 +1105,8 @@ void RegLuaPacket(lua_State *L) {
         {"ReadNum", ReadDouble},        
         {"ReadStr", ReadString},
         {"ReadTable", ReadTable},
+        {"Retain", Retain},
+        {"Release", Release},
         {NULL, NULL}
     };
 
@@ -711,11 +1122,15 @@ void RegLuaPacket(lua_State *L) {
         {"RewriteU32",RewriteUint32},
         {"RewriteNum",RewriteDouble},
         {"GetWritePos",GetWritePos},
+        {"Retain",Retain},
+        {"Release",Release},
         {NULL, NULL}
     }; 
 
     luaL_Reg rawpacket_methods[] = {                 
 		{"ReadBinary", ReadBinary},
+        {"Retain", Retain},
+        {"Release", Release},
         {NULL, NULL}
     };
 
@@ -724,7 +1139,16 @@ void RegLuaPacket(lua_State *L) {
         {"GetStatus",GetStatus},
         {"GetBody",GetBody},       
         {"GetHeaders",GetHeaders},
+        {"GetHeader",GetHeader},
+        {"GetQuery",GetQuery},
+        {"Route",Route},
+        {"Part",Part},
         {"GetMethod",GetMethod},
+        {"GetVersion",GetVersion},
+        {"AcceptEncoding",AcceptEncoding},
+        {"KeepAlive",KeepAlive},
+        {"Retain",Retain},
+        {"Release",Release},
         {NULL, NULL}
     };
 
@@ -758,8 +1182,80 @@ void RegLuaPacket(lua_State *L) {
     lua_setfield(L, -2, "__index");
     lua_pop(L, 1); 
 
+    luaL_Reg httpresponse_mt[] = {
+        {"__gc", destroy_httpresponse},
+        {NULL, NULL}
+    };
+
+    luaL_Reg httpresponse_methods[] = {
+        {"Header", ResponseHeader},
+        {"Build", ResponseBuild},
+        {"BuildHead", ResponseBuildHead},
+        {"BuildStream", ResponseBuildStream},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, LUAHTTPRESPONSE_METATABLE);
+    luaL_setfuncs(L, httpresponse_mt, 0);
+
+    luaL_newlib(L, httpresponse_methods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    luaL_Reg filepacket_methods[] = {
+        {"Retain", Retain},
+        {"Release", Release},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, LUAFILEPACKET_METATABLE);
+    luaL_setfuncs(L, packet_mt, 0);
+
+    luaL_newlib(L, filepacket_methods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    luaL_Reg staticfiles_mt[] = {
+        {"__gc", destroy_staticfiles},
+        {NULL, NULL}
+    };
+
+    luaL_Reg staticfiles_methods[] = {
+        {"Respond", StaticFilesRespond},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, LUASTATICFILES_METATABLE);
+    luaL_setfuncs(L, staticfiles_mt, 0);
+
+    luaL_newlib(L, staticfiles_methods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    luaL_Reg deflater_mt[] = {
+        {"__gc", destroy_deflater},
+        {NULL, NULL}
+    };
+
+    luaL_Reg deflater_methods[] = {
+        {"Chunk", DeflaterChunk},
+        {"Finish", DeflaterFinish},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, LUADEFLATER_METATABLE);
+    luaL_setfuncs(L, deflater_mt, 0);
+
+    luaL_newlib(L, deflater_methods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
     SET_FUNCTION(L,"NewWPacket",NewWPacket);
     SET_FUNCTION(L,"NewRPacket",NewRPacket);
     SET_FUNCTION(L,"NewRawPacket",NewRawPacket);
+    SET_FUNCTION(L,"HttpResponse",NewHttpResponse);
+    SET_FUNCTION(L,"HttpChunk",NewHttpChunk);
+    SET_FUNCTION(L,"StaticFiles",NewStaticFiles);
+    SET_FUNCTION(L,"Deflater",NewDeflater);
 
 }
\ No newline at end of file
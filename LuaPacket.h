@@ -11,6 +11,12 @@ extern "C"{
 
 void RegLuaPacket(lua_State *L);
 void push_luaPacket(lua_State *L,net::Packet *rpk);
+//push a reusable handle borrowing rpk,it must be released before rpk is destroyed
+void push_tmpLuaPacket(lua_State *L,net::Packet *rpk);
+void release_tmpLuaPacket(lua_State *L,int index);
 net::Packet *toLuaPacket(lua_State *L,int index);
+namespace net{class HttpPacket;}
+//push the handler and {name = value} captures of the route rpk matched,nil if none
+int push_httpRoute(lua_State *L,net::HttpPacket *rpk);
 
 #endif // _LUAPACKET_H
\ No newline at end of file
@@ -0,0 +1,574 @@
+#include "LuaSocket.h"
+#include "LuaPacket.h"
+#include "Reactor.h"
+#include "HttpDecoder.h"
+#include "WebSocketDecoder.h"
+#include "HttpConnPool.h"
+#include "Resolver.h"
+
+typedef struct{
+	 net::Socket* s;
+}lua_socket,*lua_socket_t;
+
+typedef struct{
+	 net::DecoderFactory* factory;
+}lua_decoder,*lua_decoder_t;
+
+typedef struct{
+	 net::HttpConnPool* pool;
+}lua_httppool,*lua_httppool_t;
+
+typedef struct{
+	 net::HttpRouter* router;
+}lua_httprouter,*lua_httprouter_t;
+
+typedef struct{
+	 net::TlsContext* ctx;
+}lua_tlscontext,*lua_tlscontext_t;
+
+#define LUASOCKET_METATABLE  "luasocket_metatable"
+#define LUADECODER_METATABLE "luadecoder_metatable"
+#define LUAHTTPPOOL_METATABLE "luahttppool_metatable"
+#define LUAHTTPROUTER_METATABLE "luahttprouter_metatable"
+#define LUATLSCONTEXT_METATABLE "luatlscontext_metatable"
+
+inline static lua_socket_t lua_getluasocket(lua_State *L, int index) {
+	return (lua_socket_t)luaL_testudata(L, index, LUASOCKET_METATABLE);
+}
+
+//the socket keeps a registry reference to its handle until it is closed,so the
+//same userdata is pushed for every callback and no per call garbage is created
+void push_luaSocket(lua_State *L,net::Socket *s){
+	luaRef &handle = s->LuaHandle();
+	if(handle.GetLState()){
+		lua_rawgeti(L, LUA_REGISTRYINDEX, handle.GetIndex());
+		return;
+	}
+	lua_socket_t ls = (lua_socket_t)lua_newuserdata(L, sizeof(*ls));
+	luaL_getmetatable(L, LUASOCKET_METATABLE);
+	lua_setmetatable(L, -2);
+	s->IncRef();
+	ls->s = s;
+	if(s->State() != net::closeing)
+		handle = luaRef(L,-1);
+}
+
+net::Socket *toLuaSocket(lua_State *L,int index){
+	lua_socket_t ls = lua_getluasocket(L,index);
+	if(ls) return ls->s;
+	return NULL;
+}
+
+static net::DecoderFactory *toLuaDecoder(lua_State *L,int index){
+	lua_decoder_t d = (lua_decoder_t)luaL_testudata(L, index, LUADECODER_METATABLE);
+	if(d) return d->factory;
+	return NULL;
+}
+
+static void push_luaDecoder(lua_State *L,net::DecoderFactory *factory){
+	lua_decoder_t d = (lua_decoder_t)lua_newuserdata(L, sizeof(*d));
+	luaL_getmetatable(L, LUADECODER_METATABLE);
+	lua_setmetatable(L, -2);
+	d->factory = factory;
+}
+
+static int destroy_luadecoder(lua_State *L) {
+	lua_decoder_t d = (lua_decoder_t)luaL_testudata(L, 1, LUADECODER_METATABLE);
+	if(d && d->factory){
+		d->factory->DecRef();
+		d->factory = NULL;
+	}
+	return 0;
+}
+
+static int PacketDecoder(lua_State *L){
+	push_luaDecoder(L,net::PacketDecoderFactory::Default()->IncRef());
+	return 1;
+}
+
+static net::HttpRouter *toLuaHttpRouter(lua_State *L,int index){
+	lua_httprouter_t r = (lua_httprouter_t)luaL_testudata(L, index, LUAHTTPROUTER_METATABLE);
+	if(r) return r->router;
+	return NULL;
+}
+
+static size_t optfield(lua_State *L,int index,const char *name,size_t def){
+	lua_getfield(L,index,name);
+	size_t v = lua_isnumber(L,-1) ? (size_t)lua_tointeger(L,-1) : def;
+	lua_pop(L,1);
+	return v;
+}
+
+//C.HttpDecoder(maxsize[,router]) limits the headers and the body to maxsize each.
+//C.HttpDecoder({maxheader=,maxbody=,stream=,router=}),maxbody 0 for no
+//limit when streaming,a buffered body is capped at 1GB
+static int HttpDecoder(lua_State *L){
+	if(!lua_istable(L,1)){
+		size_t maxsize = (size_t)lua_tointeger(L,1);
+		push_luaDecoder(L,new net::HttpDecoderFactory(maxsize,maxsize,false,toLuaHttpRouter(L,2)));
+		return 1;
+	}
+	size_t maxheader = optfield(L,1,"maxheader",65535);
+	size_t maxbody   = optfield(L,1,"maxbody",1024*1024);
+	lua_getfield(L,1,"stream");
+	bool stream = lua_toboolean(L,-1) ? true : false;
+	lua_getfield(L,1,"router");
+	net::HttpRouter *router = toLuaHttpRouter(L,-1);
+	push_luaDecoder(L,new net::HttpDecoderFactory(maxheader,maxbody,stream,router));
+	return 1;
+}
+
+//C.WebSocketDecoder([maxmessage]),a message of more than maxmessage bytes
+//closes the connection
+static int WebSocketDecoder(lua_State *L){
+	size_t maxmessage = lua_isnumber(L,1) ? (size_t)lua_tointeger(L,1) : 1024*1024;
+	push_luaDecoder(L,new net::WebSocketDecoderFactory(maxmessage));
+	return 1;
+}
+
+static int HttpRouter(lua_State *L){
+	lua_httprouter_t r = (lua_httprouter_t)lua_newuserdata(L, sizeof(*r));
+	luaL_getmetatable(L, LUAHTTPROUTER_METATABLE);
+	lua_setmetatable(L, -2);
+	r->router = new net::HttpRouter;
+	return 1;
+}
+
+static int destroy_luahttprouter(lua_State *L) {
+	lua_httprouter_t r = (lua_httprouter_t)luaL_testudata(L, 1, LUAHTTPROUTER_METATABLE);
+	if(r && r->router){
+		r->router->DecRef();
+		r->router = NULL;
+	}
+	return 0;
+}
+
+static const char *http_methods[] = {
+#define XX(num, name, string) #string,
+	HTTP_METHOD_MAP(XX)
+#undef XX
+};
+
+//router:Add(method,pattern,function(req,res,params) end),method "*" or nil for any
+static int RouterAdd(lua_State *L){
+	net::HttpRouter *router = toLuaHttpRouter(L,1);
+	if(!router) return luaL_error(L,"invaild router");
+	int method = -1;
+	if(!lua_isnil(L,2)){
+		const char *name = luaL_checkstring(L,2);
+		if(strcmp(name,"*") != 0){
+			for(size_t i = 0; i < sizeof(http_methods)/sizeof(http_methods[0]); ++i)
+				if(strcmp(name,http_methods[i]) == 0)
+					method = (int)i;
+			if(method < 0) return luaL_error(L,"unknown method %s",name);
+		}
+	}
+	const char *pattern = luaL_checkstring(L,3);
+	luaL_checktype(L,4,LUA_TFUNCTION);
+	if(!router->Add(method,pattern,luaRef(L,4)))
+		return luaL_error(L,"invaild pattern %s",pattern);
+	return 0;
+}
+
+//router:Match(req),for requests not decoded with the router,same results as req:Route()
+static int RouterMatch(lua_State *L){
+	net::HttpRouter *router = toLuaHttpRouter(L,1);
+	if(!router) return luaL_error(L,"invaild router");
+	net::HttpPacket *rpk = dynamic_cast<net::HttpPacket*>(toLuaPacket(L,2));
+	if(!rpk) return luaL_error(L,"invaild packet");
+	rpk->Route(router);
+	return push_httpRoute(L,rpk);
+}
+
+static int destroy_luasocket(lua_State *L) {
+	lua_socket_t ls = lua_getluasocket(L,1);
+	if(ls && ls->s){
+		ls->s->DecRef();
+		ls->s = NULL;
+	}
+	return 0;
+}
+
+static int Close(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	s->Close();
+	return 0;
+}
+
+static int Send(lua_State *L){
+	net::Socket *s   = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	net::Packet *wpk = toLuaPacket(L, 2);
+	if(!wpk) return luaL_error(L,"invaild packet");
+	int  ret; 
+	if(lua_gettop(L) >= 3 && !lua_isnil(L,3)){
+		luaRef cb(L,3); 
+		ret = s->Send(wpk,&cb);
+	}else{
+		ret = s->Send(wpk,NULL);
+	}
+	lua_pushboolean(L,ret == 0 ? 1:0);
+	return 1;
+}
+
+//s:SendTo(packet,ip,port) on a C.Udp socket,false when the queue is full.ip
+//is an address,a host name only if the resolver has it cached(see C.Resolve)
+static int SendTo(lua_State *L){
+	net::Socket *s   = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	net::Packet *wpk = toLuaPacket(L, 2);
+	if(!wpk) return luaL_error(L,"invaild packet");
+	const char *ip = luaL_checkstring(L,3);
+	int port       = (int)luaL_checkinteger(L,4);
+	uint32_t addr;
+	if(!net::Resolver::Lookup(ip,addr))
+		return luaL_error(L,"unresolved host %s",ip);
+	lua_pushboolean(L,s->SendTo(wpk,addr,port) == 0 ? 1:0);
+	return 1;
+}
+
+static int PauseRead(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	s->PauseRead();
+	return 0;
+}
+
+static int ResumeRead(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	s->ResumeRead();
+	return 0;
+}
+
+//s:SetWatermark(high,low[,function(s) end])
+static int SetWatermark(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	size_t high = (size_t)luaL_checkinteger(L,2);
+	size_t low  = (size_t)luaL_optinteger(L,3,high/2);
+	s->SetWatermark(high,low,luaRef(L,4));
+	return 0;
+}
+
+static int Full(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	lua_pushboolean(L,s->Full());
+	return 1;
+}
+
+static int Pending(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	lua_pushinteger(L,(lua_Integer)s->Pending());
+	return 1;
+}
+
+//s:Compress([dict,level]),compress the stream from here on,see Socket::Compress.
+//both ends switch once a handshake in the clear agreed on it and dict
+static int Compress(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	size_t dlen = 0;
+	const char *dict = lua_isstring(L,2) ? lua_tolstring(L,2,&dlen) : NULL;
+	int level = (int)luaL_optinteger(L,3,Z_DEFAULT_COMPRESSION);
+	lua_pushboolean(L,s->Compress(dict,dlen,level));
+	return 1;
+}
+
+//s:Encrypt(sendkey,recvkey),ChaCha20-Poly1305 on the stream from here on,see
+//Socket::Encrypt.the keys are 32 byte strings a handshake derived,the peer
+//passes them swapped
+static int Encrypt(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	size_t slen,rlen;
+	const char *sendkey = luaL_checklstring(L,2,&slen);
+	const char *recvkey = luaL_checklstring(L,3,&rlen);
+	if(slen != net::StreamCipher::KEYLEN || rlen != net::StreamCipher::KEYLEN)
+		return luaL_error(L,"keys must be %d bytes",(int)net::StreamCipher::KEYLEN);
+	lua_pushboolean(L,s->Encrypt((const unsigned char*)sendkey,(const unsigned char*)recvkey));
+	return 1;
+}
+
+net::TlsContext *toLuaTlsContext(lua_State *L,int index){
+	lua_tlscontext_t t = (lua_tlscontext_t)luaL_testudata(L, index, LUATLSCONTEXT_METATABLE);
+	if(t) return t->ctx;
+	return NULL;
+}
+
+//C.TlsContext({cert=,key=,ca=,verify=}),pem files.a server context has a cert,
+//verify(the peer's certificate against ca,else the system's CAs) defaults to
+//true without one.returns nil,err on failure
+static int TlsContext(lua_State *L){
+	const char *cert = NULL,*key = NULL,*ca = NULL;
+	bool verify = true;
+	if(lua_istable(L,1)){
+		lua_getfield(L,1,"cert");
+		cert = lua_tostring(L,-1);
+		lua_getfield(L,1,"key");
+		key = lua_tostring(L,-1);
+		lua_getfield(L,1,"ca");
+		ca = lua_tostring(L,-1);
+		lua_getfield(L,1,"verify");
+		verify = lua_isnil(L,-1) ? cert == NULL : lua_toboolean(L,-1) != 0;
+	}
+	net::TlsContext *ctx = new net::TlsContext;
+	std::string err;
+	if(!ctx->Init(cert,key,ca,verify,err)){
+		ctx->DecRef();
+		lua_pushnil(L);
+		lua_pushstring(L,err.c_str());
+		return 2;
+	}
+	lua_tlscontext_t t = (lua_tlscontext_t)lua_newuserdata(L, sizeof(*t));
+	luaL_getmetatable(L, LUATLSCONTEXT_METATABLE);
+	lua_setmetatable(L, -2);
+	t->ctx = ctx;
+	return 1;
+}
+
+static int destroy_luatlscontext(lua_State *L) {
+	lua_tlscontext_t t = (lua_tlscontext_t)luaL_testudata(L, 1, LUATLSCONTEXT_METATABLE);
+	if(t && t->ctx){
+		t->ctx->DecRef();
+		t->ctx = NULL;
+	}
+	return 0;
+}
+
+//s:StartTLS(ctx[,servername[,function(s,success) end]]),the server end without
+//servername.on an accepted socket it belongs in the new client callback,
+//before anything is read
+static int StartTLS(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	net::TlsContext *ctx = toLuaTlsContext(L,2);
+	if(!ctx) return luaL_error(L,"invaild tls context");
+	const char *servername = lua_tostring(L,3);
+	lua_pushboolean(L,s->StartTLS(ctx,servername,NULL,luaRef(L,4)));
+	return 1;
+}
+
+//s:TlsInfo(),{version=,cipher=,resumed=} once the handshake finished or nil
+static int TlsInfo(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	net::TlsStream *t = s->Tls();
+	if(!t || !t->Established()){
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_newtable(L);
+	lua_pushstring(L,SSL_get_version(t->Ssl()));
+	lua_setfield(L,-2,"version");
+	lua_pushstring(L,SSL_get_cipher_name(t->Ssl()));
+	lua_setfield(L,-2,"cipher");
+	lua_pushboolean(L,SSL_session_reused(t->Ssl()));
+	lua_setfield(L,-2,"resumed");
+	return 1;
+}
+
+//s:CompressStats(),{out_plain=,out_wire=,in_wire=,in_plain=,usec=} or nil
+static int CompressStats(lua_State *L){
+	net::Socket *s = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	net::StreamCompressor *c = s->Compressor();
+	if(!c){
+		lua_pushnil(L);
+		return 1;
+	}
+	const net::StreamCompressor::stats &st = c->Stats();
+	lua_newtable(L);
+	lua_pushinteger(L,(lua_Integer)st.out_plain);
+	lua_setfield(L,-2,"out_plain");
+	lua_pushinteger(L,(lua_Integer)st.out_wire);
+	lua_setfield(L,-2,"out_wire");
+	lua_pushinteger(L,(lua_Integer)st.in_wire);
+	lua_setfield(L,-2,"in_wire");
+	lua_pushinteger(L,(lua_Integer)st.in_plain);
+	lua_setfield(L,-2,"in_plain");
+	lua_pushinteger(L,(lua_Integer)st.usec);
+	lua_setfield(L,-2,"usec");
+	return 1;
+}
+
+static int Bind(lua_State *L){
+	net::Socket  *s    = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	net::DecoderFactory *d = toLuaDecoder(L,2);
+	//the same two handlers are usually bound to every client
+	luaRef  cb_packet(L,3,true);
+	luaRef  cb_disconnected(L,4,true);
+	lua_pushboolean(L,s->Bind(s->GetReactor(),d,std::move(cb_packet),std::move(cb_disconnected)));
+	return 1;
+}
+
+//accepted sockets get their decoder from the factory and share the two callbacks,
+//the new client callback given to C.Listen becomes optional
+static int DefaultBind(lua_State *L){
+	net::Socket  *s    = toLuaSocket(L,1);
+	if(!s) return luaL_error(L,"invaild socket");
+	net::DecoderFactory *d = toLuaDecoder(L,2);
+	luaRef  cb_packet(L,3,true);
+	luaRef  cb_disconnected(L,4,true);
+	lua_pushboolean(L,s->DefaultBind(d,std::move(cb_packet),std::move(cb_disconnected)));
+	return 1;
+}
+
+//C.HttpConnPool(maxidle,maxperhost,idletimeout_ms)
+static int HttpConnPool(lua_State *L){
+	net::Reactor *reactor = (net::Reactor*)lua_touserdata(L,lua_upvalueindex(1));
+	int maxidle           = lua_isnumber(L,1) ? lua_tointeger(L,1) : 16;
+	int maxperhost        = lua_isnumber(L,2) ? lua_tointeger(L,2) : 64;
+	int idletimeout       = lua_isnumber(L,3) ? lua_tointeger(L,3) : 30000;
+	lua_httppool_t p      = (lua_httppool_t)lua_newuserdata(L, sizeof(*p));
+	luaL_getmetatable(L, LUAHTTPPOOL_METATABLE);
+	lua_setmetatable(L, -2);
+	p->pool = new net::HttpConnPool(reactor,maxidle < 0 ? 0 : maxidle,maxperhost,idletimeout);
+	return 1;
+}
+
+static net::HttpConnPool *toLuaHttpPool(lua_State *L,int index){
+	lua_httppool_t p = (lua_httppool_t)luaL_testudata(L, index, LUAHTTPPOOL_METATABLE);
+	if(p) return p->pool;
+	return NULL;
+}
+
+static int destroy_luahttppool(lua_State *L) {
+	lua_httppool_t p = (lua_httppool_t)luaL_testudata(L, 1, LUAHTTPPOOL_METATABLE);
+	if(p && p->pool){
+		delete p->pool;
+		p->pool = NULL;
+	}
+	return 0;
+}
+
+//pool:Acquire(host,port,function(s,success) end[,tls]),tls a C.TlsContext
+static int Acquire(lua_State *L){
+	net::HttpConnPool *pool = toLuaHttpPool(L,1);
+	if(!pool) return luaL_error(L,"invaild pool");
+	const char *host = luaL_checkstring(L,2);
+	int port         = luaL_checkinteger(L,3);
+	luaL_checktype(L,4,LUA_TFUNCTION);
+	pool->Acquire(host,port,luaRef(L,4),toLuaTlsContext(L,5));
+	return 0;
+}
+
+//pool:Release(s,keepalive)
+static int Release(lua_State *L){
+	net::HttpConnPool *pool = toLuaHttpPool(L,1);
+	if(!pool) return luaL_error(L,"invaild pool");
+	net::Socket *s = toLuaSocket(L,2);
+	if(!s) return luaL_error(L,"invaild socket");
+	pool->Release(s,lua_toboolean(L,3));
+	return 0;
+}
+
+#define SET_FUNCTION(L,NAME,FUNC) do{\
+	lua_pushstring(L,NAME);\
+	lua_pushcfunction(L,FUNC);\
+	lua_settable(L, -3);\
+}while(0)
+
+void RegLuaSocket(lua_State *L,net::Reactor *reactor){
+
+    luaL_Reg socket_mt[] = {
+        {"__gc", destroy_luasocket},
+        {NULL, NULL}
+    };
+
+    luaL_Reg socket_methods[] = {
+        {"Send",  Send},
+        {"SendTo", SendTo},
+        {"Close", Close},
+        {"Bind",  Bind},
+        {"DefaultBind", DefaultBind},
+        {"PauseRead", PauseRead},
+        {"ResumeRead", ResumeRead},
+        {"SetWatermark", SetWatermark},
+        {"Full", Full},
+        {"Pending", Pending},
+        {"Compress", Compress},
+        {"CompressStats", CompressStats},
+        {"Encrypt", Encrypt},
+        {"StartTLS", StartTLS},
+        {"TlsInfo", TlsInfo},
+        {NULL, NULL}
+    };
+
+    luaL_Reg decoder_mt[] = {
+        {"__gc", destroy_luadecoder},
+        {NULL, NULL}
+    };
+
+    luaL_Reg httppool_mt[] = {
+        {"__gc", destroy_luahttppool},
+        {NULL, NULL}
+    };
+
+    luaL_Reg httppool_methods[] = {
+        {"Acquire", Acquire},
+        {"Release", Release},
+        {NULL, NULL}
+    };
+
+    luaL_Reg httprouter_mt[] = {
+        {"__gc", destroy_luahttprouter},
+        {NULL, NULL}
+    };
+
+    luaL_Reg httprouter_methods[] = {
+        {"Add", RouterAdd},
+        {"Match", RouterMatch},
+        {NULL, NULL}
+    };
+
+    luaL_Reg tlscontext_mt[] = {
+        {"__gc", destroy_luatlscontext},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, LUATLSCONTEXT_METATABLE);
+    luaL_setfuncs(L, tlscontext_mt, 0);
+    lua_pop(L, 1);
+
+    luaL_newmetatable(L, LUAHTTPROUTER_METATABLE);
+    luaL_setfuncs(L, httprouter_mt, 0);
+    luaL_newlib(L, httprouter_methods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    luaL_newmetatable(L, LUAHTTPPOOL_METATABLE);
+    luaL_setfuncs(L, httppool_mt, 0);
+    luaL_newlib(L, httppool_methods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    luaL_newmetatable(L, LUADECODER_METATABLE);
+    luaL_setfuncs(L, decoder_mt, 0);
+    lua_pop(L, 1);
+
+    luaL_newmetatable(L, LUASOCKET_METATABLE);
+    luaL_setfuncs(L, socket_mt, 0);
+
+    luaL_newlib(L, socket_methods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    SET_FUNCTION(L,"Send",Send);
+    SET_FUNCTION(L,"Close",Close);
+    SET_FUNCTION(L,"Bind",Bind);
+    SET_FUNCTION(L,"PacketDecoder",PacketDecoder);
+    SET_FUNCTION(L,"HttpDecoder",HttpDecoder);
+    SET_FUNCTION(L,"WebSocketDecoder",WebSocketDecoder);
+    SET_FUNCTION(L,"HttpRouter",HttpRouter);
+    SET_FUNCTION(L,"TlsContext",TlsContext);
+
+    lua_pushstring(L,"HttpConnPool");
+    lua_pushlightuserdata(L,reactor);
+    lua_pushcclosure(L,HttpConnPool,1);
+    lua_settable(L, -3);
+}
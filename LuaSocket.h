@@ -0,0 +1,17 @@
+#ifndef _LUASOCKET_H
+#define _LUASOCKET_H
+
+extern "C"{
+#include <lua.h>  
+#include <lauxlib.h>  
+#include <lualib.h>
+}
+
+#include "Socket.h"
+
+void RegLuaSocket(lua_State *L,net::Reactor *reactor);
+void push_luaSocket(lua_State *L,net::Socket *s);
+net::Socket *toLuaSocket(lua_State *L,int index);
+net::TlsContext *toLuaTlsContext(lua_State *L,int index);
+
+#endif // _LUASOCKET_H
@@ -1,4 +1,3 @@
-
 #ifndef _LUAUTIL_H
 #define _LUAUTIL_H
 
@@ -8,50 +7,102 @@ extern "C"{
 #include <lualib.h>
 }
 #include <string>
+#include <utility>
 
+//a registry slot counted by an int from a free list of the thread:copies bump
+//it,moves touch nothing.shared refs to one lua function(or table/userdata),like
+//a handler bound to every client,also share the slot through the per state ref
+//table.that lookup costs more than a slot of its own,so fresh closures(send
+//callbacks) are not shared
 class luaRef{
-public:
-	luaRef(lua_State *L,int idx):L(L),rindex(-1){
-		if(L){
-			lua_pushvalue(L,idx);
-			this->rindex = luaL_ref(L,LUA_REGISTRYINDEX);
-			if(LUA_REFNIL == this->rindex)
-				this->L = NULL;
-			if(L) counter = new int(1);
+	struct slot{
+		int   count;
+		int   rindex;
+		bool  byvalue;
+		slot *next;//in the free list
+	};
+
+	//slots are carved from blocks that are never freed,a handful is in use at once
+	static slot *&freeslots(){
+		static __thread slot *head = NULL;
+		return head;
+	}
+
+	static slot *newslot(){
+		slot *&head = freeslots();
+		if(!head){
+			static const int n = 64;
+			slot *block = new slot[n];
+			for(int i = 0; i < n; ++i)
+				block[i].next = i + 1 < n ? &block[i + 1] : NULL;
+			head = block;
 		}
+		slot *s = head;
+		head = s->next;
+		return s;
+	}
+
+	static void freeslot(slot *s){
+		slot *&head = freeslots();
+		s->next = head;
+		head = s;
+	}
+
+public:
+	luaRef(lua_State *L,int idx,bool shared = false):L(NULL),rindex(LUA_NOREF),counter(NULL){
+		if(!L) return;
+		this->L = L;
+		if(shared && shareable(L,idx))
+			acquireShared(lua_absindex(L,idx));
+		else
+			acquire(idx);
+	}
+
+	luaRef(const luaRef &other)
+		:L(other.L),rindex(other.rindex),counter(other.counter)
+	{
+		if(counter) ++counter->count;
+	}
+
+	luaRef(luaRef &&other)
+		:L(other.L),rindex(other.rindex),counter(other.counter)
+	{
+		other.L       = NULL;
+		other.rindex  = LUA_NOREF;
+		other.counter = NULL;
 	}
 
 	luaRef &operator = (const luaRef & other)
 	{
-		if(this != &other && other.L)
+		if(this != &other)
 		{
-			if(L && counter && --(*counter) <= 0)
-			{
-				luaL_unref(this->L,LUA_REGISTRYINDEX,this->rindex);
-				delete counter;
-			}
-			counter = other.counter;
-			++(*counter);
-			this->rindex = other.rindex;
-			this->L = other.L;	
+			if(other.counter)
+				++other.counter->count;
+			release();
+			this->L       = other.L;
+			this->rindex  = other.rindex;
+			this->counter = other.counter;
 		}
 		return *this;
 	}
 
-	luaRef(const luaRef &other)
-		:L(other.L),rindex(other.rindex),counter(other.counter)
+	luaRef &operator = (luaRef &&other)
 	{
-		if(L && counter) ++(*counter);
+		if(this != &other)
+		{
+			release();
+			this->L       = other.L;
+			this->rindex  = other.rindex;
+			this->counter = other.counter;
+			other.L       = NULL;
+			other.rindex  = LUA_NOREF;
+			other.counter = NULL;
+		}
+		return *this;
 	}
 
 	~luaRef(){
-		if(L && counter){
-			if(!(--(*counter)))
-			{
-				luaL_unref(L,LUA_REGISTRYINDEX,rindex);
-				delete counter;
-			}
-		}
+		release();
 	}
 
 	lua_State *GetLState(){
@@ -63,9 +114,80 @@ public:
 	}
 
 private:
+
+	static bool shareable(lua_State *L,int idx){
+		int type = lua_type(L,idx);
+		return type == LUA_TFUNCTION || type == LUA_TTABLE || type == LUA_TUSERDATA;
+	}
+
+	//value -> slot,only for values that can be shared
+	static void pushreftable(lua_State *L){
+		static char key;
+		lua_rawgetp(L,LUA_REGISTRYINDEX,&key);
+		if(lua_isnil(L,-1)){
+			lua_pop(L,1);
+			lua_newtable(L);
+			lua_pushvalue(L,-1);
+			lua_rawsetp(L,LUA_REGISTRYINDEX,&key);
+		}
+	}
+
+	//nil gets no slot and leaves the ref empty
+	void acquire(int idx){
+		lua_pushvalue(L,idx);
+		rindex = luaL_ref(L,LUA_REGISTRYINDEX);
+		if(rindex == LUA_REFNIL){
+			L      = NULL;
+			rindex = LUA_NOREF;
+			return;
+		}
+		counter = newslot();
+		counter->count   = 1;
+		counter->rindex  = rindex;
+		counter->byvalue = false;
+	}
+
+	void acquireShared(int idx){
+		int top = lua_gettop(L);
+		pushreftable(L);
+		lua_pushvalue(L,idx);
+		lua_rawget(L,top+1);
+		if(lua_type(L,-1) == LUA_TLIGHTUSERDATA){
+			counter = (slot*)lua_touserdata(L,-1);
+			++counter->count;
+			rindex = counter->rindex;
+		}else{
+			acquire(idx);
+			counter->byvalue = true;
+			lua_pushvalue(L,idx);
+			lua_pushlightuserdata(L,counter);
+			lua_rawset(L,top+1);
+		}
+		lua_settop(L,top);
+	}
+
+	void release(){
+		if(!counter) return;
+		if(--counter->count <= 0){
+			if(counter->byvalue){
+				int top = lua_gettop(L);
+				pushreftable(L);
+				lua_rawgeti(L,LUA_REGISTRYINDEX,rindex);
+				lua_pushnil(L);
+				lua_rawset(L,top+1);
+				lua_settop(L,top);
+			}
+			luaL_unref(L,LUA_REGISTRYINDEX,rindex);
+			freeslot(counter);
+		}
+		L       = NULL;
+		rindex  = LUA_NOREF;
+		counter = NULL;
+	}
+
 	lua_State     *L;
 	int 		   rindex;
-	int*           counter;
+	slot          *counter;
 };
 
-#endif
\ No newline at end of file
+#endif
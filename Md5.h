@@ -0,0 +1,120 @@
+#ifndef _MD5_H
+#define _MD5_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+namespace net{
+
+//RFC 1321
+class Md5{
+public:
+	Md5():len(0){
+		h[0] = 0x67452301;
+		h[1] = 0xefcdab89;
+		h[2] = 0x98badcfe;
+		h[3] = 0x10325476;
+	}
+
+	void Update(const void *data,size_t size){
+		const unsigned char *p = (const unsigned char*)data;
+		size_t used = (size_t)(len & 63);
+		len += size;
+		if(used){
+			size_t n = 64 - used;
+			if(n > size) n = size;
+			memcpy(block + used,p,n);
+			p += n;
+			size -= n;
+			if(used + n < 64) return;
+			transform(block);
+		}
+		for(; size >= 64; p += 64,size -= 64)
+			transform(p);
+		memcpy(block,p,size);
+	}
+
+	void Final(unsigned char digest[16]){
+		static const unsigned char pad[64] = {0x80};
+		uint64_t bits = len << 3;
+		size_t used = (size_t)(len & 63);
+		Update(pad,used < 56 ? 56 - used : 120 - used);
+		unsigned char lenbuf[8];
+		for(int i = 0; i < 8; ++i)
+			lenbuf[i] = (unsigned char)(bits >> (8*i));
+		Update(lenbuf,8);
+		for(int i = 0; i < 16; ++i)
+			digest[i] = (unsigned char)(h[i>>2] >> (8*(i&3)));
+	}
+
+	static std::string Hex(const void *data,size_t size){
+		static const char hex[] = "0123456789abcdef";
+		Md5 md5;
+		unsigned char digest[16];
+		md5.Update(data,size);
+		md5.Final(digest);
+		std::string ret(32,'0');
+		for(int i = 0; i < 16; ++i){
+			ret[i*2]   = hex[digest[i] >> 4];
+			ret[i*2+1] = hex[digest[i] & 0xf];
+		}
+		return ret;
+	}
+
+private:
+	static uint32_t rotl(uint32_t x,int c){
+		return (x << c) | (x >> (32 - c));
+	}
+
+	void transform(const unsigned char *p){
+		static const uint32_t K[64] = {
+			0xd76aa478,0xe8c7b756,0x242070db,0xc1bdceee,0xf57c0faf,0x4787c62a,0xa8304613,0xfd469501,
+			0x698098d8,0x8b44f7af,0xffff5bb1,0x895cd7be,0x6b901122,0xfd987193,0xa679438e,0x49b40821,
+			0xf61e2562,0xc040b340,0x265e5a51,0xe9b6c7aa,0xd62f105d,0x02441453,0xd8a1e681,0xe7d3fbc8,
+			0x21e1cde6,0xc33707d6,0xf4d50d87,0x455a14ed,0xa9e3e905,0xfcefa3f8,0x676f02d9,0x8d2a4c8a,
+			0xfffa3942,0x8771f681,0x6d9d6122,0xfde5380c,0xa4beea44,0x4bdecfa9,0xf6bb4b60,0xbebfbc70,
+			0x289b7ec6,0xeaa127fa,0xd4ef3085,0x04881d05,0xd9d4d039,0xe6db99e5,0x1fa27cf8,0xc4ac5665,
+			0xf4292244,0x432aff97,0xab9423a7,0xfc93a039,0x655b59c3,0x8f0ccc92,0xffeff47d,0x85845dd1,
+			0x6fa87e4f,0xfe2ce6e0,0xa3014314,0x4e0811a1,0xf7537e82,0xbd3af235,0x2ad7d2bb,0xeb86d391};
+		static const int R[16] = {7,12,17,22,5,9,14,20,4,11,16,23,6,10,15,21};
+		uint32_t m[16];
+		for(int i = 0; i < 16; ++i)
+			m[i] = p[i*4] | (p[i*4+1] << 8) | (p[i*4+2] << 16) | ((uint32_t)p[i*4+3] << 24);
+		uint32_t a = h[0],b = h[1],c = h[2],d = h[3];
+		for(int i = 0; i < 64; ++i){
+			uint32_t f;
+			int g;
+			if(i < 16){
+				f = (b & c) | (~b & d);
+				g = i;
+			}else if(i < 32){
+				f = (d & b) | (~d & c);
+				g = (5*i + 1) & 15;
+			}else if(i < 48){
+				f = b ^ c ^ d;
+				g = (3*i + 5) & 15;
+			}else{
+				f = c ^ (b | ~d);
+				g = (7*i) & 15;
+			}
+			uint32_t tmp = d;
+			d = c;
+			c = b;
+			b = b + rotl(a + f + K[i] + m[g],R[(i >> 4)*4 + (i & 3)]);
+			a = tmp;
+		}
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+	}
+
+	uint32_t      h[4];
+	uint64_t      len;
+	unsigned char block[64];
+};
+
+}
+
+#endif
@@ -1,11 +1,14 @@
 #include "LuaUtil.h"
 #include "LuaPacket.h"
+#include "LuaSocket.h"
+#include "LuaAsync.h"
 #include "Socket.h"
 #include "Reactor.h"
 #include "RPacket.h"
 #include "WPacket.h"
 #include "SysTime.h"
-#include "HttpDecoder.h"
+#include "Worker.h"
+#include "Resolver.h"
 #include <signal.h>
 
 namespace net{
@@ -31,96 +34,212 @@ static inline void clean(){
 
 }
 
-static net::Reactor *g_reactor = NULL;
+//every thread running a lua_State(the main one or a worker) has its own reactor
+static __thread net::Reactor *g_reactor = NULL;
+
+//C.OnMessage callback of this thread's lua_State
+static __thread luaRef *g_on_message = NULL;
 
 bool Init(){
 	if(g_reactor) return false;
 	if(!net::init()) return false;
-	g_reactor = new net::Reactor;
+	net::Worker *w = net::Worker::Current();
+	g_reactor = w ? w->GetReactor() : new net::Reactor;
 	return true;
 }
 
+//a packet posted by C.PostMessage,delivered on the receiver's reactor thread
+class LuaMessage : public net::Task{
+public:
+	LuaMessage(int from,net::Packet *pk):from(from),pk(pk){}
+
+	~LuaMessage(){
+		delete pk;
+	}
+
+	void Do(net::Reactor*){
+		if(!g_on_message) return;
+		lua_State *L = g_on_message->GetLState();
+		int oldtop = lua_gettop(L);
+		push_tmpLuaPacket(L,pk);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, g_on_message->GetIndex());
+		lua_pushinteger(L,from);
+		lua_pushvalue(L,oldtop+1);
+		if(0 != lua_pcall(L, 2, 0, 0))
+			printf("%s\n",lua_tostring(L,-1));
+		release_tmpLuaPacket(L,oldtop+1);
+		lua_settop(L, oldtop);
+	}
+
+private:
+	int          from;
+	net::Packet *pk;
+};
 
-int lua_Close(lua_State *L){
-	net::Socket *s = (net::Socket*)lua_touserdata(L,1);
-	s->Close();
-	return 0;
-}
 
 int lua_Run(lua_State *L){
 	g_reactor->LoopOnce(lua_tointeger(L,1));
 	return 0;
 }
 
+//C.Connect(host,port,on_connect[,tls[,servername]]),with a C.TlsContext
+//on_connect is called after the handshake.servername defaults to host
 int lua_Connect(lua_State *L){
 	const char *ip = lua_tostring(L, 1);
 	int port       = lua_tointeger(L, 2);
 	luaRef cb(L,3);
+	net::TlsContext *tls = toLuaTlsContext(L,4);
 	net::Socket *s  = new net::Socket(AF_INET, SOCK_STREAM,IPPROTO_TCP);
-	lua_pushboolean(L,(int)s->Connect(g_reactor,ip,port,cb));
+	if(tls)
+		s->ConnectTLS(tls,lua_isstring(L,5) ? lua_tostring(L,5) : ip,NULL);
+	bool ret = s->Connect(g_reactor,ip,port,std::move(cb));
+	if(!ret) s->Close();
+	lua_pushboolean(L,(int)ret);
 	return 1;
 }
 
+//C.Listen(ip,port[,on_newclient[,backlog[,reuseport]]])
+//reuseport defaults to true inside a worker:every worker reactor gets its own
+//listening socket and the kernel spreads the accepts over them
 int lua_Listen(lua_State *L){
 	const char *ip = lua_tostring(L, 1);
 	int port       = lua_tointeger(L, 2);
 	luaRef cb(L,3);
-	net::Socket *s  = new net::Socket(AF_INET, SOCK_STREAM,IPPROTO_TCP);
-	if(0 == s->Listen(g_reactor,ip,port,cb)){
-		lua_pushlightuserdata(L,s);
-	}else
+	int backlog    = lua_isnumber(L,4) ? lua_tointeger(L,4) : 256;
+	bool reuseport = lua_isboolean(L,5) ? lua_toboolean(L,5) : net::Worker::Current() != NULL;
+	if(reuseport && !net::Socket::ReusePortSupported()){
+		if(!net::Worker::Current()){
+			lua_pushnil(L);
+			return 1;
+		}
+		reuseport = false;
+	}
+	net::Socket *s;
+	bool ret;
+	if(net::Worker::Current() && !reuseport){
+		SOCKET fd = net::Worker::SharedListener(ip,port,backlog);
+		if(fd == INVAILD_FD){
+			lua_pushnil(L);
+			return 1;
+		}
+		s   = new net::Socket(fd);
+		ret = s->Listen(g_reactor,std::move(cb));
+	}else{
+		s   = new net::Socket(AF_INET, SOCK_STREAM,IPPROTO_TCP);
+		ret = s->Listen(g_reactor,ip,port,std::move(cb),backlog,reuseport);
+	}
+	if(ret){
+		push_luaSocket(L,s);
+	}else{
+		s->Close();
 		lua_pushnil(L);
+	}
 	return 1;
 }
 
-int lua_SendWPacket(lua_State *L){
-	net::Socket *s    = (net::Socket*)lua_touserdata(L,1);
-	net::Packet *wpk = toLuaPacket(L, 2);
-	int  ret; 
-	if(lua_gettop(L) == 3){
-		luaRef cb(L,3); 
-		ret = s->Send(wpk,&cb);
+//C.Udp(ip,port,on_packet[,maxsize]),on_packet(s,rpk,ip,port) for every
+//datagram,port 0 for any.send with s:SendTo(packet,ip,port)
+int lua_Udp(lua_State *L){
+	const char *ip = luaL_checkstring(L, 1);
+	int port       = (int)luaL_checkinteger(L, 2);
+	luaL_checktype(L,3,LUA_TFUNCTION);
+	luaRef cb(L,3);
+	size_t maxsize = lua_isnumber(L,4) ? (size_t)lua_tointeger(L,4) : 2048;
+	net::Socket *s = new net::Socket(AF_INET, SOCK_DGRAM,IPPROTO_UDP);
+	if(s->BindDatagram(g_reactor,ip,port,std::move(cb),maxsize)){
+		push_luaSocket(L,s);
 	}else{
-		ret = s->Send(wpk,NULL);
+		s->Close();
+		lua_pushnil(L);
 	}
-	lua_pushboolean(L,ret == 0 ? 1:0);
 	return 1;
 }
 
-int lua_GetSysTick(lua_State *L){
-	lua_pushnumber(L,GetSystemMs64());
+int lua_StartWorkers(lua_State *L){
+	int n              = lua_tointeger(L,1);
+	const char *script = lua_tostring(L,2);
+	if(net::Worker::Current())
+		return luaL_error(L,"StartWorkers can't be called in a worker");
+	lua_pushboolean(L,net::Worker::StartWorkers(n,script));
 	return 1;
 }
 
-int lua_Bind(lua_State *L){
-	net::Socket  *s    = (net::Socket*)lua_touserdata(L,1);	
-	net::Decoder *d    = (net::Decoder*)lua_touserdata(L,2);
-	luaRef  cb_packet(L,3);
-	luaRef  cb_disconnected(L,4);
-	lua_pushboolean(L,s->Bind(g_reactor,d,cb_packet,cb_disconnected));
+//C.PostMessage(workerId,packet):the receiver gets a read packet sharing packet's
+//buffer,nothing is copied or serialized.from is 0 outside of a worker
+int lua_PostMessage(lua_State *L){
+	net::Worker *w  = net::Worker::Get(lua_tointeger(L,1));
+	net::Packet *pk = toLuaPacket(L,2);
+	if(!w || !pk){
+		lua_pushboolean(L,0);
+		return 1;
+	}
+	net::Worker *cur = net::Worker::Current();
+	w->GetReactor()->Post(new LuaMessage(cur ? cur->Id() : 0,pk->MakeReadPacket()));
+	lua_pushboolean(L,1);
 	return 1;
 }
 
-int lua_PacketDecoder(lua_State *L){
-	lua_pushlightuserdata(L,new net::PacketDecoder);
-	return 1;
+//C.OnMessage(function(from,rpk) end),nil stops delivery
+int lua_OnMessage(lua_State *L){
+	delete g_on_message;
+	g_on_message = NULL;
+	if(lua_isfunction(L,1))
+		g_on_message = new luaRef(L,1);
+	return 0;
 }
 
-int lua_HttpDecoder(lua_State *L){
-	lua_pushlightuserdata(L,new net::HttpDecoder(lua_tointeger(L,1)));
-	return 1;
-}
+class LuaResolveJob : public net::ResolveJob{
+public:
+	LuaResolveJob(const char *host,luaRef &&cb):net::ResolveJob(host),cb(std::move(cb)){}
+
+	void Do(net::Reactor*){
+		lua_State *L = cb.GetLState();
+		int oldtop = lua_gettop(L);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, cb.GetIndex());
+		if(ok){
+			const unsigned char *b = (const unsigned char*)&addr;
+			lua_pushfstring(L,"%d.%d.%d.%d",b[0],b[1],b[2],b[3]);
+			lua_pushnil(L);
+		}else{
+			lua_pushnil(L);
+			lua_pushstring(L,err.c_str());
+		}
+		if(0 != lua_pcall(L, 2, 0, 0))
+			printf("%s\n",lua_tostring(L,-1));
+		lua_settop(L, oldtop);
+	}
+
+private:
+	luaRef cb;
+};
 
-int lua_Socket_Retain(lua_State *L){
-	net::Socket *s = (net::Socket*)lua_touserdata(L,1);
-	s->IncRef();
+//C.Resolve(host,function(ip,err) end),called at once when the answer is cached
+int lua_Resolve(lua_State *L){
+	const char *host = luaL_checkstring(L,1);
+	luaL_checktype(L,2,LUA_TFUNCTION);
+	luaRef cb(L,2);
+	LuaResolveJob *job = new LuaResolveJob(host,std::move(cb));
+	uint32_t addr;
+	if(net::Resolver::Lookup(host,addr)){
+		job->Done(addr);
+		job->Do(g_reactor);
+		delete job;
+	}else
+		net::Resolver::Submit(g_reactor,job);
 	return 0;
 }
 
-int lua_Socket_Release(lua_State *L){
-	net::Socket *s = (net::Socket*)lua_touserdata(L,1);
-	s->DecRef();
-	return 0;
+//C.SetNameServer(ip[,port]):replaces the one from /etc/resolv.conf and drops the cache
+int lua_SetNameServer(lua_State *L){
+	const char *ip = luaL_checkstring(L,1);
+	int port       = lua_isnumber(L,2) ? lua_tointeger(L,2) : 53;
+	lua_pushboolean(L,net::Resolver::SetNameServer(ip,port));
+	return 1;
+}
+
+int lua_GetSysTick(lua_State *L){
+	lua_pushnumber(L,GetSystemMs64());
+	return 1;
 }
 
 #define REGISTER_CONST(L,N) do{\
@@ -141,17 +260,18 @@ bool Reg2Lua(lua_State *L){
 
 	lua_newtable(L);
 	RegLuaPacket(L);	
-	REGISTER_FUNCTION("SocketRetain", &lua_Socket_Retain);
-	REGISTER_FUNCTION("SocketRelease", &lua_Socket_Release);
+	RegLuaSocket(L,g_reactor);
+	RegLuaAsync(L,g_reactor);
 	REGISTER_FUNCTION("Connect", &lua_Connect);
 	REGISTER_FUNCTION("Listen", &lua_Listen);
-	REGISTER_FUNCTION("Close", &lua_Close);
+	REGISTER_FUNCTION("Udp", &lua_Udp);
 	REGISTER_FUNCTION("Run", &lua_Run);
-	REGISTER_FUNCTION("Bind", &lua_Bind);
-	REGISTER_FUNCTION("Send", &lua_SendWPacket);
 	REGISTER_FUNCTION("GetSysTick", &lua_GetSysTick);
-	REGISTER_FUNCTION("PacketDecoder", &lua_PacketDecoder);
-	REGISTER_FUNCTION("HttpDecoder", &lua_HttpDecoder);
+	REGISTER_FUNCTION("StartWorkers", &lua_StartWorkers);
+	REGISTER_FUNCTION("PostMessage", &lua_PostMessage);
+	REGISTER_FUNCTION("OnMessage", &lua_OnMessage);
+	REGISTER_FUNCTION("Resolve", &lua_Resolve);
+	REGISTER_FUNCTION("SetNameServer", &lua_SetNameServer);
 	lua_setglobal(L,"C");
 	return true;
 }
\ No newline at end of file
@@ -8,6 +8,7 @@ enum{
 	RPACKET,
 	HTTPPACKET,
 	RAWBINARY,
+	FILEPACKET,
 };
 
 namespace net{
@@ -37,6 +38,12 @@ public:
 
 	ByteBuffer *Buffer() {return m_buffer;}
 
+	//the bytes to send from pos on,NULL for a packet the socket has to
+	//read from a file(see FilePacket)
+	virtual const char *Data(size_t pos){
+		return m_buffer ? (const char*)m_buffer->ReadBin(pos) : NULL;
+	}
+
 protected:
 	int         m_type;
 	ByteBuffer *m_buffer;	
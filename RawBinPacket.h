@@ -15,6 +15,10 @@ public:
 		m_buffer->WriteBin(0,(void*)data,len);
 	}
 
+	//takes a reference to the first len bytes of buffer,nothing is copied
+	RawBinPacket(ByteBuffer *buffer,size_t len):Packet(RAWBINARY,buffer),m_size(len)
+	{}
+
 	RawBinPacket(const RawBinPacket &o):Packet(RAWBINARY,o.m_buffer),m_size(o.m_size)
 	{}
 
@@ -1,7 +1,108 @@
 #include "Reactor.h"
 #include "SysTime.h"
+#ifdef _LINUX
+#include <sys/eventfd.h>
+#endif
 namespace net{
 
+Reactor::Reactor():notified(0){
+	notifyfd[0] = notifyfd[1] = -1;
+#if defined(_LINUX)
+	notifyfd[0] = notifyfd[1] = ::eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+#elif !defined(_WIN)
+	if(0 == ::pipe(notifyfd)){
+		fcntl(notifyfd[0],F_SETFL,fcntl(notifyfd[0],F_GETFL) | O_NONBLOCK);
+		fcntl(notifyfd[1],F_SETFL,fcntl(notifyfd[1],F_GETFL) | O_NONBLOCK);
+	}
+#endif
+}
+
+Reactor::~Reactor(){
+	mpscnode *n;
+	while((n = tasks.Pop()))
+		delete (Task*)n;
+#ifndef _WIN
+	if(notifyfd[0] >= 0) ::close(notifyfd[0]);
+	if(notifyfd[1] >= 0 && notifyfd[1] != notifyfd[0]) ::close(notifyfd[1]);
+#endif
+}
+
+void Reactor::Post(Task *t){
+	tasks.Push(t);
+	//only the first post after the reactor drained its queue pays for the write
+#ifdef _WIN
+	if(0 == InterlockedCompareExchange(&notified,1,0))
+#else
+	if(__sync_bool_compare_and_swap(&notified,0,1))
+#endif
+		wakeup();
+}
+
+void Reactor::wakeup(){
+#if defined(_LINUX)
+	uint64_t one = 1;
+	if(::write(notifyfd[1],&one,sizeof(one))){}
+#elif !defined(_WIN)
+	char c = 0;
+	if(::write(notifyfd[1],&c,1)){}
+#endif
+}
+
+void Reactor::runTasks(){
+	if(!notified) return;
+#ifndef _WIN
+	if(notifyfd[0] >= 0){
+		char buf[64];
+		while(::read(notifyfd[0],buf,sizeof(buf)) > 0);
+	}
+#endif
+	//clear the flag before popping,a post racing with us either lands in this
+	//round or sets the flag again and wakes the next select
+#ifdef _WIN
+	InterlockedExchange(&notified,0);
+#else
+	__sync_lock_test_and_set(&notified,0);
+#endif
+	mpscnode *n;
+	while((n = tasks.Pop())){
+		Task *t = (Task*)n;
+		t->Do(this);
+		delete t;
+	}
+}
+
+void Reactor::AddTimer(void (*fn)(void*),void *ud,uint32_t interval){
+	timer t;
+	t.fn       = fn;
+	t.ud       = ud;
+	t.interval = interval;
+	t.next     = GetSystemMs64() + interval;
+	timers.push_back(t);
+}
+
+//a timer may be removed from a timer callback,it is erased by runTimers
+void Reactor::RemoveTimer(void *ud){
+	std::list<timer>::iterator it = timers.begin();
+	for(; it != timers.end(); ++it)
+		if(it->ud == ud) it->fn = NULL;
+}
+
+void Reactor::runTimers(){
+	uint64_t now = GetSystemMs64();
+	std::list<timer>::iterator it = timers.begin();
+	while(it != timers.end()){
+		if(!it->fn){
+			it = timers.erase(it);
+			continue;
+		}
+		if(now >= it->next){
+			it->next = now + it->interval;
+			it->fn(it->ud);
+		}
+		++it;
+	}
+}
+
 bool Reactor::Add(Socket *s,int event)
 {
 	if(s->reactor && s->reactor != this)
@@ -45,6 +146,24 @@ void Reactor::LoopOnce(unsigned int ms){
 			maxfd = s->Fd();
 		node = node->next;
 	}
+#ifndef _WIN
+	if(notifyfd[0] >= 0){
+		FD_SET(notifyfd[0],&r_set);
+		if(notifyfd[0] > maxfd)
+			maxfd = notifyfd[0];
+	}
+#endif
+	//a producer may still be linking its task,don't block on a set flag
+	if(notified) ms = 0;
+	if(!timers.empty()){
+		uint64_t now = GetSystemMs64();
+		std::list<timer>::iterator it = timers.begin();
+		for(; it != timers.end(); ++it){
+			if(!it->fn) continue;
+			uint64_t wait = it->next > now ? it->next - now : 0;
+			if(wait < ms) ms = (unsigned int)wait;
+		}
+	}
 	struct timeval timeout;
 	timeout.tv_sec = ms/1000;
 	timeout.tv_usec = (ms%1000)*1000;
@@ -70,5 +189,7 @@ void Reactor::LoopOnce(unsigned int ms){
 			--size;
 		}
 	}
+	runTasks();
+	runTimers();
 }
 }
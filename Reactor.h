@@ -2,17 +2,54 @@
 #define _REACTOR_H
 
 #include <map>
+#include <list>
 #include "Socket.h"
+#include "mpscqueue.h"
 namespace net{
 
+class Reactor;
+
+//work handed to a reactor from any thread,it runs and is deleted on the thread
+//calling the reactor's LoopOnce
+class Task : public mpscnode{
+public:
+	virtual ~Task(){}
+	virtual void Do(Reactor*) = 0;
+};
+
 class Reactor{
 
 public:
+	Reactor();
+	~Reactor();
 	void LoopOnce(unsigned int ms = 0);
 	bool Add(Socket*,int event);
 	bool Remove(Socket*,int event);
+	//thread safe,wakes the reactor if it is blocked in select
+	void Post(Task*);
+	//fn(ud) runs from LoopOnce every interval ms,select waits no longer than the next one
+	void AddTimer(void (*fn)(void*),void *ud,uint32_t interval);
+	void RemoveTimer(void *ud);
 private:
-	dlist sockets;
+	struct timer{
+		void   (*fn)(void*);//NULL once removed
+		void    *ud;
+		uint32_t interval;
+		uint64_t next;
+	};
+
+	Reactor(const Reactor&);
+	Reactor& operator = (const Reactor&);
+	void wakeup();
+	void runTasks();
+	void runTimers();
+	std::list<timer> timers;
+	dlist         sockets;
+	mpscqueue     tasks;
+	volatile long notified;
+	//eventfd on linux(both ends are the same fd),a pipe on other unix,
+	//windows has no notify fd and polls the queue instead
+	int           notifyfd[2];
 };
 }
 
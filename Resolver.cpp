@@ -0,0 +1,381 @@
+#include "Resolver.h"
+#include "SysTime.h"
+#include <map>
+#include <vector>
+#include <ctype.h>
+#include <stdlib.h>
+
+namespace net{
+
+struct dnsentry{
+	uint32_t addr;
+	uint64_t expire;
+};
+
+static Mutex                            g_dns_mtx;
+static std::map<std::string,dnsentry>   g_dns_cache;
+static std::map<std::string,uint32_t>   g_hosts;
+static bool                             g_dns_loaded = false;
+static bool                             g_has_nameserver = false;
+static struct sockaddr_in               g_nameserver;
+static std::vector<std::string>         g_search;//domains tried for short names
+static int                              g_ndots = 1;
+
+static const uint32_t fallback_ttl  = 30;//getaddrinfo gives no ttl
+static const int      query_timeout = 2000;
+static const int      query_tries   = 2;
+
+static std::string lower(const std::string &s){
+	std::string ret(s);
+	for(size_t i = 0; i < ret.size(); ++i)
+		ret[i] = tolower((unsigned char)ret[i]);
+	return ret;
+}
+
+static bool parse_ipv4(const char *s,uint32_t &addr){
+	int dots = 0;
+	for(const char *p = s; *p; ++p){
+		if(*p == '.') ++dots;
+		else if(*p < '0' || *p > '9') return false;
+	}
+	if(dots != 3) return false;
+	addr = inet_addr(s);
+	return addr != INADDR_NONE || strcmp(s,"255.255.255.255") == 0;
+}
+
+//called with g_dns_mtx held
+static void load_config(){
+	if(g_dns_loaded) return;
+	g_dns_loaded = true;
+#ifndef _WIN
+	char line[512];
+	FILE *f = fopen("/etc/hosts","r");
+	if(f){
+		while(fgets(line,sizeof(line),f)){
+			char *hash = strchr(line,'#');
+			if(hash) *hash = 0;
+			char *save = NULL;
+			char *ip = strtok_r(line," \t\r\n",&save);
+			uint32_t addr;
+			if(!ip || !parse_ipv4(ip,addr)) continue;
+			char *name;
+			while((name = strtok_r(NULL," \t\r\n",&save))){
+				std::string key = lower(name);
+				if(g_hosts.find(key) == g_hosts.end())
+					g_hosts[key] = addr;
+			}
+		}
+		fclose(f);
+	}
+	//the first nameserver,the last search or domain line and ndots,as the libc resolver reads them
+	f = fopen("/etc/resolv.conf","r");
+	if(f){
+		while(fgets(line,sizeof(line),f)){
+			char *save = NULL;
+			char *key = strtok_r(line," \t\r\n",&save);
+			if(!key) continue;
+			if(strcmp(key,"search") == 0 || strcmp(key,"domain") == 0){
+				g_search.clear();
+				char *domain;
+				while((domain = strtok_r(NULL," \t\r\n",&save))){
+					std::string d = lower(domain);
+					while(!d.empty() && d[d.size()-1] == '.') d.erase(d.size()-1);
+					if(!d.empty()) g_search.push_back(d);
+				}
+			}else if(strcmp(key,"options") == 0){
+				char *opt;
+				while((opt = strtok_r(NULL," \t\r\n",&save))){
+					if(strncmp(opt,"ndots:",6) == 0){
+						g_ndots = atoi(opt + 6);
+						if(g_ndots < 0) g_ndots = 0;
+						if(g_ndots > 15) g_ndots = 15;
+					}
+				}
+			}else if(strcmp(key,"nameserver") == 0 && !g_has_nameserver){
+				char *ip = strtok_r(NULL," \t\r\n",&save);
+				uint32_t addr;
+				if(!ip || !parse_ipv4(ip,addr)) continue;
+				memset(&g_nameserver,0,sizeof(g_nameserver));
+				g_nameserver.sin_family      = AF_INET;
+				g_nameserver.sin_addr.s_addr = addr;
+				g_nameserver.sin_port        = htons(53);
+				g_has_nameserver = true;
+			}
+		}
+		fclose(f);
+	}
+#endif
+}
+
+bool Resolver::SetNameServer(const char *ip,int port){
+	uint32_t addr;
+	if(!ip || !parse_ipv4(ip,addr) || port <= 0 || port > 65535) return false;
+	Guard guard(g_dns_mtx);
+	load_config();
+	memset(&g_nameserver,0,sizeof(g_nameserver));
+	g_nameserver.sin_family      = AF_INET;
+	g_nameserver.sin_addr.s_addr = addr;
+	g_nameserver.sin_port        = htons(port);
+	g_has_nameserver = true;
+	g_dns_cache.clear();
+	return true;
+}
+
+void Resolver::ClearCache(){
+	Guard guard(g_dns_mtx);
+	g_dns_cache.clear();
+}
+
+bool Resolver::Lookup(const std::string &host,uint32_t &addr){
+	if(parse_ipv4(host.c_str(),addr)) return true;
+	std::string key = lower(host);
+	Guard guard(g_dns_mtx);
+	load_config();
+	std::map<std::string,uint32_t>::iterator h = g_hosts.find(key);
+	if(h != g_hosts.end()){
+		addr = h->second;
+		return true;
+	}
+	std::map<std::string,dnsentry>::iterator it = g_dns_cache.find(key);
+	if(it == g_dns_cache.end()) return false;
+	if(it->second.expire <= GetSystemMs64()){
+		g_dns_cache.erase(it);
+		return false;
+	}
+	addr = it->second.addr;
+	return true;
+}
+
+static void cache(const std::string &host,uint32_t addr,uint32_t ttl){
+	if(ttl == 0) return;
+	dnsentry e;
+	e.addr   = addr;
+	e.expire = GetSystemMs64() + (uint64_t)ttl*1000;
+	Guard guard(g_dns_mtx);
+	g_dns_cache[lower(host)] = e;
+}
+
+static void closefd(SOCKET fd){
+#ifdef _WIN
+	::closesocket(fd);
+#else
+	::close(fd);
+#endif
+}
+
+static bool skip_name(const unsigned char *buf,int len,int &pos){
+	while(pos < len){
+		unsigned char c = buf[pos];
+		if(c == 0){
+			pos += 1;
+			return true;
+		}
+		if((c & 0xC0) == 0xC0){
+			pos += 2;
+			return pos <= len;
+		}
+		pos += c + 1;
+	}
+	return false;
+}
+
+enum{
+	query_ok = 0,
+	query_noname,//the server answered,but with no A record
+	query_failed,//no usable answer,worth trying getaddrinfo
+};
+
+static int query(const struct sockaddr_in &ns,const std::string &host,uint32_t &addr,uint32_t &ttl,std::string &err){
+	unsigned char buf[1500];
+	static volatile long seq = 0;
+#ifdef _WIN
+	unsigned short id = (unsigned short)(InterlockedIncrement(&seq) ^ GetSystemMs64());
+#else
+	unsigned short id = (unsigned short)(__sync_add_and_fetch(&seq,1) ^ GetSystemMs64());
+#endif
+	int pos = 12;
+	memset(buf,0,pos);
+	buf[0] = id >> 8;
+	buf[1] = id & 0xff;
+	buf[2] = 0x01;//recursion desired
+	buf[5] = 1;//one question
+	size_t start = 0;
+	while(start < host.size()){
+		size_t dot = host.find('.',start);
+		if(dot == std::string::npos) dot = host.size();
+		size_t n = dot - start;
+		if(n == 0 || n > 63 || pos + n + 6 > 255 + 12){
+			err = "invaild host name";
+			return query_noname;
+		}
+		buf[pos++] = (unsigned char)n;
+		memcpy(&buf[pos],host.data() + start,n);
+		pos  += n;
+		start = dot + 1;
+	}
+	buf[pos++] = 0;
+	buf[pos++] = 0;
+	buf[pos++] = 1;//type A
+	buf[pos++] = 0;
+	buf[pos++] = 1;//class IN
+	int qlen = pos;
+
+	SOCKET fd = ::socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
+	if(fd == INVAILD_FD){
+		err = "create socket failed";
+		return query_failed;
+	}
+	if(::connect(fd,(const sockaddr*)&ns,sizeof(ns)) != 0){
+		closefd(fd);
+		err = "connect name server failed";
+		return query_failed;
+	}
+	err = "name server timeout";
+	int len = -1;
+	for(int i = 0; i < query_tries && len < 0; ++i){
+		if(::send(fd,(const char*)buf,qlen,0) != qlen) break;
+		uint64_t deadline = GetSystemMs64() + query_timeout;
+		for(;;){
+			uint64_t now = GetSystemMs64();
+			if(now >= deadline) break;
+			fd_set r_set;
+			FD_ZERO(&r_set);
+			FD_SET(fd,&r_set);
+			struct timeval timeout;
+			timeout.tv_sec  = (deadline - now)/1000;
+			timeout.tv_usec = ((deadline - now)%1000)*1000;
+			if(::select(fd + 1,&r_set,NULL,NULL,&timeout) <= 0) continue;
+			int n = ::recv(fd,(char*)buf,sizeof(buf),0);
+			if(n < 0){
+				//icmp port unreachable,retrying won't help
+				err = "name server unreachable";
+				i   = query_tries;
+				break;
+			}
+			//drop anything that is not the answer to this query
+			if(n < 12 || buf[0] != (id >> 8) || buf[1] != (id & 0xff) || !(buf[2] & 0x80)) continue;
+			len = n;
+			break;
+		}
+	}
+	closefd(fd);
+	if(len < 0) return query_failed;
+
+	int rcode = buf[3] & 0x0f;
+	if(rcode == 3){
+		err = "no such host";
+		return query_noname;
+	}
+	if(rcode != 0){
+		err = "name server error";
+		return query_failed;
+	}
+	int qdcount = (buf[4] << 8) | buf[5];
+	int ancount = (buf[6] << 8) | buf[7];
+	pos = 12;
+	for(int i = 0; i < qdcount; ++i){
+		if(!skip_name(buf,len,pos)) return query_failed;
+		pos += 4;
+	}
+	bool found = false;
+	ttl = 0xffffffff;
+	//answers may hold a cname chain before the A records,the shortest ttl wins
+	for(int i = 0; i < ancount; ++i){
+		if(!skip_name(buf,len,pos) || pos + 10 > len) break;
+		int type       = (buf[pos] << 8) | buf[pos+1];
+		int klass      = (buf[pos+2] << 8) | buf[pos+3];
+		uint32_t rttl  = ((uint32_t)buf[pos+4] << 24) | (buf[pos+5] << 16) | (buf[pos+6] << 8) | buf[pos+7];
+		int rdlen      = (buf[pos+8] << 8) | buf[pos+9];
+		pos += 10;
+		if(pos + rdlen > len) break;
+		if(rttl < ttl) ttl = rttl;
+		if(type == 1 && klass == 1 && rdlen == 4 && !found){
+			memcpy(&addr,&buf[pos],4);
+			found = true;
+		}
+		pos += rdlen;
+	}
+	if(!found){
+		err = "no address for host";
+		return query_noname;
+	}
+	return query_ok;
+}
+
+static bool system_resolve(const std::string &host,uint32_t &addr,std::string &err){
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	memset(&hints,0,sizeof(hints));
+	hints.ai_family   = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	int ret = getaddrinfo(host.c_str(),NULL,&hints,&res);
+	if(ret != 0 || !res){
+		err = gai_strerror(ret);
+		return false;
+	}
+	addr = ((struct sockaddr_in*)res->ai_addr)->sin_addr.s_addr;
+	freeaddrinfo(res);
+	return true;
+}
+
+//the names to query for host in order:a name with fewer than ndots dots is
+//tried with the search domains first,a trailing dot means no search at all.
+//returns whether host is such a short name
+static bool candidates(const std::string &host,const std::vector<std::string> &search,int ndots,std::vector<std::string> &names){
+	if(!host.empty() && host[host.size()-1] == '.'){
+		names.push_back(host.substr(0,host.size()-1));
+		return false;
+	}
+	int dots = 0;
+	for(size_t i = 0; i < host.size(); ++i)
+		if(host[i] == '.') ++dots;
+	if(dots >= ndots) names.push_back(host);
+	for(size_t i = 0; i < search.size(); ++i)
+		names.push_back(host + "." + search[i]);
+	if(dots < ndots) names.push_back(host);
+	return dots < ndots;
+}
+
+bool Resolver::Resolve(const std::string &host,uint32_t &addr,std::string &err){
+	if(Lookup(host,addr)) return true;
+	struct sockaddr_in ns;
+	bool has_nameserver;
+	std::vector<std::string> names;
+	bool shortname;
+	{
+		Guard guard(g_dns_mtx);
+		has_nameserver = g_has_nameserver;
+		ns = g_nameserver;
+		shortname = candidates(host,g_search,g_ndots,names);
+	}
+	if(has_nameserver){
+		int ret = query_noname;
+		for(size_t i = 0; i < names.size() && ret == query_noname; ++i){
+			uint32_t ttl = 0;
+			ret = query(ns,names[i],addr,ttl,err);
+			if(ret == query_ok){
+				cache(host,addr,ttl);
+				return true;
+			}
+		}
+		//a short name may come from a source the name server doesn't know,
+		//leave it to the system's resolver
+		if(ret == query_noname && !shortname)
+			return false;
+	}
+	if(!system_resolve(host,addr,err))
+		return false;
+	cache(host,addr,fallback_ttl);
+	return true;
+}
+
+void Resolver::Submit(Reactor *reactor,ResolveJob *job){
+	static ThreadPool *pool = new ThreadPool(2);
+	pool->Submit(reactor,job);
+}
+
+void ResolveJob::Work(){
+	ok = Resolver::Resolve(host,addr,err);
+}
+
+}
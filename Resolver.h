@@ -0,0 +1,50 @@
+#ifndef _RESOLVER_H
+#define _RESOLVER_H
+
+#include <string>
+#include "ThreadPool.h"
+
+namespace net{
+
+//an ipv4 lookup run on the resolver threads,Do is called back on the reactor
+//that submitted it with ok,addr(network order) and err filled
+class ResolveJob : public Job{
+public:
+	ResolveJob(const char *host):host(host),addr(0),ok(false){}
+	void Work();
+	//mark the job answered without running it,for hits from Resolver::Lookup
+	void Done(uint32_t addr){
+		this->addr = addr;
+		ok = true;
+	}
+protected:
+	std::string host;
+	uint32_t    addr;
+	bool        ok;
+	std::string err;
+};
+
+//a stub resolver:literal addresses and /etc/hosts are answered at once,other
+//names are sent as A queries over udp to the name server and the answers are
+//cached for their ttl.the search domains and ndots of /etc/resolv.conf apply,
+//a short name no domain knows is left to getaddrinfo,as is every name when
+//there is no name server
+class Resolver{
+public:
+	//the name server defaults to the first one in /etc/resolv.conf
+	static bool SetNameServer(const char *ip,int port = 53);
+
+	//answers from literal addresses,hosts and the cache only,never blocks
+	static bool Lookup(const std::string &host,uint32_t &addr);
+
+	//blocking,call it from a resolver thread
+	static bool Resolve(const std::string &host,uint32_t &addr,std::string &err);
+
+	static void Submit(Reactor*,ResolveJob*);
+
+	static void ClearCache();
+};
+
+}
+
+#endif
@@ -2,12 +2,20 @@
 #include "Reactor.h"
 #include "SysTime.h"
 #include "LuaPacket.h"
+#include "LuaSocket.h"
+#include "Resolver.h"
+#include "FilePacket.h"
+#ifdef _LINUX
+#include <sys/sendfile.h>
+#endif
 namespace net{
 
 Socket::Socket(int family,int type,int protocol):reactor(NULL),
 	writeable(true),refCount(1),state(0),wpos(0),upos(0),event(0),ud(NULL),
 	cb_connect(NULL,0),cb_new_client(NULL,0),
-	cb_disconnected(NULL,0),cb_packet(NULL,0),decoder(NULL)
+	cb_disconnected(NULL,0),cb_packet(NULL,0),lua_handle(NULL,0),cb_drain(NULL,0),decoder(NULL),factory(NULL),
+	close_hook(NULL),corked(false),readpaused(false),pending(0),highmark(0),lowmark(0),draining(false),
+	plain(0),ucur(0),tlsconnect(NULL),handshaking(false),dgramsize(0)
 {
 	fd = ::socket(family,type,protocol);
 	if(fd < 0) exit(0);
@@ -16,12 +24,27 @@ Socket::Socket(int family,int type,int protocol):reactor(NULL),
 Socket::Socket(SOCKET fd):fd(fd),reactor(NULL),
 	writeable(true),refCount(1),state(0),wpos(0),upos(0),event(0),ud(NULL),	
 	cb_connect(NULL,0),cb_new_client(NULL,0),
-	cb_disconnected(NULL,0),cb_packet(NULL,0),decoder(NULL)
+	cb_disconnected(NULL,0),cb_packet(NULL,0),lua_handle(NULL,0),cb_drain(NULL,0),decoder(NULL),factory(NULL),
+	close_hook(NULL),corked(false),readpaused(false),pending(0),highmark(0),lowmark(0),draining(false),
+	plain(0),ucur(0),tlsconnect(NULL),handshaking(false),dgramsize(0)
 {}
 
-bool  Socket::Listen(Reactor *reactor,const char *ip,int port,luaRef &cb)
+bool  Socket::BindListen(SOCKET fd,const char *ip,int port,int backlog,bool reuseport)
 {
-	if(!reactor || !ip || !cb.GetLState()) return false;
+	if(!ip) return false;
+#ifndef _WIN
+	int on = 1;
+	setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,(const char*)&on,sizeof(on));
+#endif
+	if(reuseport){
+#ifdef SO_REUSEPORT
+		int on = 1;
+		if(setsockopt(fd,SOL_SOCKET,SO_REUSEPORT,(const char*)&on,sizeof(on)) < 0)
+			return false;
+#else
+		return false;
+#endif
+	}
 	struct sockaddr_in servaddr;
 	memset((void*)&servaddr,0,sizeof(servaddr));
 	servaddr.sin_family = AF_INET;
@@ -30,40 +53,250 @@ bool  Socket::Listen(Reactor *reactor,const char *ip,int port,luaRef &cb)
 	if(::bind(fd,(const sockaddr *)&servaddr,sizeof(servaddr)) < 0)
 		return false;
 
-	if(::listen(fd,256) < 0)
+	if(::listen(fd,backlog > 0 ? backlog : 256) < 0)
 		return false;
+	return true;
+}
+
+bool  Socket::Listen(Reactor *reactor,const char *ip,int port,luaRef cb,int backlog,bool reuseport)
+{
+	if(!reactor || !ip) return false;
+	if(!BindListen(fd,ip,port,backlog,reuseport))
+		return false;
+	return Listen(reactor,std::move(cb));
+}
+
+bool  Socket::Listen(Reactor *reactor,luaRef cb)
+{
+	if(!reactor) return false;
 	SetNonBlock();
-	cb_new_client = cb;
+	cb_new_client = std::move(cb);
 	reactor->Add(this,EV_READ);
 	state = listening;
 	return true;
 }
 
-bool Socket::Connect(Reactor *reactor,const char *host,int port,luaRef &cb)
+bool Socket::BindDatagram(Reactor *reactor,const char *ip,int port,luaRef cb,size_t maxsize)
 {
-	if(!reactor || !host || !cb.GetLState()) return false;
-	
-	struct sockaddr_in remote;	
-	remote.sin_family = AF_INET;
-	remote.sin_port = htons(port);
+	if(!reactor || !ip || maxsize == 0) return false;
+	struct sockaddr_in addr;
+	memset((void*)&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr(ip);
+	addr.sin_port = htons(port);
+	if(::bind(fd,(const sockaddr *)&addr,sizeof(addr)) < 0)
+		return false;
+	SetNonBlock();
+	dgramsize = maxsize;
+	for(size_t i = 0; i < max_dgram_batch; ++i)
+		dgrambufs.push_back(new ByteBuffer(sizeof(uint32_t) + dgramsize + 1));
+	cb_packet = std::move(cb);
+	reactor->Add(this,EV_READ);
+	state = datagram;
+	return true;
+}
 
-	hostent *phostent = gethostbyname(host);
-	if(phostent)
-		remote.sin_addr.s_addr = *((unsigned long*)phostent->h_addr_list[0]); 
-	else
-		remote.sin_addr.s_addr = inet_addr(host);
+int Socket::SendTo(Packet *wpk,uint32_t addr,int port){
+	if(state != datagram) return -1;
+	int type = wpk->Type();
+	if(type != WPACKET && type != RPACKET && type != RAWBINARY)
+		return -1;
+	if(dgramlist.size() >= max_dgram_queue)
+		return -1;
+	stDatagram d;
+	d.packet = wpk->Clone();
+	memset((void*)&d.addr,0,sizeof(d.addr));
+	d.addr.sin_family = AF_INET;
+	d.addr.sin_addr.s_addr = addr;
+	d.addr.sin_port = htons(port);
+	dgramlist.push_back(d);
+	//replies from the packet callbacks go out after the read batch,the rest
+	//once select finds the socket writable,at the latest a reactor round later
+	if(corked) return 0;
+	if(dgramlist.size() >= max_dgram_batch)
+		return sendDatagrams();
+	if(!(event & EV_WRITE))
+		reactor->Add(this,EV_WRITE);
+	return 0;
+}
+
+//what a datagram carries for a packet
+static const char *datagramPayload(Packet *wpk,size_t &len){
+	if(wpk->Type() == RAWBINARY){
+		len = wpk->PkTotal();
+		return wpk->Data(0);
+	}
+	len = wpk->PkTotal() - sizeof(uint32_t);
+	return wpk->Data(sizeof(uint32_t));
+}
+
+//read up to max_dgram_batch datagrams a syscall until the socket is drained
+//or a few batches were handled,other sockets get their turn meanwhile
+void Socket::recvDatagrams(){
+	struct sockaddr_in addrs[max_dgram_batch];
+	size_t             lens[max_dgram_batch];
+	corked = true;
+	for(int round = 0; round < 8 && state == datagram; ++round){
+		int n = 0;
+#ifdef _LINUX
+		struct mmsghdr msgs[max_dgram_batch];
+		struct iovec   iov[max_dgram_batch];
+		memset(msgs,0,sizeof(msgs));
+		for(size_t i = 0; i < max_dgram_batch; ++i){
+			iov[i].iov_base = &dgrambufs[i]->Buf()[sizeof(uint32_t)];
+			iov[i].iov_len  = dgramsize;
+			msgs[i].msg_hdr.msg_iov     = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen  = 1;
+			msgs[i].msg_hdr.msg_name    = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+		}
+		n = TEMP_FAILURE_RETRY(::recvmmsg(fd,msgs,max_dgram_batch,0,NULL));
+		for(int i = 0; i < n; ++i)
+			lens[i] = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? (size_t)-1 : msgs[i].msg_len;
+#else
+		for(; n < (int)max_dgram_batch; ++n){
+#ifdef _WIN
+			int addrlen = sizeof(addrs[n]);
+#else
+			socklen_t addrlen = sizeof(addrs[n]);
+#endif
+			//one byte more than maxsize tells a longer datagram
+			int r = TEMP_FAILURE_RETRY(::recvfrom(fd,&dgrambufs[n]->Buf()[sizeof(uint32_t)],(int)dgramsize + 1,0,
+				(struct sockaddr*)&addrs[n],&addrlen));
+			if(r < 0) break;
+			lens[n] = (size_t)r > dgramsize ? (size_t)-1 : (size_t)r;
+		}
+#endif
+		if(n <= 0) break;
+		for(int i = 0; i < n && state == datagram; ++i){
+			if(lens[i] == (size_t)-1) continue;
+			ByteBuffer *b = dgrambufs[i];
+			b->WriteUint32(0,(unsigned int)lens[i]);
+			RPacket *rpk = new RPacket(b);
+			if(cb_packet.GetLState())
+				do_cb_datagram(this,rpk,addrs[i]);
+			delete rpk;
+			//retained in lua,the next datagram needs a buffer of its own
+			if(b->Shared()){
+				b->DecRef();
+				dgrambufs[i] = new ByteBuffer(sizeof(uint32_t) + dgramsize + 1);
+			}
+		}
+		if(n < (int)max_dgram_batch) break;
+	}
+	corked = false;
+	if(state == datagram && !dgramlist.empty())
+		sendDatagrams();
+}
+
+//up to max_dgram_batch datagrams a syscall.udp is lossy anyway:one the
+//kernel refuses is dropped,a full send buffer waits for EV_WRITE
+int Socket::sendDatagrams(){
+	while(!dgramlist.empty()){
+		int n;
+#ifdef _LINUX
+		struct mmsghdr msgs[max_dgram_batch];
+		struct iovec   iov[max_dgram_batch];
+		memset(msgs,0,sizeof(msgs));
+		size_t cnt = 0;
+		std::list<stDatagram>::iterator it = dgramlist.begin();
+		for(; it != dgramlist.end() && cnt < max_dgram_batch; ++it,++cnt){
+			size_t len;
+			const char *data = datagramPayload(it->packet,len);
+			iov[cnt].iov_base = (void*)data;
+			iov[cnt].iov_len  = data ? len : 0;
+			msgs[cnt].msg_hdr.msg_iov     = &iov[cnt];
+			msgs[cnt].msg_hdr.msg_iovlen  = 1;
+			msgs[cnt].msg_hdr.msg_name    = &it->addr;
+			msgs[cnt].msg_hdr.msg_namelen = sizeof(it->addr);
+		}
+		n = TEMP_FAILURE_RETRY(::sendmmsg(fd,msgs,cnt,0));
+#else
+		size_t len;
+		stDatagram &d = dgramlist.front();
+		const char *data = datagramPayload(d.packet,len);
+		n = TEMP_FAILURE_RETRY(::sendto(fd,data ? data : "",data ? (int)len : 0,0,
+			(const struct sockaddr*)&d.addr,sizeof(d.addr)));
+		if(n >= 0) n = 1;
+#endif
+		if(n < 0){
+#ifdef _WIN
+			if(WSAGetLastError() == WSAEWOULDBLOCK){
+#else
+			if(errno == EWOULDBLOCK || errno == EAGAIN){
+#endif
+				if(!(event & EV_WRITE))
+					reactor->Add(this,EV_WRITE);
+				return 0;
+			}
+			n = 1;
+		}
+		for(; n > 0; --n){
+			delete dgramlist.front().packet;
+			dgramlist.pop_front();
+		}
+	}
+	if(event & EV_WRITE)
+		reactor->Remove(this,EV_WRITE);
+	return 0;
+}
+
+//resolves the host of a connecting socket,then resumes the connect on the reactor
+class ConnectJob : public ResolveJob{
+public:
+	ConnectJob(Socket *s,const char *host,int port):ResolveJob(host),s(s),port(port){
+		s->IncRef();
+	}
+
+	void Do(Reactor*){
+		//closed while resolving
+		if(s->state == resolving){
+			if(ok)
+				s->connectTo(addr,port);
+			else{
+				printf("resolve %s failed:%s\n",host.c_str(),err.c_str());
+				do_cb_connect(s,0);
+			}
+		}
+		s->DecRef();
+	}
+
+private:
+	Socket *s;
+	int     port;
+};
+
+bool Socket::Connect(Reactor *reactor,const char *host,int port,luaRef cb)
+{
+	if(!reactor || !host || !cb.GetLState()) return false;
 	if(!SetNonBlock()){ 
 		printf("Connect SetNonBlock error\n");
 		return false;
 	}
-	cb_connect = cb;
+	this->reactor = reactor;
+	cb_connect = std::move(cb);
+	uint32_t addr;
+	if(Resolver::Lookup(host,addr))
+		return connectTo(addr,port);
+	state = resolving;
+	Resolver::Submit(reactor,new ConnectJob(this,host,port));
+	return true;
+}
+
+bool Socket::connectTo(uint32_t addr,int port)
+{
+	struct sockaddr_in remote;	
+	memset(&remote,0,sizeof(remote));
+	remote.sin_family = AF_INET;
+	remote.sin_port = htons(port);
+	remote.sin_addr.s_addr = addr;
 #ifdef _WIN
 	if(::connect(fd,(const sockaddr *)&remote,sizeof(remote)) != SOCKET_ERROR){
 #else
 	if(::connect(fd,(const sockaddr *)&remote,sizeof(remote)) == 0){
 #endif
 		state = establish;
-		do_cb_connect(this,1);
+		connected();
 		return true;
 	}else{
 #ifdef _WIN
@@ -71,7 +304,9 @@ bool Socket::Connect(Reactor *reactor,const char *host,int port,luaRef &cb)
 #else		
 		if(errno != EINPROGRESS){
 #endif	
+			//do_cb_connect closes the socket,it may be released here
 			do_cb_connect(this,0);
+			return true;
 		}
 		
 	}
@@ -95,11 +330,31 @@ void Socket::doAccept(){
 		}
 		Socket *client = new Socket(clientfd);
 		client->state = establish;
-		do_cb_newclient(this,client);
+		client->reactor = reactor;
+		client->SetNonBlock();
+		if(factory)
+			client->Bind(reactor,factory,cb_packet,cb_disconnected);
+		if(cb_new_client.GetLState())
+			do_cb_newclient(this,client);
+		else if(!factory)
+			client->Close();
 	}
 }
 
+//replies sent from the packet callbacks are held until every packet of this read
+//is handled and then written together
 void Socket::unpack(){
+	corked = true;
+	do{
+		//a tls client is bound after its handshake
+		if(upos > 0 && decoder) unpackPackets();
+	}while(!transforms.empty() && decode());
+	corked = false;
+	if(state == establish && -1 == rawSend())
+		Close();
+}
+
+void Socket::unpackPackets(){
 
 	size_t  pos    = 0;
 	size_t  size   = (size_t)upos - pos;
@@ -108,34 +363,269 @@ void Socket::unpack(){
 	int     err;
 	do{
 		packet = this->decoder->unpack(unpackbuf,pos,size,maxpacket_size,pklen,err);
+		for(Packet *reply; (reply = decoder->Reply()) != NULL;)
+			queue(reply);
 		if(err){
+			//replies to the packets before the bad one still go out
+			corked = false;
+			rawSend();
 			Close();
 			return;
 		}
 
 		if(pklen > 0){
 			pos += pklen;
-			size = upos - pos;
+			ucur = pos;
 		}
 		if(packet){
-			do_cb_packet(this,packet);
+			if(cb_packet.GetLState())
+				do_cb_packet(this,packet);
+			else
+				Close();
 			delete packet;
-		}else
+		}
+		//Compress in the callback takes the bytes after the packet away
+		size = upos - pos;
+		//a decoder may take bytes without a packet coming out(a websocket
+		//control frame),what follows them is unpacked all the same
+		if(!packet && !pklen)
 			break;
-	}while(size && state == establish);
-	if(size)
+	}while(size && state == establish && !readpaused);
+	if(size && pos)
 		memmove(unpackbuf,&unpackbuf[pos],size);
 	upos = size;
+	ucur = 0;
+}
+
+//run received bytes through the transforms,wire side first,into unpackbuf.
+//false when nothing came out
+bool Socket::decode(){
+	if(state != establish || readpaused || upos >= (size_t)maxpacket_size)
+		return false;
+	int  n     = 0;
+	bool moved = true;
+	while(n == 0 && moved){
+		moved = false;
+		for(size_t i = transforms.size() - 1; i > 0 && n >= 0; --i){
+			size_t space;
+			char *in = transforms[i - 1]->InputSpace(space);
+			n = transforms[i]->Decode(in,space);
+			if(n > 0){
+				transforms[i - 1]->InputAdded(n);
+				moved = true;
+			}
+		}
+		if(n >= 0)
+			n = transforms[0]->Decode(&unpackbuf[upos],maxpacket_size - upos);
+	}
+	//handshake messages,alerts
+	flushOutput();
+	if(n < 0){
+		corked = false;
+		rawSend();
+		if(handshaking)
+			handshakeDone(false);
+		else
+			Close();
+		return false;
+	}
+	upos += n;
+	if(handshaking && Tls()->Established())
+		handshakeDone(true);
+	return n > 0 && state == establish;
+}
+
+//queue what the stages produced on their own,through the stages on its wire side
+void Socket::flushOutput(){
+	for(size_t i = 0; i < transforms.size(); ++i){
+		Packet *out = transforms[i]->Output();
+		if(!out) continue;
+		if(plain)
+			encodePlain();
+		for(size_t j = i + 1; j < transforms.size(); ++j){
+			Packet *outer = transforms[j]->Encode(out->Data(0) ? out->Data(0) : "",out->PkTotal(),true);
+			delete out;
+			out = outer;
+		}
+		//ahead of a file still being encoded
+		std::list<Packet*>::iterator at = sendlist.end();
+		for(size_t k = 0; k < plain; ++k) --at;
+		sendlist.insert(at,out);
+		pending += out->PkTotal();
+	}
+}
+
+//encode the packets queued since the last rawSend.the last one flushes the
+//stream,so does one with a send callback:the callback must not run before
+//the peer can read the packet.a file is encoded a slice at a time in front
+//of it,the file and what follows stay plain until the slice went out,
+//unless all of it is wanted now
+void Socket::encodePlain(bool all){
+	static const size_t slice = 65536;
+	std::list<Packet*>::iterator it = sendlist.end();
+	for(size_t i = 0; i < plain; ++i) --it;
+	while(it != sendlist.end()){
+		Packet *wpk = *it;
+		std::list<Packet*>::iterator next = it;
+		++next;
+		std::list<stSendFinish>::reverse_iterator cb = finishcb_list.rbegin();
+		while(cb != finishcb_list.rend() && cb->packet != wpk) ++cb;
+		bool waited = cb != finishcb_list.rend();
+		size_t len = wpk->PkTotal();
+		bool sliced = wpk->Type() == FILEPACKET && len > slice;
+		if(sliced) len = slice;
+		const char *data = wpk->Data(0);
+		std::vector<char> file;
+		if(!data && len){
+			//a file region,read through
+			file.resize(len);
+			FileBody *body = ((FilePacket*)wpk)->File();
+			size_t off = ((FilePacket*)wpk)->Offset();
+			for(size_t got = 0; got < len;){
+				ssize_t n = body->Read(off + got,&file[got],len - got);
+				if(n <= 0){
+					//the file shrank,the rest of it is dropped
+					file.resize(got);
+					sliced = false;
+					break;
+				}
+				got += n;
+			}
+			data = file.empty() ? "" : &file[0];
+			len  = file.size();
+		}
+		bool flush = !sliced && (waited || next == sendlist.end());
+		Packet *epk = transforms[0]->Encode(data ? data : "",len,flush);
+		for(size_t i = 1; i < transforms.size(); ++i){
+			Packet *outer = transforms[i]->Encode(epk->Data(0) ? epk->Data(0) : "",epk->PkTotal(),flush);
+			delete epk;
+			epk = outer;
+		}
+		if(sliced){
+			((FilePacket*)wpk)->Skip(len);
+			pending = pending - len + epk->PkTotal();
+			sendlist.insert(it,epk);
+			if(all) continue;
+			plain = std::distance(it,sendlist.end());
+			return;
+		}
+		if(waited) cb->packet = epk;
+		pending = pending - wpk->PkTotal() + epk->PkTotal();
+		*it = epk;
+		delete wpk;
+		it = next;
+	}
+	plain = 0;
+}
+
+class ResumeReadTask : public Task{
+public:
+	ResumeReadTask(Socket *s):s(s){
+		s->IncRef();
+	}
+
+	~ResumeReadTask(){
+		s->DecRef();
+	}
+
+	void Do(Reactor*){
+		if(s->state == establish && !s->readpaused &&
+			(s->upos > 0 || s->undecoded()))
+			s->unpack();
+	}
+
+private:
+	Socket *s;
+};
+
+//a new stage goes next to the packets:the queued ones are encoded by the
+//stages there were,the received bytes after the packet being handled have
+//only been through those and are decoded by it next
+bool Socket::addTransform(StreamTransform *t){
+	if(state != establish || !t->Ok()){
+		delete t;
+		return false;
+	}
+	if(plain)
+		encodePlain(true);
+	transforms.insert(transforms.begin(),t);
+	if(upos > ucur){
+		t->PushInput(&unpackbuf[ucur],upos - ucur);
+		upos = ucur;
+		//outside of unpack nobody would look at them before the next read
+		if(!corked)
+			reactor->Post(new ResumeReadTask(this));
+	}
+	return true;
+}
+
+bool Socket::Compress(const char *dict,size_t dlen,int level){
+	if(Compressor()) return false;
+	return addTransform(new StreamCompressor(dict,dlen,level));
+}
+
+bool Socket::Encrypt(const unsigned char *sendkey,const unsigned char *recvkey){
+	return addTransform(new StreamCipher(sendkey,recvkey));
+}
+
+bool Socket::StartTLS(TlsContext *ctx,const char *servername,SSL_SESSION *session,luaRef cb){
+	if(Tls() || !addTransform(new TlsStream(ctx,servername,session)))
+		return false;
+	if(cb.GetLState()){
+		cb_connect  = std::move(cb);
+		handshaking = true;
+	}
+	flushOutput();
+	if(!corked && -1 == rawSend()){
+		if(handshaking)
+			handshakeDone(false);
+		else
+			Close();
+	}
+	return true;
+}
+
+void Socket::PauseRead(){
+	if(state != establish || readpaused) return;
+	readpaused = true;
+	reactor->Remove(this,EV_READ);
+}
+
+void Socket::ResumeRead(){
+	if(state != establish || !readpaused) return;
+	readpaused = false;
+	reactor->Add(this,EV_READ);
+	//inside unpack the loop just goes on,else the packets left in the buffer
+	//are handled at the end of this reactor round
+	if(!corked && (upos > 0 || undecoded()))
+		reactor->Post(new ResumeReadTask(this));
 }
 
 void Socket::onReadAct()
 {
 	if(state == listening)
 		doAccept();
+	else if(state == datagram)
+		recvDatagrams();
 	else if(state == connecting)
 		doConnect();
-	else if(state == establish){
-		int n = TEMP_FAILURE_RETRY(::recv(fd,recvbuf,recvbuf_size,0));
+	else if(state == establish && !readpaused){
+		if(upos >= (size_t)maxpacket_size){
+			//the decoder can't make progress on a full buffer
+			Close();
+			return;
+		}
+		char  *buf   = &unpackbuf[upos];
+		size_t space = maxpacket_size - upos;
+		if(!transforms.empty()){
+			buf = transforms.back()->InputSpace(space);
+			if(space == 0){
+				//decode what is there first
+				unpack();
+				return;
+			}
+		}
+		int n = TEMP_FAILURE_RETRY(::recv(fd,buf,space,0));
 		if(n == 0){
 			Close();	
 #ifdef _WIN				
@@ -143,12 +633,14 @@ void Socket::onReadAct()
 			if(WSAGetLastError() != WSAEWOULDBLOCK)
 #else
 	    }else if(n < 0){
-			if(errno != EWOULDBLOCK || errno != EAGAIN)
+			if(errno != EWOULDBLOCK && errno != EAGAIN)
 #endif	
 				Close();
 		}else{
-			memcpy(&unpackbuf[upos],recvbuf,n);
-			upos += n;
+			if(!transforms.empty())
+				transforms.back()->InputAdded(n);
+			else
+				upos += n;
 			unpack();
 		}
 	}
@@ -165,16 +657,136 @@ void Socket::doConnect()
 	if(state != 0)
 		state = establish;
 	reactor->Remove(this,EV_WRITE);
-	do_cb_connect(this,state == establish?1:0);
+	if(state == establish)
+		connected();
+	else
+		do_cb_connect(this,0);
+}
+
+//over TLS cb_connect waits for the handshake,the records are read before Bind
+void Socket::connected(){
+	if(!tlsconnect){
+		do_cb_connect(this,1);
+		return;
+	}
+	TlsStream *t = tlsconnect;
+	tlsconnect = NULL;
+	reactor->Add(this,EV_READ);
+	if(!addTransform(t)){
+		do_cb_connect(this,0);
+		return;
+	}
+	handshaking = true;
+	flushOutput();
+	if(-1 == rawSend())
+		handshakeDone(false);
+}
+
+void Socket::handshakeDone(bool ok){
+	handshaking = false;
+	//a failure closes the socket
+	do_cb_connect(this,ok ? 1 : 0);
 }
 
 
+//pop the packets the last send finished,the first unfinished one keeps its offset in wpos
+int  Socket::sendFinished(size_t n){
+	pending -= n;
+	while(!sendlist.empty()){
+		Packet *wpk = sendlist.front();
+		size_t len = wpk->PkTotal() - wpos;
+		if(n < len){
+			wpos += n;
+			break;
+		}
+		n   -= len;
+		wpos = 0;
+		sendlist.pop_front();
+		if(!finishcb_list.empty() && finishcb_list.front().packet == wpk){
+			luaRef cb(std::move(finishcb_list.front().cb));
+			finishcb_list.pop_front();
+			delete wpk;
+			lua_State *L = cb.GetLState();
+			int oldtop = lua_gettop(L);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, cb.GetIndex());
+			push_luaSocket(L,this);
+			if(0 != lua_pcall(L, 1, 0, 0))
+				printf("%s\n",lua_tostring(L,-1));
+			lua_settop(L, oldtop);
+			if(state == closeing)
+				return -1;
+		}else
+			delete wpk;
+	}
+	if(draining && pending <= lowmark){
+		draining = false;
+		lua_State *L = cb_drain.GetLState();
+		if(L){
+			int oldtop = lua_gettop(L);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, cb_drain.GetIndex());
+			push_luaSocket(L,this);
+			if(0 != lua_pcall(L, 1, 0, 0))
+				printf("%s\n",lua_tostring(L,-1));
+			lua_settop(L, oldtop);
+			if(state == closeing)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+//the queued packets go out with one gathering write,so responses to pipelined
+//requests share a segment instead of waiting on nagle one by one
 int  Socket::rawSend(){
-	while(writeable && !sendlist.empty()){
-		Packet *wpk = sendlist.front();	
-		char *buf = (char *)wpk->Buffer()->ReadBin(wpos);
-		int len = wpk->PkTotal()-wpos;
-		int n = TEMP_FAILURE_RETRY(::send(fd,&buf[wpos],len,0));
+	static const int max_iov = 64;
+	if(plain && !corked)
+		encodePlain();
+	while(writeable && !sendlist.empty() && !corked){
+		if(plain == sendlist.size()){
+			//the slice of a file before went out,the next one
+			encodePlain();
+			continue;
+		}
+#ifdef _WIN
+		WSABUF iov[max_iov];
+#else
+		struct iovec iov[max_iov];
+#endif
+		int    cnt = 0;
+		size_t off = wpos;
+		size_t total = 0;
+		size_t ready = sendlist.size() - plain;
+		std::list<Packet*>::iterator it = sendlist.begin();
+		for(; it != sendlist.end() && cnt < max_iov && (size_t)cnt < ready; ++it,++cnt){
+			Packet *wpk = *it;
+			const char *data = wpk->Data(off);
+			if(!data && wpk->PkTotal() > off)
+				break;//a file packet,the write stops in front of it
+#ifdef _WIN
+			iov[cnt].buf = (char*)data;
+			iov[cnt].len = (ULONG)(wpk->PkTotal() - off);
+#else
+			iov[cnt].iov_base = (void*)data;
+			iov[cnt].iov_len  = wpk->PkTotal() - off;
+#endif
+			total += wpk->PkTotal() - off;
+			off = 0;
+		}
+		if(cnt == 0){
+			int n = sendFile((FilePacket*)sendlist.front());
+			if(n != 0) return n < 0 ? -1 : 0;
+			continue;
+		}
+		if(total == 0){
+			if(-1 == sendFinished(0)) return 0;
+			continue;
+		}
+#ifdef _WIN
+		DWORD sent = 0;
+		int n = ::WSASend(fd,iov,cnt,&sent,0,NULL,NULL) == 0 ? (int)sent : SOCKET_ERROR;
+#else
+		int n = TEMP_FAILURE_RETRY(::writev(fd,iov,cnt));
+#endif
 		if(n == 0){
 			writeable = false;
 			return -1;		
@@ -183,7 +795,7 @@ int  Socket::rawSend(){
 			if(WSAGetLastError() != WSAEWOULDBLOCK){
 #else
 	    }else if(n < 0){
-			if(errno != EWOULDBLOCK || errno != EAGAIN){
+			if(errno != EWOULDBLOCK && errno != EAGAIN){
 #endif		
 				writeable = false;
 				return -1;
@@ -194,34 +806,55 @@ int  Socket::rawSend(){
 					reactor->Add(this,EV_WRITE);
 				return 0;
 			}
-		}else{
-			if(n == len){
-				sendlist.pop_front();
-				delete wpk;
-				wpos = 0;
-
-				if(!finishcb_list.empty()){
-					stSendFinish stCb = finishcb_list.front();
-					if(stCb.packet == wpk){
-						finishcb_list.pop_front();
-						lua_State *L = stCb.cb.GetLState();
-						int oldtop = lua_gettop(L);
-						lua_rawgeti(L, LUA_REGISTRYINDEX, stCb.cb.GetIndex());
-						if(0 != lua_pcall(L, 0, 0, 0))
-							printf("%s\n",lua_tostring(L,-1));
-						lua_settop(L, oldtop);
-
-						if(state == closeing)
-							return 0;
-					}
-				}
-
+		}else if(-1 == sendFinished((size_t)n))
+			return 0;
+	}
+	//everything went out,the finish and drain callbacks included.a writable
+	//socket left in the write set would wake every select for nothing
+	if(sendlist.empty() && (event & EV_WRITE))
+		reactor->Remove(this,EV_WRITE);
+	return 0;
+}
 
-			}else{
-				wpos += len;		
-			}
-		}			
+//send the file packet kept open at the front of sendlist
+int Socket::sendFile(FilePacket *wpk){
+	size_t len = wpk->PkTotal() - wpos;
+#ifdef _LINUX
+	off_t offset = (off_t)(wpk->Offset() + wpos);
+	int n = TEMP_FAILURE_RETRY(::sendfile(fd,wpk->File()->Fd(),&offset,len));
+#else
+	static __thread char buf[65536];
+	int n = (int)wpk->File()->Read(wpk->Offset() + wpos,buf,len < sizeof(buf) ? len : sizeof(buf));
+	if(n > 0){
+#ifdef _WIN
+		n = ::send(fd,buf,n,0);
+#else
+		n = TEMP_FAILURE_RETRY(::send(fd,buf,n,0));
+#endif
+	}else
+		n = 0;
+#endif
+	if(n == 0){
+		//the file shrank under us
+		writeable = false;
+		return -1;
+#ifdef _WIN
+	}else if(n == SOCKET_ERROR){
+		if(WSAGetLastError() != WSAEWOULDBLOCK){
+#else
+	}else if(n < 0){
+		if(errno != EWOULDBLOCK && errno != EAGAIN){
+#endif
+			writeable = false;
+			return -1;
+		}
+		writeable = false;
+		if(!(event & EV_WRITE))
+			reactor->Add(this,EV_WRITE);
+		return 1;
 	}
+	if(-1 == sendFinished((size_t)n))
+		return 1;
 	return 0;
 }
 
@@ -229,6 +862,8 @@ void Socket::onWriteAct()
 {
 	if(state == connecting){
 		doConnect();
+	}else if(state == datagram){
+		sendDatagrams();
 	}else if(state == establish){
 		writeable = true;
 		if(-1 == rawSend()){
@@ -240,6 +875,15 @@ void Socket::onWriteAct()
 void  Socket::Close()
 {
 	if(state != closeing){
+		//a tls peer is told the close was meant,if the alert goes out at once
+		if(state == establish && sendlist.empty() && !transforms.empty()){
+			TlsStream *tls = dynamic_cast<TlsStream*>(transforms.back());
+			Packet *alert = tls ? tls->Shutdown() : NULL;
+			if(alert){
+				::send(fd,alert->Data(0),alert->PkTotal(),0);
+				delete alert;
+			}
+		}
 		state = closeing;
 #if _WIN		
 		::closesocket(fd);
@@ -250,38 +894,101 @@ void  Socket::Close()
 			delete sendlist.front();
 			sendlist.pop_front();
 		}
+		pending = 0;
+		plain   = 0;
+		while(!dgramlist.empty()){
+			delete dgramlist.front().packet;
+			dgramlist.pop_front();
+		}
+		releaseDecoder();
 
 		if(reactor)
 			reactor->Remove(this,EV_WRITE|EV_READ);
+		if(close_hook){
+			CloseHook hook = close_hook;
+			close_hook = NULL;
+			hook(this,ud);
+		}
+		delete tlsconnect;
+		tlsconnect = NULL;
+		if(handshaking){
+			handshaking = false;
+			do_cb_connect(this,0);
+		}
 		if(cb_disconnected.GetLState()) 
 			do_cb_disconnected(this);
+		//release every lua reference now,the lua handle only keeps the object alive
+		finishcb_list.clear();
+		cb_connect = cb_new_client = cb_disconnected = cb_packet = cb_drain = luaRef(NULL,0);
+		lua_handle = luaRef(NULL,0);
 		DecRef();
 	}
 }
 
 int  Socket::Send(Packet *wpk,luaRef *cb){
 	if(state != establish) return -1;
-	wpk = wpk->Clone();
-	sendlist.push_back(wpk);
+	Packet *head = NULL,*body = NULL;
+	if(decoder && decoder->Frame(wpk,head,body)){
+		queue(head);
+		wpk = body;
+	}else
+		wpk = wpk->Clone();
+	queue(wpk);
 	if(cb){
-		stSendFinish stCb(wpk,*cb);
-		finishcb_list.push_back(stCb);
+		finishcb_list.push_back(stSendFinish(wpk,std::move(*cb)));
 	}
 	return rawSend();
 }
 
-bool Socket::Bind(Reactor *reactor,Decoder *decoder,luaRef &cb1,luaRef &cb2){
+void Socket::queue(Packet *wpk){
+	sendlist.push_back(wpk);
+	if(!transforms.empty()) ++plain;
+	pending += wpk->PkTotal();
+	if(Full()) draining = true;
+}
+
+bool Socket::Bind(Reactor *reactor,DecoderFactory *factory,luaRef cb1,luaRef cb2){
 	if(state == establish){
 		this->reactor = reactor;
 		this->reactor->Add(this,EV_READ);
-		cb_packet = cb1;
-		cb_disconnected = cb2;
-		this->decoder = decoder ? decoder: new RawBinaryDecoder();
+		readpaused = false;
+		cb_packet = std::move(cb1);
+		cb_disconnected = std::move(cb2);
+		if(!factory) factory = RawBinaryDecoderFactory::Default();
+		//rebinding with the same factory(a pooled connection) keeps the decoder
+		if(factory != this->factory || !this->decoder){
+			factory->IncRef();
+			releaseDecoder();
+			this->factory = factory;
+			this->decoder = factory->Get();
+		}
 		return true;
 	}
 	return false;
 }
 
+bool Socket::DefaultBind(DecoderFactory *factory,luaRef cb1,luaRef cb2){
+	if(state == listening){
+		cb_packet = std::move(cb1);
+		cb_disconnected = std::move(cb2);
+		if(!factory) factory = RawBinaryDecoderFactory::Default();
+		factory->IncRef();
+		releaseDecoder();
+		this->factory = factory;
+		return true;
+	}
+	return false;
+}
+
+void Socket::releaseDecoder(){
+	if(factory){
+		if(decoder) factory->Put(decoder);
+		factory->DecRef();
+		factory = NULL;
+		decoder = NULL;
+	}
+}
+
 bool Socket::SetNonBlock(){
 		int ret;
 #ifdef _WIN
@@ -306,7 +1013,7 @@ void do_cb_newclient(Socket *s,Socket *client){
 		lua_State *L = s->cb_new_client.GetLState();
 		int oldtop = lua_gettop(L);
 		lua_rawgeti(L, LUA_REGISTRYINDEX, s->cb_new_client.GetIndex());
-		lua_pushlightuserdata(L,client);
+		push_luaSocket(L,client);
 		if(0 != lua_pcall(L, 1, 0, 0))
 			printf("%s\n",lua_tostring(L,-1));
 		lua_settop(L, oldtop);
@@ -318,7 +1025,7 @@ void do_cb_connect(Socket *s,int success){
 	int oldtop = lua_gettop(L);
 	lua_rawgeti(L, LUA_REGISTRYINDEX, s->cb_connect.GetIndex());
 	if(success)
-		lua_pushlightuserdata(L,s);
+		push_luaSocket(L,s);
 	else
 		lua_pushnil(L);
 	lua_pushboolean(L,success);
@@ -332,20 +1039,39 @@ void do_cb_connect(Socket *s,int success){
 void do_cb_packet(Socket *s,Packet *rpk){
 	lua_State *L = s->cb_packet.GetLState();
 	int oldtop = lua_gettop(L);
+	push_tmpLuaPacket(L,rpk);
 	lua_rawgeti(L, LUA_REGISTRYINDEX, s->cb_packet.GetIndex());
-	lua_pushlightuserdata(L,s);
-	push_luaPacket(L,rpk);
+	push_luaSocket(L,s);
+	lua_pushvalue(L,oldtop+1);
 	if(0 != lua_pcall(L, 2, 0, 0))
 		printf("%s\n",lua_tostring(L,-1));
+	release_tmpLuaPacket(L,oldtop+1);
 	lua_settop(L, oldtop);		
 }
 
 
+void do_cb_datagram(Socket *s,Packet *rpk,const struct sockaddr_in &addr){
+	lua_State *L = s->cb_packet.GetLState();
+	int oldtop = lua_gettop(L);
+	char ip[INET_ADDRSTRLEN];
+	inet_ntop(AF_INET,(void*)&addr.sin_addr,ip,sizeof(ip));
+	push_tmpLuaPacket(L,rpk);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, s->cb_packet.GetIndex());
+	push_luaSocket(L,s);
+	lua_pushvalue(L,oldtop+1);
+	lua_pushstring(L,ip);
+	lua_pushinteger(L,ntohs(addr.sin_port));
+	if(0 != lua_pcall(L, 4, 0, 0))
+		printf("%s\n",lua_tostring(L,-1));
+	release_tmpLuaPacket(L,oldtop+1);
+	lua_settop(L, oldtop);
+}
+
 void do_cb_disconnected(Socket *s){
 	lua_State *L = s->cb_disconnected.GetLState();
 	int oldtop = lua_gettop(L);
 	lua_rawgeti(L, LUA_REGISTRYINDEX, s->cb_disconnected.GetIndex());
-	lua_pushlightuserdata(L,s);
+	push_luaSocket(L,s);
 	if(0 != lua_pcall(L, 1, 0, 0))
 		printf("%s\n",lua_tostring(L,-1));
 	lua_settop(L, oldtop);
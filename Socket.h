@@ -63,6 +63,9 @@ typedef int SOCKET;
 #include "WPacket.h"
 #include "dlist.h"
 #include "Decoder.h"
+#include "StreamCompressor.h"
+#include "StreamCipher.h"
+#include "Tls.h"
 #include <list>
 
 
@@ -77,33 +80,124 @@ enum{
 	establish,
 	timeout,
 	closeing,
+	resolving,
+	datagram,
 };
 
 class WPacket;
 class Reactor;
 class RPacket;
 class Socket;
+class ConnectJob;
+class ResumeReadTask;
+class FilePacket;
+
+//lets native code owning a socket(HttpConnPool) hear about its close,it runs
+//before the lua disconnect callback
+typedef void (*CloseHook)(Socket*,void *ud);
 
 class Socket:public dnode{
 	friend class Reactor;
+	friend class ConnectJob;
+	friend class ResumeReadTask;
 	friend void do_cb_newclient(Socket *s,Socket *client);
 	friend void do_cb_connect(Socket *s,int success);
 	friend void do_cb_packet(Socket *s,Packet*);
 	friend void do_cb_disconnected(Socket *s);		
+	friend void do_cb_datagram(Socket *s,Packet*,const struct sockaddr_in&);
 public:
 	Socket(int family,int type,int protocol);
 	Socket(SOCKET fd);
 	bool SetNonBlock();
-	int  Send(Packet*,luaRef*);
-	bool Bind(Reactor *reactor,Decoder *,luaRef&,luaRef&);
+	int  Send(Packet*,luaRef*);//the callback reference is moved into the socket
+	bool Bind(Reactor *reactor,DecoderFactory *,luaRef,luaRef);
+	//listening socket only:accepted sockets are bound natively with the factory
+	bool DefaultBind(DecoderFactory *,luaRef,luaRef);
 	void Close();
 	int  Event(){return event;}
 	int  State(){return state;}
-	bool  Listen(Reactor*,const char *ip,int port,luaRef&);
-	bool  Connect(Reactor *reactor,const char *ip,int port,luaRef&);
+	//reuseport:bind with SO_REUSEPORT so several sockets share the address and
+	//the kernel balances the incoming connections between them
+	bool  Listen(Reactor*,const char *ip,int port,luaRef,int backlog = 256,bool reuseport = false);
+	//start accepting on a fd which is already listening
+	bool  Listen(Reactor*,luaRef);
+	static bool BindListen(SOCKET fd,const char *ip,int port,int backlog = 256,bool reuseport = false);
+	static bool ReusePortSupported(){
+#ifdef SO_REUSEPORT
+		return true;
+#else
+		return false;
+#endif
+	}
+	//a host name is resolved off the reactor thread,cb fires once connected or failed
+	bool  Connect(Reactor *reactor,const char *host,int port,luaRef cb);
+	//a udp socket bound to ip:port(port 0 picks one),cb(s,rpk,ip,port) gets
+	//every datagram as a RPacket of its bytes.datagrams are read in batches,
+	//longer ones than maxsize are dropped
+	bool  BindDatagram(Reactor *reactor,const char *ip,int port,luaRef cb,size_t maxsize);
+	//queue a datagram to addr:port,the queue goes out in batches at the end of
+	//the read or the reactor round.the body of a WPacket or RPacket is sent,
+	//without the length in front.-1 if the queue is full
+	int   SendTo(Packet*,uint32_t addr,int port);
 	SOCKET Fd(){return fd;}
 	void SetUd(void *ud){this->ud = ud;}
 	void *GetUd(){return ud;}
+	void SetCloseHook(CloseHook hook,void *ud){
+		close_hook = hook;
+		this->ud   = ud;
+	}
+	//drop the lua callbacks but keep the decoder,a packet arriving afterwards
+	//has nobody to go to and closes the socket
+	void Unbind(){
+		cb_packet = cb_disconnected = cb_drain = luaRef(NULL,0);
+		highmark = lowmark = 0;
+		draining = false;
+	}
+	//stop reading the fd,the peer is held back by tcp flow control.packets
+	//already received are delivered after ResumeRead
+	void PauseRead();
+	void ResumeRead();
+	//once more than high bytes are queued the socket is Full,cb is called when
+	//the queue drains to low again.high 0 turns it off
+	void SetWatermark(size_t high,size_t low,luaRef cb){
+		highmark = high;
+		lowmark  = low < high ? low : high;
+		cb_drain = std::move(cb);
+	}
+	bool Full(){return highmark && pending >= highmark;}
+	size_t Pending(){return pending;}
+	//compress the stream from here on in both directions,with the peer doing
+	//the same at the same point:what was sent before goes out as is,received
+	//bytes after the packet being handled are inflated
+	bool Compress(const char *dict,size_t dlen,int level);
+	StreamCompressor *Compressor(){
+		for(size_t i = 0; i < transforms.size(); ++i)
+			if(StreamCompressor *c = dynamic_cast<StreamCompressor*>(transforms[i]))
+				return c;
+		return NULL;
+	}
+	//seal the stream from here on,switching like Compress.the peer passes the
+	//keys the other way round.to do both,Encrypt first:the stage added last
+	//is next to the packets,so packets are compressed and then sealed
+	bool Encrypt(const unsigned char *sendkey,const unsigned char *recvkey);
+	//TLS from here on,before any other stage.with servername this is the
+	//client end and session one to resume.cb(s,success) is called once the
+	//handshake finished,a failed one closes the socket
+	bool StartTLS(TlsContext *ctx,const char *servername,SSL_SESSION *session,luaRef cb);
+	//before Connect:the connection is TLS and the cb of Connect waits for
+	//the handshake
+	void ConnectTLS(TlsContext *ctx,const char *servername,SSL_SESSION *session){
+		delete tlsconnect;
+		tlsconnect = new TlsStream(ctx,servername,session);
+	}
+	TlsStream *Tls(){
+		for(size_t i = 0; i < transforms.size(); ++i)
+			if(TlsStream *t = dynamic_cast<TlsStream*>(transforms[i]))
+				return t;
+		return NULL;
+	}
+	Reactor *GetReactor(){return reactor;}
+	luaRef  &LuaHandle(){return lua_handle;}
 	void IncRef(){
 #ifdef _WIN		
 		InterlockedIncrement(&refCount);
@@ -124,27 +218,56 @@ public:
 private:
 	Socket(const Socket&);
 	Socket& operator = (const Socket &o);
-	~Socket(){ if(decoder) delete decoder;} 	
+	~Socket(){
+		releaseDecoder();
+		for(size_t i = 0; i < transforms.size(); ++i)
+			delete transforms[i];
+		delete tlsconnect;
+		for(size_t i = 0; i < dgrambufs.size(); ++i)
+			dgrambufs[i]->DecRef();
+	}	
 	int  rawSend();
+	void queue(Packet*);
+	int  sendFile(FilePacket*);
+	int  sendFinished(size_t n);
 	void onReadAct();
 	void onWriteAct();
 	void doAccept();
 	void doConnect();
+	bool connectTo(uint32_t addr,int port);
 	void unpack();
+	void unpackPackets();
+	bool addTransform(StreamTransform*);
+	bool decode();
+	void flushOutput();
+	void connected();
+	void handshakeDone(bool ok);
+	bool undecoded(){
+		for(size_t i = 0; i < transforms.size(); ++i)
+			if(transforms[i]->Pending()) return true;
+		return false;
+	}
+	void encodePlain(bool all = false);
+	void releaseDecoder();
+	void recvDatagrams();
+	int  sendDatagrams();
 
 private:
 
 	struct stSendFinish{
 		luaRef         cb;
 		Packet        *packet;
-		stSendFinish(Packet *p,luaRef &r):cb(r),packet(p)
+		stSendFinish(Packet *p,luaRef &&r):cb(std::move(r)),packet(p)
 		{}		
 	};
 
+	struct stDatagram{
+		Packet             *packet;
+		struct sockaddr_in  addr;
+	};
+
 	SOCKET        fd;
-	static const  int recvbuf_size = 65535;
 	static const  int maxpacket_size = 65535;
-	char   		  recvbuf[recvbuf_size];
 	Reactor      *reactor;
 	bool    	  writeable;
 	volatile      long refCount;
@@ -160,7 +283,27 @@ private:
 	luaRef        cb_new_client;
 	luaRef        cb_disconnected;
 	luaRef        cb_packet;
-	Decoder      *decoder;   	
+	luaRef        lua_handle;
+	luaRef        cb_drain;
+	Decoder      *decoder;
+	DecoderFactory *factory;	
+	CloseHook     close_hook;
+	bool          corked;
+	bool          readpaused;
+	size_t        pending;//bytes queued in sendlist
+	size_t        highmark;
+	size_t        lowmark;
+	bool          draining;//went over highmark,cb_drain is due
+	std::vector<StreamTransform*> transforms;//transforms[0] is next to the packets
+	size_t        plain;//packets at the end of sendlist not encoded yet
+	size_t        ucur;//end of the packet being handled in unpackbuf
+	TlsStream    *tlsconnect;//started once connected
+	bool          handshaking;//cb_connect is due when the tls handshake ends
+	static const  size_t max_dgram_batch = 64;
+	static const  size_t max_dgram_queue = 4096;
+	std::list<stDatagram>     dgramlist;//queued by SendTo
+	std::vector<ByteBuffer*>  dgrambufs;//one per datagram of a batch,behind 4 bytes for the length
+	size_t        dgramsize;
 };
 
 }//end namespace net
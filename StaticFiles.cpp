@@ -0,0 +1,377 @@
+#include <errno.h>
+#ifndef _WIN
+#include <strings.h>
+#else
+#define strcasecmp _stricmp
+#endif
+#include "StaticFiles.h"
+#include "HttpPacket.h"
+#include "http-parser/http_parser.h"
+
+namespace net{
+
+static const struct{
+	const char *ext;
+	const char *type;
+	bool        compressible;
+}mime_types[] = {
+	{"html","text/html; charset=utf-8",true},
+	{"htm","text/html; charset=utf-8",true},
+	{"css","text/css",true},
+	{"js","application/javascript",true},
+	{"json","application/json",true},
+	{"txt","text/plain; charset=utf-8",true},
+	{"xml","application/xml",true},
+	{"svg","image/svg+xml",true},
+	{"wasm","application/wasm",true},
+	{"png","image/png",false},
+	{"jpg","image/jpeg",false},
+	{"jpeg","image/jpeg",false},
+	{"gif","image/gif",false},
+	{"ico","image/x-icon",false},
+	{"webp","image/webp",false},
+	{"woff","font/woff",false},
+	{"woff2","font/woff2",false},
+	{"pdf","application/pdf",false},
+	{"zip","application/zip",false},
+	{"mp3","audio/mpeg",false},
+	{"mp4","video/mp4",false},
+};
+
+static const char *mimeType(const std::string &path,bool &compressible){
+	compressible = false;
+	size_t dot = path.rfind('.');
+	if(dot == std::string::npos || path.find('/',dot) != std::string::npos)
+		return "application/octet-stream";
+	const char *ext = path.c_str() + dot + 1;
+	for(size_t i = 0; i < sizeof(mime_types)/sizeof(mime_types[0]); ++i)
+		if(strcasecmp(ext,mime_types[i].ext) == 0){
+			compressible = mime_types[i].compressible;
+			return mime_types[i].type;
+		}
+	return "application/octet-stream";
+}
+
+//no "..",empty or "." segment may climb out of the root
+static bool safePath(const char *path,size_t len){
+	size_t i = 0;
+	while(i < len){
+		size_t end = i;
+		while(end < len && path[end] != '/' && path[end] != '\\'){
+			if(path[end] == '\0') return false;
+			++end;
+		}
+		if(end - i == 2 && path[i] == '.' && path[i+1] == '.')
+			return false;
+		i = end + 1;
+	}
+	return true;
+}
+
+static bool headerIs(HttpPacket *req,const char *name,const char *expect){
+	const char *value;
+	size_t len;
+	if(!req->GetHeader(name,strlen(name),value,len)) return false;
+	return len == strlen(expect) && memcmp(value,expect,len) == 0;
+}
+
+//If-None-Match:"*" or a list of etags,weak ones compare equal too
+static bool noneMatch(const char *value,size_t len,const char *etag){
+	size_t elen = strlen(etag);
+	size_t i = 0;
+	while(i < len){
+		while(i < len && (value[i] == ' ' || value[i] == ',')) ++i;
+		size_t end = i;
+		while(end < len && value[end] != ',') ++end;
+		size_t tend = end;
+		while(tend > i && value[tend-1] == ' ') --tend;
+		const char *tag = value + i;
+		size_t tlen = tend - i;
+		if(tlen == 1 && tag[0] == '*') return true;
+		if(tlen > 2 && tag[0] == 'W' && tag[1] == '/'){
+			tag  += 2;
+			tlen -= 2;
+		}
+		if(tlen == elen && memcmp(tag,etag,elen) == 0) return true;
+		i = end;
+	}
+	return false;
+}
+
+//a single "bytes=first-last" range of size bytes,1 when satisfiable,-1 when
+//not and 0 when the header is ignored(several ranges,bad syntax)
+static int byteRange(const char *value,size_t len,size_t size,size_t &first,size_t &last){
+	std::string spec(value,len);
+	if(spec.compare(0,6,"bytes=") != 0 || spec.find(',') != std::string::npos)
+		return 0;
+	const char *p = spec.c_str() + 6;
+	char *end;
+	if(*p == '-'){
+		//the last n bytes
+		unsigned long long n = strtoull(p + 1,&end,10);
+		if(end == p + 1 || *end) return 0;
+		if(n == 0 || size == 0) return -1;
+		first = n >= size ? 0 : size - n;
+		last  = size - 1;
+		return 1;
+	}
+	unsigned long long a = strtoull(p,&end,10);
+	if(end == p || *end != '-') return 0;
+	p = end + 1;
+	unsigned long long b = size ? size - 1 : 0;
+	if(*p){
+		b = strtoull(p,&end,10);
+		if(*end || b < a) return 0;
+		if(b >= size) b = size - 1;
+	}
+	if(a >= size) return -1;
+	first = (size_t)a;
+	last  = (size_t)b;
+	return 1;
+}
+
+StaticFiles::StaticFiles(const char *root,size_t cachesize,size_t maxfile,size_t compressmin):root(root),
+	cachesize(cachesize),maxfile(maxfile),compressmin(compressmin),cached(0){
+	while(this->root.size() > 1 && this->root[this->root.size() - 1] == '/')
+		this->root.resize(this->root.size() - 1);
+}
+
+StaticFiles::~StaticFiles(){
+	std::list<entry*>::iterator it = lru.begin();
+	for(; it != lru.end(); ++it)
+		delete *it;
+}
+
+void StaticFiles::remove(entry *e){
+	cache.erase(e->path);
+	lru.erase(e->lru);
+	cached -= e->file->Size();
+	for(int i = 0; i < 2; ++i)
+		cached -= e->variants[i].len;
+	delete e;
+}
+
+void StaticFiles::evict(entry *keep){
+	while(cached > cachesize && lru.back() != keep)
+		remove(lru.back());
+}
+
+//the encoded variant of a cached file,compressed on first use
+StaticFiles::variant *StaticFiles::encoded(entry *e,int encoding){
+	variant *v = &e->variants[encoding == ENCODING_GZIP ? 0 : 1];
+	if(!v->tried){
+		v->tried = true;
+		Deflater *deflater = Deflater::Shared(encoding,9);
+		size_t size = e->file->Size();
+		if(deflater->Ok() && e->file->Data()){
+			ByteBuffer *data = ByteBuffer::New(size/2 + 64);
+			size_t len = deflater->Write(data,0,e->file->Data(),size,Z_FINISH);
+			if(len < size){
+				v->data = data;
+				v->len  = len;
+				cached += len;
+				snprintf(v->etag,sizeof(v->etag),"%.*s-%s\"",(int)strlen(e->etag) - 1,e->etag,EncodingName(encoding));
+				evict(e);
+			}else
+				data->DecRef();
+		}
+	}
+	return v->data ? v : NULL;
+}
+
+StaticFiles::entry *StaticFiles::open(const std::string &path,int &status){
+	int fd = ::open(path.c_str(),O_RDONLY);
+	if(fd < 0){
+		status = errno == EACCES ? 403 : 404;
+		return NULL;
+	}
+	struct stat st;
+	if(fstat(fd,&st) != 0 || S_ISDIR(st.st_mode) || !S_ISREG(st.st_mode)){
+		::close(fd);
+		status = 404;
+		return NULL;
+	}
+	size_t size = (size_t)st.st_size;
+	entry *e   = new entry;
+	e->path    = path;
+	e->mtime   = st.st_mtime;
+	e->ino     = st.st_ino;
+	e->checked = time(NULL);
+	e->mime    = mimeType(path,e->compressible);
+	snprintf(e->etag,sizeof(e->etag),"\"%llx-%llx\"",(unsigned long long)st.st_mtime,(unsigned long long)size);
+	struct tm tm;
+#ifdef _WIN
+	gmtime_s(&tm,&e->mtime);
+#else
+	gmtime_r(&e->mtime,&tm);
+#endif
+	strftime(e->lastmodified,sizeof(e->lastmodified),"%a, %d %b %Y %H:%M:%S GMT",&tm);
+	if(size > maxfile || size > cachesize){
+		e->file = FileBody::Open(fd,size,false);
+		return e;
+	}
+	e->file    = FileBody::Open(fd,size,true);
+	e->incache = true;
+	lru.push_front(e);
+	e->lru = lru.begin();
+	cache[path] = e;
+	cached += size;
+	evict(e);
+	return e;
+}
+
+StaticFiles::entry *StaticFiles::lookup(const std::string &path,int &status){
+	time_t now = time(NULL);
+	std::map<std::string,entry*>::iterator it = cache.find(path);
+	if(it != cache.end()){
+		entry *e = it->second;
+		bool fresh = e->checked == now;
+		if(!fresh){
+			struct stat st;
+			fresh = stat(path.c_str(),&st) == 0 && st.st_mtime == e->mtime &&
+				st.st_ino == e->ino && (size_t)st.st_size == e->file->Size();
+			e->checked = now;
+		}
+		if(fresh){
+			lru.splice(lru.begin(),lru,e->lru);
+			return e;
+		}
+		remove(e);
+	}
+	struct stat st;
+	if(stat(path.c_str(),&st) != 0){
+		status = errno == EACCES ? 403 : 404;
+		return NULL;
+	}
+	if(S_ISDIR(st.st_mode))
+		return lookup(path + (path[path.size() - 1] == '/' ? "index.html" : "/index.html"),status);
+	return open(path,status);
+}
+
+int StaticFiles::error(int status,HttpResponse *&res,Packet *&body,size_t &length){
+	const char *text;
+	switch(status){
+		case 403:text = "forbidden\n";break;
+		case 404:text = "not found\n";break;
+		case 405:text = "method not allowed\n";break;
+		default:text = "error\n";break;
+	}
+	res = new HttpResponse(status);
+	res->AddHeader("Content-Type: text/plain",24);
+	if(status == 405)
+		res->AddHeader("Allow: GET, HEAD",16);
+	length = strlen(text);
+	body   = new RawBinPacket(text,length);
+	return status;
+}
+
+int StaticFiles::Respond(HttpPacket *req,const char *path,size_t plen,HttpResponse *&res,Packet *&body,size_t &length){
+	res    = NULL;
+	body   = NULL;
+	length = 0;
+	int method = req->GetMethod();
+	if(method != HTTP_GET && method != HTTP_HEAD)
+		return error(405,res,body,length);
+	scratch = root;
+	scratch += '/';
+	if(path){
+		while(plen > 0 && *path == '/'){
+			++path;
+			--plen;
+		}
+		scratch.append(path,plen);
+	}else{
+		size_t len;
+		const char *url = req->GetUrl(len);
+		if(!url) url = "";
+		size_t end = 0;
+		while(end < len && url[end] != '?' && url[end] != '#') ++end;
+		size_t begin = 0;
+		if(end > 0 && url[0] != '/'){
+			//an absolute form url,skip the scheme and host
+			const char *p = (const char*)memchr(url,':',end);
+			if(p && p + 3 <= url + end && p[1] == '/' && p[2] == '/'){
+				p = (const char*)memchr(p + 3,'/',url + end - (p + 3));
+				begin = p ? p - url : end;
+			}
+		}
+		while(begin < end && url[begin] == '/') ++begin;
+		size_t off = scratch.size();
+		scratch.resize(off + end - begin);
+		scratch.resize(off + UrlDecode(url + begin,end - begin,&scratch[off],false));
+	}
+	size_t rel = root.size() + 1;
+	if(!safePath(scratch.c_str() + rel,scratch.size() - rel))
+		return error(404,res,body,length);
+	int status = 404;
+	entry *e = lookup(scratch,status);
+	if(!e) return error(status,res,body,length);
+
+	size_t size = e->file->Size();
+	const char *value;
+	size_t vlen;
+	//a range is served from the file as is
+	bool compressible = e->incache && e->compressible && compressmin && size >= compressmin &&
+		!req->GetHeader("Range",5,value,vlen);
+	variant *v = NULL;
+	int encoding = ENCODING_IDENTITY;
+	if(compressible && req->GetHeader("Accept-Encoding",15,value,vlen)){
+		encoding = NegotiateEncoding(value,vlen);
+		if(encoding != ENCODING_IDENTITY)
+			v = encoded(e,encoding);
+	}
+	const char *etag = v ? v->etag : e->etag;
+	bool notmodified;
+	if(req->GetHeader("If-None-Match",13,value,vlen))
+		notmodified = noneMatch(value,vlen,etag);
+	else
+		notmodified = headerIs(req,"If-Modified-Since",e->lastmodified);
+
+	status = 200;
+	size_t first = 0,last = size ? size - 1 : 0;
+	if(notmodified)
+		status = 304;
+	else if(!v && req->GetHeader("Range",5,value,vlen) && (!req->GetHeader("If-Range",8,value,vlen) ||
+		headerIs(req,"If-Range",e->etag) || headerIs(req,"If-Range",e->lastmodified))){
+		req->GetHeader("Range",5,value,vlen);
+		int r = byteRange(value,vlen,size,first,last);
+		if(r > 0)
+			status = 206;
+		else if(r < 0)
+			status = 416;
+	}
+
+	char buf[128];
+	res = new HttpResponse(status);
+	if(status != 304)
+		res->AddHeader("Content-Type",12,e->mime,strlen(e->mime));
+	res->AddHeader("Last-Modified",13,e->lastmodified,strlen(e->lastmodified));
+	res->AddHeader("ETag",4,etag,strlen(etag));
+	res->AddHeader("Accept-Ranges: bytes",20);
+	if(v){
+		const char *name = EncodingName(encoding);
+		res->AddHeader("Content-Encoding",16,name,strlen(name));
+	}
+	if(compressible)
+		res->AddHeader("Vary: Accept-Encoding",21);
+	if(status == 416){
+		int n = snprintf(buf,sizeof(buf),"Content-Range: bytes */%llu",(unsigned long long)size);
+		res->AddHeader(buf,n);
+	}else if(status == 206){
+		int n = snprintf(buf,sizeof(buf),"Content-Range: bytes %llu-%llu/%llu",
+			(unsigned long long)first,(unsigned long long)last,(unsigned long long)size);
+		res->AddHeader(buf,n);
+	}
+	if(v)
+		length = v->len;
+	else if(status == 200 || status == 206)
+		length = size ? last - first + 1 : 0;
+	else if(status == 304)
+		length = size;
+	if(length && (status == 200 || status == 206) && method == HTTP_GET)
+		body = v ? (Packet*)new RawBinPacket(v->data,v->len) : new FilePacket(e->file,first,length);
+	if(!e->incache) delete e;
+	return status;
+}
+
+}
@@ -0,0 +1,89 @@
+#ifndef _STATICFILES_H
+#define _STATICFILES_H
+
+#include <time.h>
+#include <map>
+#include <list>
+#include <string>
+#include "FilePacket.h"
+#include "HttpResponse.h"
+
+namespace net{
+
+class HttpPacket;
+
+//answers GET and HEAD with the files under a root directory:ETag and
+//Last-Modified for conditional requests(304),a single byte Range(206).files
+//up to maxfile bytes are read into memory and kept in an LRU cache of at most cachesize
+//bytes,bigger ones are opened per request and sent with sendfile.a cached
+//file is checked against the disk at most once a second.cached text files of
+//at least compressmin bytes are also served gzip or deflate encoded,each
+//variant is compressed once and cached next to the file.file data never
+//leaves native memory
+class StaticFiles{
+public:
+	StaticFiles(const char *root,size_t cachesize,size_t maxfile,size_t compressmin);
+	~StaticFiles();
+
+	//the response to req for path(decoded,relative to root,NULL for the path
+	//of the request url):the head in res,the body in body(NULL for none) and
+	//the length to announce.returns the status
+	int Respond(HttpPacket *req,const char *path,size_t plen,HttpResponse *&res,Packet *&body,size_t &length);
+
+	size_t Cached(){return cached;}
+
+private:
+	//the file compressed with one encoding,data is NULL when it did not shrink
+	struct variant{
+		ByteBuffer *data;
+		size_t      len;
+		bool        tried;
+		char        etag[56];
+	};
+
+	struct entry{
+		std::string                  path;
+		FileBody                    *file;
+		time_t                       mtime;
+		ino_t                        ino;
+		time_t                       checked;//last stat
+		bool                         incache;
+		const char                  *mime;
+		bool                         compressible;
+		variant                      variants[2];//gzip,deflate
+		char                         etag[48];
+		char                         lastmodified[40];
+		std::list<entry*>::iterator  lru;
+		entry():file(NULL),incache(false),compressible(false){
+			memset(variants,0,sizeof(variants));
+		}
+		~entry(){
+			if(file) file->DecRef();
+			for(int i = 0; i < 2; ++i)
+				if(variants[i].data) variants[i].data->DecRef();
+		}
+	};
+
+	StaticFiles(const StaticFiles&);
+	StaticFiles& operator = (const StaticFiles&);
+
+	entry *lookup(const std::string &path,int &status);
+	entry *open(const std::string &path,int &status);
+	void   remove(entry *e);
+	void   evict(entry *keep);
+	variant *encoded(entry *e,int encoding);
+	int    error(int status,HttpResponse *&res,Packet *&body,size_t &length);
+
+	std::string                    root;
+	size_t                         cachesize;
+	size_t                         maxfile;
+	size_t                         compressmin;
+	size_t                         cached;
+	std::map<std::string,entry*>   cache;
+	std::list<entry*>              lru;//most recently used first
+	std::string                    scratch;
+};
+
+}
+
+#endif
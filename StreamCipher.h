@@ -0,0 +1,104 @@
+#ifndef _STREAMCIPHER_H
+#define _STREAMCIPHER_H
+
+#include <stdint.h>
+#include "RawBinPacket.h"
+#include "StreamTransform.h"
+#include "ChaCha20Poly1305.h"
+
+namespace net{
+
+//ChaCha20-Poly1305 records on a socket's byte stream:every packet goes out
+//sealed as 4 bytes of big endian length(authenticated too),the ciphertext and
+//a 16 byte tag,longer ones split at MAXRECORD.each direction has its own key
+//and counts records for the nonce,so the peer passes the two keys swapped.
+//a record is only handed on after its tag checked out
+class StreamCipher : public StreamTransform{
+public:
+	static const size_t KEYLEN    = ChaCha20Poly1305::KEYLEN;
+	static const size_t MAXRECORD = 16384;
+	static const size_t OVERHEAD  = 4 + ChaCha20Poly1305::TAGLEN;
+
+	StreamCipher(const unsigned char sendkey[KEYLEN],const unsigned char recvkey[KEYLEN]):
+		m_send(sendkey),m_recv(recvkey),m_sendseq(0),m_recvseq(0),m_open(0){}
+
+	bool Ok(){
+		return true;
+	}
+
+	//copied into the packet's buffer,then encrypted there
+	Packet *Encode(const char *data,size_t len,bool){
+		size_t records = (len + MAXRECORD - 1)/MAXRECORD;
+		ByteBuffer *buffer = ByteBuffer::New(len + records*OVERHEAD);
+		std::vector<char> &buf = buffer->Buf();
+		size_t pos = 0;
+		while(len > 0){
+			size_t n = len < MAXRECORD ? len : MAXRECORD;
+			unsigned char *p = (unsigned char*)&buf[pos];
+			p[0] = (unsigned char)(n >> 24);
+			p[1] = (unsigned char)(n >> 16);
+			p[2] = (unsigned char)(n >> 8);
+			p[3] = (unsigned char)n;
+			memcpy(p + 4,data,n);
+			unsigned char nonce[ChaCha20Poly1305::NONCELEN];
+			makeNonce(nonce,m_sendseq++);
+			m_send.Seal(nonce,p,4,p + 4,n,p + 4 + n);
+			pos  += n + OVERHEAD;
+			data += n;
+			len  -= n;
+		}
+		Packet *packet = new RawBinPacket(buffer,pos);
+		buffer->DecRef();
+		return packet;
+	}
+
+	//records are opened in place in the input buffer,-1 on a bad tag or length
+	int Decode(char *out,size_t cap){
+		size_t n = 0;
+		while(n < cap){
+			if(m_open == 0){
+				if(m_inlen < 4) break;
+				unsigned char *p = (unsigned char*)&m_input[m_inpos];
+				size_t len = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | p[3];
+				if(len == 0 || len > MAXRECORD) return -1;
+				if(m_inlen < len + OVERHEAD) break;
+				unsigned char nonce[ChaCha20Poly1305::NONCELEN];
+				makeNonce(nonce,m_recvseq++);
+				if(!m_recv.Open(nonce,p,4,p + 4,len,p + 4 + len))
+					return -1;
+				m_inpos += 4;
+				m_inlen -= 4;
+				m_open   = len;
+			}
+			size_t c = m_open < cap - n ? m_open : cap - n;
+			memcpy(out + n,&m_input[m_inpos],c);
+			n       += c;
+			m_inpos += c;
+			m_inlen -= c;
+			m_open  -= c;
+			if(m_open == 0){
+				//the tag
+				m_inpos += ChaCha20Poly1305::TAGLEN;
+				m_inlen -= ChaCha20Poly1305::TAGLEN;
+			}
+		}
+		return (int)n;
+	}
+
+private:
+	static void makeNonce(unsigned char nonce[ChaCha20Poly1305::NONCELEN],uint64_t seq){
+		memset(nonce,0,4);
+		for(int i = 0; i < 8; ++i)
+			nonce[4 + i] = (unsigned char)(seq >> (8*i));
+	}
+
+	ChaCha20Poly1305  m_send;
+	ChaCha20Poly1305  m_recv;
+	uint64_t          m_sendseq;
+	uint64_t          m_recvseq;
+	size_t            m_open;//opened plaintext left at m_inpos,its tag follows
+};
+
+}
+
+#endif
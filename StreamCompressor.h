@@ -0,0 +1,135 @@
+#ifndef _STREAMCOMPRESSOR_H
+#define _STREAMCOMPRESSOR_H
+
+#include <zlib.h>
+#include <time.h>
+#include <stdint.h>
+#include <string>
+#include "RawBinPacket.h"
+#include "StreamTransform.h"
+#ifdef _WIN
+#include "SysTime.h"
+#endif
+
+namespace net{
+
+//zlib compression of both directions of a socket's byte stream,below the
+//decoder.both ends start from the same preset dictionary(say the keys and
+//strings common in packets),so short packets compress from the first byte on
+class StreamCompressor : public StreamTransform{
+public:
+	struct stats{
+		uint64_t out_plain;//bytes handed to Send
+		uint64_t out_wire;//after compression
+		uint64_t in_wire;//compressed bytes inflated
+		uint64_t in_plain;//after inflation
+		uint64_t usec;//time spent compressing and inflating
+	};
+
+	StreamCompressor(const char *dict,size_t dlen,int level):m_dict(dict ? dict : "",dict ? dlen : 0),m_ok(false){
+		memset(&m_stats,0,sizeof(m_stats));
+		memset(&m_deflate,0,sizeof(m_deflate));
+		memset(&m_inflate,0,sizeof(m_inflate));
+		if(deflateInit(&m_deflate,level) != Z_OK) return;
+		if(inflateInit(&m_inflate) != Z_OK){
+			deflateEnd(&m_deflate);
+			return;
+		}
+		if(!m_dict.empty())
+			deflateSetDictionary(&m_deflate,(const Bytef*)m_dict.data(),(uInt)m_dict.size());
+		m_ok = true;
+	}
+
+	~StreamCompressor(){
+		if(m_ok){
+			deflateEnd(&m_deflate);
+			inflateEnd(&m_inflate);
+		}
+	}
+
+	bool Ok(){
+		return m_ok;
+	}
+
+	const stats &Stats(){
+		return m_stats;
+	}
+
+	//compress the len bytes of a packet into a new one,with flush the output
+	//ends on a byte boundary the reader can inflate in full(Z_SYNC_FLUSH),else
+	//it may be held back to compress better with what follows
+	Packet *Encode(const char *data,size_t len,bool flush){
+		uint64_t start = now();
+		ByteBuffer *buffer = ByteBuffer::New(len + 64);
+		std::vector<char> &buf = buffer->Buf();
+		size_t pos = 0;
+		m_deflate.next_in  = (Bytef*)data;
+		m_deflate.avail_in = (uInt)len;
+		for(;;){
+			if(buf.size() < pos + 64)
+				buffer->Reserve(pos + 64 + len/2);
+			m_deflate.next_out  = (Bytef*)&buf[pos];
+			m_deflate.avail_out = (uInt)(buf.size() - pos);
+			int ret = deflate(&m_deflate,flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+			pos = buf.size() - m_deflate.avail_out;
+			if(ret == Z_STREAM_ERROR || m_deflate.avail_out > 0)
+				break;
+		}
+		Packet *packet = new RawBinPacket(buffer,pos);
+		buffer->DecRef();
+		m_stats.out_plain += len;
+		m_stats.out_wire  += pos;
+		m_stats.usec      += now() - start;
+		return packet;
+	}
+
+	//inflate into out,-1 on a corrupt stream or a dictionary other than ours
+	int Decode(char *out,size_t cap){
+		if(m_inlen == 0 || cap == 0) return 0;
+		uint64_t start = now();
+		m_inflate.next_in   = (Bytef*)&m_input[m_inpos];
+		m_inflate.avail_in  = (uInt)m_inlen;
+		m_inflate.next_out  = (Bytef*)out;
+		m_inflate.avail_out = (uInt)cap;
+		int ret = inflate(&m_inflate,Z_SYNC_FLUSH);
+		if(ret == Z_NEED_DICT){
+			if(m_dict.empty() || inflateSetDictionary(&m_inflate,(const Bytef*)m_dict.data(),(uInt)m_dict.size()) != Z_OK)
+				return -1;
+			ret = inflate(&m_inflate,Z_SYNC_FLUSH);
+		}
+		if(ret != Z_OK && ret != Z_BUF_ERROR)
+			return -1;//Z_STREAM_END too,the peer never ends the stream
+		size_t used = m_inlen - m_inflate.avail_in;
+		m_inpos += used;
+		m_inlen -= used;
+		m_stats.in_wire += used;
+		size_t n = cap - m_inflate.avail_out;
+		m_stats.in_plain += n;
+		m_stats.usec     += now() - start;
+		return (int)n;
+	}
+
+private:
+	StreamCompressor(const StreamCompressor&);
+	StreamCompressor& operator = (const StreamCompressor&);
+
+	static uint64_t now(){
+#ifdef _WIN
+		return GetSystemMs64()*1000;
+#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC,&ts);
+		return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+#endif
+	}
+
+	std::string        m_dict;
+	z_stream           m_deflate;
+	z_stream           m_inflate;
+	stats              m_stats;
+	bool               m_ok;
+};
+
+}
+
+#endif
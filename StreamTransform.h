@@ -0,0 +1,78 @@
+#ifndef _STREAMTRANSFORM_H
+#define _STREAMTRANSFORM_H
+
+#include <string.h>
+#include <vector>
+#include "Packet.h"
+
+namespace net{
+
+//a stage between a socket's packets and the wire,in both directions:Encode
+//turns the bytes of sent packets into what goes out,received bytes are put in
+//the input buffer and Decode gives back what the peer's stage was handed.
+//Socket chains them,the one added last is next to the packets
+class StreamTransform{
+public:
+	StreamTransform():m_input(65536),m_inpos(0),m_inlen(0){}
+	virtual ~StreamTransform(){}
+
+	virtual bool Ok() = 0;
+
+	//the wire form of len bytes,with flush all of them must be decodable by
+	//the peer once it has what this returns,else they may be held back
+	virtual Packet *Encode(const char *data,size_t len,bool flush) = 0;
+
+	//decode into out,at most cap bytes.returns the bytes written,-1 on a
+	//corrupt stream
+	virtual int Decode(char *out,size_t cap) = 0;
+
+	//wire bytes the stage produced on its own(a handshake),sent after what
+	//was encoded before them
+	virtual Packet *Output(){
+		return NULL;
+	}
+
+	//room for received bytes
+	char *InputSpace(size_t &space){
+		if(m_inpos > 0){
+			memmove(&m_input[0],&m_input[m_inpos],m_inlen);
+			m_inpos = 0;
+		}
+		space = m_input.size() - m_inlen;
+		return &m_input[m_inlen];
+	}
+
+	void InputAdded(size_t n){
+		m_inlen += n;
+	}
+
+	//bytes received before the stage was added that belong after it
+	void PushInput(const char *data,size_t len){
+		size_t space;
+		char *p = InputSpace(space);
+		if(space < len){
+			m_input.resize(m_inlen + len);
+			p = &m_input[m_inlen];
+		}
+		memcpy(p,data,len);
+		InputAdded(len);
+	}
+
+	//received bytes not decoded yet
+	virtual size_t Pending(){
+		return m_inlen;
+	}
+
+protected:
+	std::vector<char>  m_input;
+	size_t             m_inpos;
+	size_t             m_inlen;
+
+private:
+	StreamTransform(const StreamTransform&);
+	StreamTransform& operator = (const StreamTransform&);
+};
+
+}
+
+#endif
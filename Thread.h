@@ -0,0 +1,162 @@
+#ifndef _THREAD_H
+#define _THREAD_H
+
+#ifdef _WIN
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+namespace net{
+
+class Mutex{
+public:
+	Mutex(){
+#ifdef _WIN
+		InitializeCriticalSection(&m_mtx);
+#else
+		pthread_mutex_init(&m_mtx,NULL);
+#endif
+	}
+
+	~Mutex(){
+#ifdef _WIN
+		DeleteCriticalSection(&m_mtx);
+#else
+		pthread_mutex_destroy(&m_mtx);
+#endif
+	}
+
+	void Lock(){
+#ifdef _WIN
+		EnterCriticalSection(&m_mtx);
+#else
+		pthread_mutex_lock(&m_mtx);
+#endif
+	}
+
+	void Unlock(){
+#ifdef _WIN
+		LeaveCriticalSection(&m_mtx);
+#else
+		pthread_mutex_unlock(&m_mtx);
+#endif
+	}
+
+private:
+	friend class Condition;
+	Mutex(const Mutex&);
+	Mutex& operator = (const Mutex&);
+#ifdef _WIN
+	CRITICAL_SECTION m_mtx;
+#else
+	pthread_mutex_t  m_mtx;
+#endif
+};
+
+class Guard{
+public:
+	Guard(Mutex &mtx):m_mtx(mtx){m_mtx.Lock();}
+	~Guard(){m_mtx.Unlock();}
+private:
+	Guard(const Guard&);
+	Guard& operator = (const Guard&);
+	Mutex &m_mtx;
+};
+
+class Condition{
+public:
+	Condition(){
+#ifdef _WIN
+		InitializeConditionVariable(&m_cond);
+#else
+		pthread_cond_init(&m_cond,NULL);
+#endif
+	}
+
+	~Condition(){
+#ifndef _WIN
+		pthread_cond_destroy(&m_cond);
+#endif
+	}
+
+	//mtx must be locked by the caller
+	void Wait(Mutex &mtx){
+#ifdef _WIN
+		SleepConditionVariableCS(&m_cond,&mtx.m_mtx,INFINITE);
+#else
+		pthread_cond_wait(&m_cond,&mtx.m_mtx);
+#endif
+	}
+
+	void Signal(){
+#ifdef _WIN
+		WakeConditionVariable(&m_cond);
+#else
+		pthread_cond_signal(&m_cond);
+#endif
+	}
+
+private:
+	Condition(const Condition&);
+	Condition& operator = (const Condition&);
+#ifdef _WIN
+	CONDITION_VARIABLE m_cond;
+#else
+	pthread_cond_t     m_cond;
+#endif
+};
+
+class Thread{
+public:
+	Thread():started(false){}
+
+	virtual ~Thread(){}
+
+	bool Start(){
+		if(started) return false;
+#ifdef _WIN
+		m_thread = CreateThread(NULL,0,routine,this,0,NULL);
+		started  = m_thread != NULL;
+#else
+		started  = pthread_create(&m_thread,NULL,routine,this) == 0;
+#endif
+		return started;
+	}
+
+	void Join(){
+		if(!started) return;
+#ifdef _WIN
+		WaitForSingleObject(m_thread,INFINITE);
+		CloseHandle(m_thread);
+#else
+		pthread_join(m_thread,NULL);
+#endif
+		started = false;
+	}
+
+protected:
+	virtual void Run() = 0;
+
+private:
+#ifdef _WIN
+	static DWORD WINAPI routine(LPVOID arg){
+		((Thread*)arg)->Run();
+		return 0;
+	}
+	HANDLE    m_thread;
+#else
+	static void *routine(void *arg){
+		((Thread*)arg)->Run();
+		return NULL;
+	}
+	pthread_t m_thread;
+#endif
+	Thread(const Thread&);
+	Thread& operator = (const Thread&);
+	bool      started;
+};
+
+}
+
+#endif
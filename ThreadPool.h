@@ -0,0 +1,91 @@
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <list>
+#include <vector>
+#include "Thread.h"
+#include "Reactor.h"
+
+namespace net{
+
+//Work runs on a pool thread,then the job is posted back to the reactor that
+//submitted it and Do completes it on that reactor's thread
+class Job : public Task{
+public:
+	Job():reactor(NULL){}
+	virtual void Work() = 0;
+private:
+	friend class ThreadPool;
+	Reactor *reactor;
+};
+
+//a fixed number of threads taking jobs from one queue,it lives until exit
+class ThreadPool{
+public:
+	//the pool shared by every reactor of the process,n only matters on the first call
+	static ThreadPool *Default(int n = 4){
+		static Mutex       mtx;
+		static ThreadPool *pool = NULL;
+		Guard guard(mtx);
+		if(!pool) pool = new ThreadPool(n > 0 ? n : 4);
+		return pool;
+	}
+
+	//a pool of its own keeps slow jobs(dns lookups) from starving Default
+	ThreadPool(int n){
+		for(int i = 0; i < n; ++i){
+			PoolThread *t = new PoolThread(this);
+			if(t->Start())
+				threads.push_back(t);
+			else
+				delete t;
+		}
+	}
+
+	void Submit(Reactor *reactor,Job *job){
+		job->reactor = reactor;
+		Guard guard(mtx);
+		jobs.push_back(job);
+		cond.Signal();
+	}
+
+	int Size() const{
+		return (int)threads.size();
+	}
+
+private:
+	class PoolThread : public Thread{
+	public:
+		PoolThread(ThreadPool *pool):pool(pool){}
+	protected:
+		void Run(){pool->loop();}
+	private:
+		ThreadPool *pool;
+	};
+
+	void loop(){
+		for(;;){
+			Job *job;
+			{
+				Guard guard(mtx);
+				while(jobs.empty())
+					cond.Wait(mtx);
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			job->Work();
+			job->reactor->Post(job);
+		}
+	}
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator = (const ThreadPool&);
+	Mutex                      mtx;
+	Condition                  cond;
+	std::list<Job*>            jobs;
+	std::vector<PoolThread*>   threads;
+};
+
+}
+
+#endif
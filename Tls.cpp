@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+#include "Tls.h"
+#ifndef _WIN
+#include <arpa/inet.h>
+#endif
+
+namespace net{
+
+static std::string lastError(){
+	char buf[256];
+	unsigned long e = ERR_get_error();
+	ERR_clear_error();
+	if(!e) return "unknown error";
+	ERR_error_string_n(e,buf,sizeof(buf));
+	return buf;
+}
+
+bool TlsContext::Init(const char *cert,const char *key,const char *ca,bool verify,std::string &err){
+	ctx = SSL_CTX_new(TLS_method());
+	if(!ctx){
+		err = lastError();
+		return false;
+	}
+	this->verify = verify;
+	SSL_CTX_set_min_proto_version(ctx,TLS1_2_VERSION);
+	SSL_CTX_set_mode(ctx,SSL_MODE_RELEASE_BUFFERS);
+	//clients keep sessions to resume,servers issue tickets
+	SSL_CTX_set_session_cache_mode(ctx,SSL_SESS_CACHE_BOTH);
+	static const unsigned char sid[] = "luanet";
+	SSL_CTX_set_session_id_context(ctx,sid,sizeof(sid) - 1);
+	if(cert){
+		if(SSL_CTX_use_certificate_chain_file(ctx,cert) != 1 ||
+		   SSL_CTX_use_PrivateKey_file(ctx,key ? key : cert,SSL_FILETYPE_PEM) != 1 ||
+		   SSL_CTX_check_private_key(ctx) != 1){
+			err = lastError();
+			return false;
+		}
+	}
+	if(verify){
+		if((ca ? SSL_CTX_load_verify_locations(ctx,ca,NULL) : SSL_CTX_set_default_verify_paths(ctx)) != 1){
+			err = lastError();
+			return false;
+		}
+		SSL_CTX_set_verify(ctx,SSL_VERIFY_PEER,NULL);
+	}
+	return true;
+}
+
+TlsStream::TlsStream(TlsContext *ctx,const char *servername,SSL_SESSION *session):
+	m_ctx(ctx->IncRef()),m_ssl(NULL),m_rbio(NULL),m_wbio(NULL),m_established(false){
+	SSL *ssl = SSL_new(ctx->Ctx());
+	if(!ssl) return;
+	m_rbio = BIO_new(BIO_s_mem());
+	m_wbio = BIO_new(BIO_s_mem());
+	if(!m_rbio || !m_wbio){
+		SSL_free(ssl);
+		return;
+	}
+	SSL_set_bio(ssl,m_rbio,m_wbio);
+	if(servername){
+		SSL_set_connect_state(ssl);
+		//an ip address is verified against the certificate's ip entries and
+		//is never sent as the server name
+		struct in_addr addr;
+		bool ip = inet_pton(AF_INET,servername,&addr) == 1;
+		if(!ip)
+			SSL_set_tlsext_host_name(ssl,servername);
+		if(ctx->Verify()){
+			if(ip)
+				X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl),servername);
+			else
+				SSL_set1_host(ssl,servername);
+		}
+		if(session)
+			SSL_set_session(ssl,session);
+		//the client hello
+		SSL_do_handshake(ssl);
+	}else
+		SSL_set_accept_state(ssl);
+	m_ssl = ssl;
+}
+
+TlsStream::~TlsStream(){
+	if(m_ssl)
+		SSL_free(m_ssl);//and the bios
+	else{
+		if(m_rbio) BIO_free(m_rbio);
+		if(m_wbio) BIO_free(m_wbio);
+	}
+	m_ctx->DecRef();
+}
+
+bool TlsStream::write(const char *data,size_t len){
+	while(len > 0){
+		//a memory bio takes everything
+		int n = SSL_write(m_ssl,data,len > 0x7fffffff ? 0x7fffffff : (int)len);
+		if(n <= 0){
+			printf("tls write:%s\n",lastError().c_str());
+			return false;
+		}
+		data += n;
+		len  -= n;
+	}
+	return true;
+}
+
+//the records waiting in the write bio as one packet
+Packet *TlsStream::drain(bool always){
+	size_t n = BIO_ctrl_pending(m_wbio);
+	if(n == 0)
+		return always ? new RawBinPacket("",0) : NULL;
+	ByteBuffer *buffer = ByteBuffer::New(n);
+	std::vector<char> &buf = buffer->Buf();
+	int got = BIO_read(m_wbio,&buf[0],(int)n);
+	Packet *packet = new RawBinPacket(buffer,got > 0 ? got : 0);
+	buffer->DecRef();
+	return packet;
+}
+
+Packet *TlsStream::Encode(const char *data,size_t len,bool){
+	if(!m_established)
+		m_early.append(data,len);
+	else
+		write(data,len);
+	return drain(true);
+}
+
+Packet *TlsStream::Output(){
+	return drain(false);
+}
+
+Packet *TlsStream::Shutdown(){
+	if(!m_established) return NULL;
+	SSL_shutdown(m_ssl);
+	return drain(false);
+}
+
+size_t TlsStream::Pending(){
+	return m_inlen + BIO_ctrl_pending(m_rbio) + (m_established ? SSL_pending(m_ssl) : 0);
+}
+
+int TlsStream::Decode(char *out,size_t cap){
+	if(m_inlen > 0){
+		int n = BIO_write(m_rbio,&m_input[m_inpos],(int)m_inlen);
+		if(n > 0){
+			m_inpos += n;
+			m_inlen -= n;
+		}
+	}
+	if(!m_established){
+		int ret = SSL_do_handshake(m_ssl);
+		if(ret != 1){
+			int err = SSL_get_error(m_ssl,ret);
+			if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+				return 0;
+			long verify = SSL_get_verify_result(m_ssl);
+			if(verify != X509_V_OK)
+				printf("tls handshake:%s\n",X509_verify_cert_error_string(verify));
+			else
+				printf("tls handshake:%s\n",lastError().c_str());
+			return -1;
+		}
+		m_established = true;
+		if(!m_early.empty()){
+			bool ok = write(m_early.data(),m_early.size());
+			std::string().swap(m_early);
+			if(!ok) return -1;
+		}
+	}
+	if(cap == 0) return 0;
+	int n = SSL_read(m_ssl,out,cap > 0x7fffffff ? 0x7fffffff : (int)cap);
+	if(n > 0) return n;
+	int err = SSL_get_error(m_ssl,n);
+	//a close_notify is followed by the peer closing the connection
+	if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_ZERO_RETURN)
+		return 0;
+	printf("tls read:%s\n",lastError().c_str());
+	return -1;
+}
+
+}
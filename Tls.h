@@ -0,0 +1,112 @@
+#ifndef _TLS_H
+#define _TLS_H
+
+#include <string>
+#include <openssl/ssl.h>
+#include "RawBinPacket.h"
+#include "StreamTransform.h"
+
+#ifdef _WIN
+#include <Windows.h>
+#endif
+
+namespace net{
+
+//an SSL_CTX:the certificate and key a server presents,the CAs a peer is
+//verified against.shared by every TlsStream made from it,each holds a ref
+class TlsContext{
+public:
+	TlsContext():refCount(1),ctx(NULL){}
+
+	//cert and key are pem files,without ca the system's CAs are trusted.
+	//false with err set
+	bool Init(const char *cert,const char *key,const char *ca,bool verify,std::string &err);
+
+	TlsContext *IncRef(){
+#ifdef _WIN
+		InterlockedIncrement(&refCount);
+#else
+		__sync_add_and_fetch(&refCount,1);
+#endif
+		return this;
+	}
+
+	void DecRef(){
+#ifdef _WIN
+		if(InterlockedDecrement(&refCount) <= 0)
+#else
+		if(__sync_sub_and_fetch(&refCount,1) <=0 )
+#endif
+			delete this;
+	}
+
+	SSL_CTX *Ctx(){
+		return ctx;
+	}
+
+	bool Verify(){
+		return verify;
+	}
+
+private:
+	TlsContext(const TlsContext&);
+	TlsContext& operator = (const TlsContext&);
+	~TlsContext(){
+		if(ctx) SSL_CTX_free(ctx);
+	}
+
+	volatile long  refCount;
+	SSL_CTX       *ctx;
+	bool           verify;
+};
+
+//TLS as a stage of a socket's stream,over memory BIOs:the socket reads and
+//writes the fd on reactor events as always and the records pass through
+//here.with a servername it is the client end.what is sent before the
+//handshake finished is held and written after it
+class TlsStream : public StreamTransform{
+public:
+	//session is a previous one with the same server to resume
+	TlsStream(TlsContext *ctx,const char *servername,SSL_SESSION *session);
+	~TlsStream();
+
+	bool Ok(){
+		return m_ssl != NULL;
+	}
+
+	Packet *Encode(const char *data,size_t len,bool flush);
+	int     Decode(char *out,size_t cap);
+	Packet *Output();
+	size_t  Pending();
+
+	bool Established(){
+		return m_established;
+	}
+
+	//the close_notify alert,NULL before the handshake
+	Packet *Shutdown();
+
+	//the session to resume the next connection with,NULL before the handshake
+	SSL_SESSION *Session(){
+		return m_established ? SSL_get1_session(m_ssl) : NULL;
+	}
+
+	SSL *Ssl(){
+		return m_ssl;
+	}
+
+private:
+	bool    write(const char *data,size_t len);
+	Packet *drain(bool always);
+
+	TlsContext  *m_ctx;
+	SSL         *m_ssl;
+	BIO         *m_rbio;
+	BIO         *m_wbio;
+	std::string  m_early;//sent before the handshake finished
+	bool         m_established;
+};
+
+}
+
+#endif
@@ -151,12 +151,15 @@ public:
 	}	
 
 private:
+	//a buffer handed to Send or C.PostMessage is shared with a packet that may be
+	//read on another thread,so writing copies it first instead of appending in place
 	void CopyOnWrite(){
-		if(wpos == 0){
+		if(wpos == 0)
+			wpos = m_buffer->ReadUint32(0) + sizeof(uint32_t);
+		if(m_buffer->Shared()){
 			ByteBuffer *tmp = new ByteBuffer(*m_buffer);
 			m_buffer->DecRef();
 			m_buffer = tmp;
-			wpos = m_buffer->ReadUint32(0);
 		}
 	}
 	size_t      wpos; 
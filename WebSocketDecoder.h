@@ -0,0 +1,361 @@
+#ifndef _WEBSOCKETDECODER_H
+#define _WEBSOCKETDECODER_H
+
+#include <stdint.h>
+#include <list>
+#include <string>
+#include <openssl/evp.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "RawBinPacket.h"
+#include "HttpDecoder.h"
+
+namespace net{
+
+//xor len bytes of src with the frame's mask into dst,phase is the mask byte
+//the first one falls on and is moved past them
+static inline void WebSocketUnmask(char *dst,const char *src,size_t len,const unsigned char mask[4],size_t &phase){
+	unsigned char m[4];
+	for(int i = 0; i < 4; ++i)
+		m[i] = mask[(phase + i) & 3];
+	uint32_t m32;
+	memcpy(&m32,m,4);
+	size_t i = 0;
+#ifdef __SSE2__
+	__m128i m128 = _mm_set1_epi32((int)m32);
+	for(; i + 16 <= len; i += 16){
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i),_mm_xor_si128(v,m128));
+	}
+#endif
+	uint64_t m64 = ((uint64_t)m32 << 32) | m32;
+	for(; i + 8 <= len; i += 8){
+		uint64_t v;
+		memcpy(&v,src + i,8);
+		v ^= m64;
+		memcpy(dst + i,&v,8);
+	}
+	for(; i < len; ++i)
+		dst[i] = src[i] ^ m[i & 3];
+	phase = (phase + len) & 3;
+}
+
+//the body of a WPacket or RPacket as a frame's payload:shares the packet's
+//buffer and leaves out the length in front
+class FramePayload : public Packet{
+public:
+	FramePayload(ByteBuffer *buffer,size_t len):Packet(RAWBINARY,buffer),m_size(len){}
+
+	const char *Data(size_t pos){
+		return (const char*)m_buffer->ReadBin(sizeof(uint32_t) + pos);
+	}
+
+	Packet *Clone(){
+		return new FramePayload(m_buffer,m_size);
+	}
+
+	Packet *MakeWritePacket(){
+		return NULL;
+	}
+
+	Packet *MakeReadPacket(){
+		return NULL;
+	}
+
+	size_t PkLen(){
+		return m_size;
+	}
+
+	size_t PkTotal(){
+		return m_size;
+	}
+
+private:
+	size_t m_size;
+};
+
+//RFC 6455 server end.the upgrade request is parsed by a HttpDecoder and
+//answered here,then every binary message comes out as a RPacket,as if it
+//had been sent with a PacketDecoder,and a text message as a RawBinPacket.
+//sent WPackets and RPackets go out as binary messages,RawBinPackets as text.
+//pings are answered,a close is echoed and ends the connection
+class WebSocketDecoder : public Decoder{
+public:
+	enum{
+		CONTINUATION = 0,
+		TEXT         = 1,
+		BINARY       = 2,
+		CLOSE        = 8,
+		PING         = 9,
+		PONG         = 10,
+	};
+
+	WebSocketDecoder(size_t maxmessage):m_http(8192,8192),m_open(false),m_maxmessage(maxmessage),
+		m_inframe(false),m_left(0),m_opcode(0),m_fin(false),m_phase(0),m_message(NULL),m_type(0),
+		m_msize(0),m_csize(0){}
+
+	~WebSocketDecoder(){
+		while(!m_replies.empty()){
+			delete m_replies.front();
+			m_replies.pop_front();
+		}
+		if(m_message) m_message->DecRef();
+	}
+
+	//a message may span several unpack calls and frames,its payload is
+	//unmasked straight from the socket's buffer into the packet's
+	Packet *unpack(char *buf,size_t pos,size_t size,size_t max,size_t &pklen,int &err){
+		pklen = 0;
+		err   = 0;
+		if(!m_open)
+			return upgrade(buf,pos,size,max,pklen,err);
+		const unsigned char *p = (const unsigned char*)&buf[pos];
+		size_t used = 0;
+		if(!m_inframe){
+			if(size < 2) return NULL;
+			//no extensions are agreed on,a client must mask
+			if((p[0] & 0x70) || !(p[1] & 0x80))
+				return fail(1002,err);
+			uint64_t len  = p[1] & 0x7f;
+			size_t   hlen = len == 126 ? 4 : len == 127 ? 10 : 2;
+			if(size < hlen + 4) return NULL;
+			if(len == 126)
+				len = (p[2] << 8) | p[3];
+			else if(len == 127){
+				len = 0;
+				for(int i = 0; i < 8; ++i)
+					len = (len << 8) | p[2 + i];
+			}
+			int  opcode = p[0] & 0x0f;
+			bool fin    = (p[0] & 0x80) != 0;
+			if(opcode & 8){
+				if(!fin || len > 125 || opcode > PONG)
+					return fail(1002,err);
+			}else{
+				if(opcode > BINARY || (opcode == CONTINUATION) != (m_type != 0))
+					return fail(1002,err);
+				if(len > m_maxmessage - m_msize)
+					return fail(1009,err);
+				if(opcode != CONTINUATION){
+					m_type    = opcode;
+					m_msize   = 0;
+					m_message = ByteBuffer::New(sizeof(uint32_t) + len);
+				}
+				m_message->Reserve(sizeof(uint32_t) + m_msize + len);
+			}
+			memcpy(m_mask,p + hlen,4);
+			m_phase   = 0;
+			m_left    = (size_t)len;
+			m_opcode  = opcode;
+			m_fin     = fin;
+			m_inframe = true;
+			m_csize   = 0;
+			used      = hlen + 4;
+		}
+		size_t n = m_left < size - used ? m_left : size - used;
+		if(m_opcode & 8){
+			WebSocketUnmask((char*)m_control + m_csize,(const char*)p + used,n,m_mask,m_phase);
+			m_csize += n;
+		}else{
+			WebSocketUnmask(&m_message->Buf()[payloadOffset() + m_msize],(const char*)p + used,n,m_mask,m_phase);
+			m_msize += n;
+		}
+		m_left -= n;
+		pklen   = used + n;
+		if(m_left > 0) return NULL;
+		m_inframe = false;
+		if(m_opcode & 8)
+			return control(err);
+		return m_fin ? message() : NULL;
+	}
+
+	//the upgrade response,pongs and the close frame,in order
+	Packet *Reply(){
+		if(m_replies.empty()) return NULL;
+		Packet *reply = m_replies.front();
+		m_replies.pop_front();
+		return reply;
+	}
+
+	//after the upgrade every packet sent is a message.the payload is the
+	//packet's own buffer,only the frame header is new
+	bool Frame(Packet *wpk,Packet *&head,Packet *&body){
+		if(!m_open) return false;
+		int type = wpk->Type();
+		if(type == WPACKET || type == RPACKET){
+			size_t len = wpk->PkTotal() - sizeof(uint32_t);
+			body = new FramePayload(wpk->Buffer(),len);
+			head = header(BINARY,len);
+		}else{
+			body = wpk->Clone();
+			head = header(type == RAWBINARY ? TEXT : BINARY,body->PkTotal());
+		}
+		return true;
+	}
+
+private:
+	//text messages are not framed by a length,binary ones get it in front
+	size_t payloadOffset(){
+		return m_type == TEXT ? 0 : sizeof(uint32_t);
+	}
+
+	Packet *message(){
+		Packet *ret;
+		if(m_type == TEXT)
+			ret = new RawBinPacket(m_message,m_msize);
+		else{
+			m_message->WriteUint32(0,(unsigned int)m_msize);
+			ret = new RPacket(m_message);
+		}
+		m_message->DecRef();
+		m_message = NULL;
+		m_type    = 0;
+		m_msize   = 0;
+		return ret;
+	}
+
+	Packet *control(int &err){
+		if(m_opcode == PING)
+			m_replies.push_back(frame(PONG,m_control,m_csize));
+		else if(m_opcode == CLOSE){
+			//echo the status code,then the connection is closed
+			if(m_csize == 1)
+				return fail(1002,err);
+			m_replies.push_back(frame(CLOSE,m_control,m_csize < 2 ? m_csize : 2));
+			err = -1;
+		}
+		return NULL;
+	}
+
+	Packet *fail(unsigned short code,int &err){
+		unsigned char payload[2] = {(unsigned char)(code >> 8),(unsigned char)code};
+		m_replies.push_back(frame(CLOSE,payload,2));
+		err = -1;
+		return NULL;
+	}
+
+	Packet *upgrade(char *buf,size_t pos,size_t size,size_t max,size_t &pklen,int &err){
+		Packet *packet = m_http.unpack(buf,pos,size,max,pklen,err);
+		if(err){
+			badRequest();
+			return NULL;
+		}
+		if(!packet) return NULL;
+		HttpPacket *req = (HttpPacket*)packet;
+		const char *key,*value;
+		size_t klen,vlen;
+		if(req->GetMethod() != HTTP_GET ||
+		   !req->GetHeader("upgrade",7,value,vlen) || !contains(value,vlen,"websocket") ||
+		   !req->GetHeader("connection",10,value,vlen) || !contains(value,vlen,"upgrade") ||
+		   !req->GetHeader("sec-websocket-version",21,value,vlen) || vlen != 2 || memcmp(value,"13",2) != 0 ||
+		   !req->GetHeader("sec-websocket-key",17,key,klen) || klen == 0){
+			delete packet;
+			badRequest();
+			err = -1;
+			return NULL;
+		}
+		std::string accept(key,klen);
+		accept += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+		unsigned char digest[EVP_MAX_MD_SIZE];
+		unsigned int dlen = 0;
+		EVP_Digest(accept.data(),accept.size(),digest,&dlen,EVP_sha1(),NULL);
+		char encoded[64];
+		EVP_EncodeBlock((unsigned char*)encoded,digest,dlen);
+		delete packet;
+		std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+			"Upgrade: websocket\r\n"
+			"Connection: Upgrade\r\n"
+			"Sec-WebSocket-Accept: ";
+		response += encoded;
+		response += "\r\n\r\n";
+		m_replies.push_back(new RawBinPacket(response.data(),response.size()));
+		m_open = true;
+		return NULL;
+	}
+
+	void badRequest(){
+		static const char response[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+		m_replies.push_back(new RawBinPacket(response,sizeof(response) - 1));
+	}
+
+	//a header value holding the lowercase token,case insensitive
+	static bool contains(const char *value,size_t vlen,const char *token){
+		size_t tlen = strlen(token);
+		for(size_t i = 0; i + tlen <= vlen; ++i){
+			size_t j = 0;
+			while(j < tlen && (value[i + j] | 0x20) == token[j]) ++j;
+			if(j == tlen) return true;
+		}
+		return false;
+	}
+
+	//servers send their frames unmasked
+	static Packet *header(int opcode,size_t len){
+		unsigned char h[10];
+		size_t hlen = 2;
+		h[0] = 0x80 | opcode;
+		if(len < 126)
+			h[1] = (unsigned char)len;
+		else if(len <= 0xffff){
+			h[1] = 126;
+			h[2] = (unsigned char)(len >> 8);
+			h[3] = (unsigned char)len;
+			hlen = 4;
+		}else{
+			h[1] = 127;
+			for(int i = 0; i < 8; ++i)
+				h[2 + i] = (unsigned char)((uint64_t)len >> (56 - 8*i));
+			hlen = 10;
+		}
+		return new RawBinPacket((const char*)h,hlen);
+	}
+
+	//a control frame,its payload is at most 125 bytes
+	static Packet *frame(int opcode,const unsigned char *payload,size_t len){
+		unsigned char f[2 + 125];
+		f[0] = 0x80 | opcode;
+		f[1] = (unsigned char)len;
+		memcpy(f + 2,payload,len);
+		return new RawBinPacket((const char*)f,2 + len);
+	}
+
+	HttpDecoder         m_http;//the upgrade request
+	bool                m_open;
+	size_t              m_maxmessage;
+	std::list<Packet*>  m_replies;
+	//the frame being read
+	bool                m_inframe;
+	size_t              m_left;//payload not received yet
+	int                 m_opcode;
+	bool                m_fin;
+	unsigned char       m_mask[4];
+	size_t              m_phase;
+	//the message being put together
+	ByteBuffer         *m_message;
+	int                 m_type;//TEXT or BINARY,0 between messages
+	size_t              m_msize;
+	unsigned char       m_control[125];
+	size_t              m_csize;
+};
+
+//every socket has a decoder of its own
+class WebSocketDecoderFactory : public DecoderFactory{
+public:
+	WebSocketDecoderFactory(size_t maxmessage):maxmessage(maxmessage){}
+
+	Decoder *Get(){
+		return new WebSocketDecoder(maxmessage);
+	}
+
+	void Put(Decoder *d){
+		delete d;
+	}
+
+private:
+	size_t maxmessage;
+};
+
+}
+
+#endif
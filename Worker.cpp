@@ -0,0 +1,89 @@
+#include "Worker.h"
+#include <map>
+
+extern bool Reg2Lua(lua_State *L);
+
+namespace net{
+
+static std::vector<Worker*>          g_workers;
+static Mutex                         g_listeners_mtx;
+static std::map<std::string,SOCKET>  g_listeners;
+static __thread Worker              *t_worker = NULL;
+
+bool Worker::StartWorkers(int n,const char *script){
+	if(n <= 0 || !script || !g_workers.empty()) return false;
+	for(int i = 1; i <= n; ++i)
+		g_workers.push_back(new Worker(i,script));
+	for(size_t i = 0; i < g_workers.size(); ++i){
+		if(!g_workers[i]->Start())
+			printf("start worker %d failed\n",g_workers[i]->id);
+	}
+	for(size_t i = 0; i < g_workers.size(); ++i)
+		g_workers[i]->Join();
+	return true;
+}
+
+Worker *Worker::Current(){
+	return t_worker;
+}
+
+Worker *Worker::Get(int id){
+	if(id <= 0 || id > (int)g_workers.size()) return NULL;
+	return g_workers[id-1];
+}
+
+int Worker::Count(){
+	return (int)g_workers.size();
+}
+
+SOCKET Worker::SharedListener(const char *ip,int port,int backlog){
+	if(!ip) return INVAILD_FD;
+	char key[64];
+	snprintf(key,sizeof(key),"%s:%d",ip,port);
+	Guard guard(g_listeners_mtx);
+	std::map<std::string,SOCKET>::iterator it = g_listeners.find(key);
+	SOCKET fd;
+	if(it == g_listeners.end()){
+		fd = ::socket(AF_INET,SOCK_STREAM,IPPROTO_TCP);
+		if(fd == INVAILD_FD) return INVAILD_FD;
+		if(!Socket::BindListen(fd,ip,port,backlog)){
+#ifdef _WIN
+			::closesocket(fd);
+#else
+			::close(fd);
+#endif
+			return INVAILD_FD;
+		}
+		g_listeners[key] = fd;
+	}else
+		fd = it->second;
+#ifdef _WIN
+	//a SOCKET can be used from every thread of the process
+	return fd;
+#else
+	return ::dup(fd);
+#endif
+}
+
+void Worker::Run(){
+	t_worker = this;
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	if(!Reg2Lua(L)){
+		printf("worker %d init failed\n",id);
+		lua_close(L);
+		return;
+	}
+	lua_getglobal(L,"C");
+	lua_pushinteger(L,id);
+	lua_setfield(L,-2,"WorkerId");
+	lua_pop(L,1);
+	if (luaL_dofile(L,script.c_str())) {
+		const char * error = lua_tostring(L, -1);
+		printf("worker %d:%s\n",id,error);
+		lua_pop(L,1);
+	}
+	lua_close(L);
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef _WORKER_H
+#define _WORKER_H
+
+#include <string>
+#include <vector>
+#include "Thread.h"
+#include "Socket.h"
+#include "Reactor.h"
+
+namespace net{
+
+//a worker is a thread with its own lua_State and Reactor running a script.
+//StartWorkers runs n workers with the same script and waits for all of them
+class Worker : public Thread{
+public:
+	static bool StartWorkers(int n,const char *script);
+
+	//the worker of the calling thread,NULL outside of a worker
+	static Worker *Current();
+
+	static Worker *Get(int id);
+
+	static int Count();
+
+	//workers listening on the same address share one listening socket:the first
+	//one binds it,every caller gets its own dup so each reactor accepts from the
+	//same kernel queue and a connection goes to whichever worker takes it first
+	//when SO_REUSEPORT is available each worker binds its own socket instead
+	static SOCKET SharedListener(const char *ip,int port,int backlog);
+
+	int Id() const{return id;}
+
+	//created before any worker starts,so other workers can Post to it at once
+	Reactor *GetReactor() {return reactor;}
+
+protected:
+	void Run();
+
+private:
+	Worker(int id,const char *script):id(id),script(script),reactor(new Reactor){}
+	int         id;
+	std::string script;
+	Reactor    *reactor;
+};
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+//connect/close load generator for bench/accept_server.lua
+//usage:accept_client ip port threads seconds
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "SysTime.h"
+
+pthread_key_t g_systime_key;
+pthread_once_t g_systime_key_once = PTHREAD_ONCE_INIT;
+
+static struct sockaddr_in g_addr;
+static volatile int       g_stop = 0;
+static volatile long      g_connected = 0;
+static volatile long      g_failed = 0;
+
+static void *routine(void*){
+	struct linger l;
+	l.l_onoff  = 1;
+	l.l_linger = 0;
+	while(!g_stop){
+		int fd = ::socket(AF_INET,SOCK_STREAM,IPPROTO_TCP);
+		if(fd < 0) continue;
+		//reset on close,the client would run out of ports in TIME_WAIT otherwise
+		setsockopt(fd,SOL_SOCKET,SO_LINGER,&l,sizeof(l));
+		if(::connect(fd,(const sockaddr*)&g_addr,sizeof(g_addr)) == 0)
+			__sync_add_and_fetch(&g_connected,1);
+		else
+			__sync_add_and_fetch(&g_failed,1);
+		::close(fd);
+	}
+	return NULL;
+}
+
+int main(int argc,char **argv){
+	if(argc < 5){
+		printf("usage accept_client ip port threads seconds\n");
+		return 0;
+	}
+	memset(&g_addr,0,sizeof(g_addr));
+	g_addr.sin_family      = AF_INET;
+	g_addr.sin_addr.s_addr = inet_addr(argv[1]);
+	g_addr.sin_port        = htons(atoi(argv[2]));
+	int threads = atoi(argv[3]);
+	int seconds = atoi(argv[4]);
+	pthread_t *tids = new pthread_t[threads];
+	for(int i = 0; i < threads; ++i)
+		pthread_create(&tids[i],NULL,routine,NULL);
+	uint64_t start = GetSystemMs64();
+	long last = 0;
+	for(int i = 0; i < seconds; ++i){
+		sleepms(1000);
+		long now = g_connected;
+		printf("%ld conn/s\n",now - last);
+		last = now;
+	}
+	g_stop = 1;
+	for(int i = 0; i < threads; ++i)
+		pthread_join(tids[i],NULL);
+	double elapsed = (GetSystemMs64() - start)/1000.0;
+	printf("total %ld connected %ld failed,%.0f conn/s\n",(long)g_connected,(long)g_failed,g_connected/elapsed);
+	delete[] tids;
+	return 0;
+}
@@ -0,0 +1,6 @@
+--accept rate benchmark,server side.run with WORKERS=1,2,4,8:
+--  WORKERS=4 ./LuaNet bench/accept_server.lua
+--and drive it with bench/accept_client(see bench/run_accept.sh).RUN_MS is the
+--C.Run timeout of the workers,10 by default
+local n = tonumber(os.getenv("WORKERS")) or 1
+C.StartWorkers(n,"bench/accept_worker.lua")
@@ -0,0 +1,25 @@
+local accepted = 0
+local last     = C.GetSysTick()
+local backlog  = tonumber(os.getenv("BACKLOG")) or 4096
+--the select timeout only matters while the listener is idle,RUN_MS=0 polls
+local run_ms   = tonumber(os.getenv("RUN_MS")) or 10
+
+local listener = C.Listen("127.0.0.1",8011,function (s)
+	accepted = accepted + 1
+	s:Close()
+end,backlog)
+
+if not listener then
+	print(string.format("worker %d:listen failed",C.WorkerId))
+	return
+end
+
+while true do
+	C.Run(run_ms)
+	local now = C.GetSysTick()
+	if now - last >= 1000 then
+		print(string.format("worker %d accepted %.0f/s",C.WorkerId,accepted*1000/(now-last)))
+		accepted = 0
+		last = now
+	end
+end
@@ -0,0 +1,93 @@
+--echo round trip latency of other connections while the server gzips a json
+--body every 200 ms.worker 1 is the server,worker 2 the client.both modes run
+--the same native task:ASYNC_MODE=inline on the server reactor with C.Task,
+--ASYNC_MODE=async on the pool with C.Async.JOB_KB sizes the body
+--usage:ASYNC_MODE=async ./LuaNet bench/async_latency.lua
+if not C.WorkerId then
+	C.StartWorkers(2,"bench/async_latency.lua")
+	return
+end
+
+local mode     = os.getenv("ASYNC_MODE") or "async"
+local seconds  = tonumber(os.getenv("SECONDS")) or 5
+local conns    = 8
+local job_kb   = tonumber(os.getenv("JOB_KB")) or 2048
+
+--records that differ enough to keep deflate busy
+local function body()
+	local records = {}
+	local size = 0
+	local i = 0
+	while size < job_kb*1024 do
+		i = i + 1
+		local r = string.format('{"id":%d,"name":"user%d","score":%d,"token":"%x%x"},',
+			i,i*7919 % 100003,i*31 % 977,i*2654435761 % 4294967296,i*40503 % 65536)
+		records[#records+1] = r
+		size = size + #r
+	end
+	return "[" .. table.concat(records) .. "]"
+end
+
+local function server()
+	local listener = C.Listen("127.0.0.1",8012)
+	listener:DefaultBind(C.PacketDecoder(),function (s,rpk)
+		s:Send(C.NewWPacket(rpk))
+	end)
+	local json = body()
+	local t = C.GetSysTick()
+	local gz = C.Task("gzip",json)
+	print(string.format("job:gzip %dKB -> %dKB in %dms",#json//1024,#gz//1024,C.GetSysTick() - t))
+	local last = C.GetSysTick()
+	while true do
+		C.Run(1)
+		local now = C.GetSysTick()
+		if now - last >= 200 then
+			last = now
+			if mode == "inline" then
+				C.Task("gzip",json)
+			else
+				C.Async("gzip",json,function () end)
+			end
+		end
+	end
+end
+
+--open loop:every connection sends a ping every interval ms whether or not the
+--last one came back,so a stalled server shows up in every ping it delays
+local function client()
+	local interval = 5
+	local samples  = {}
+	local sockets  = {}
+	for i = 1,conns do
+		C.Connect("127.0.0.1",8012,function (s,success)
+			if not success then return end
+			s:Bind(C.PacketDecoder(),function (s,rpk)
+				samples[#samples+1] = C.GetSysTick() - rpk:ReadNum()
+			end)
+			sockets[s] = C.GetSysTick()
+		end)
+	end
+	local start = C.GetSysTick()
+	while C.GetSysTick() - start < seconds*1000 do
+		C.Run(1)
+		local now = C.GetSysTick()
+		for s,nextsend in pairs(sockets) do
+			while nextsend <= now do
+				local wpk = C.NewWPacket()
+				wpk:WriteNum(nextsend)
+				s:Send(wpk)
+				nextsend = nextsend + interval
+			end
+			sockets[s] = nextsend
+		end
+	end
+	table.sort(samples)
+	local function pct(p)
+		return samples[math.max(1,math.ceil(#samples*p))]
+	end
+	print(string.format("mode:%s pings:%d p50:%dms p99:%dms p99.9:%dms max:%dms",
+		mode,#samples,pct(0.5),pct(0.99),pct(0.999),samples[#samples]))
+	os.exit(0)
+end
+
+if C.WorkerId == 1 then server() else client() end
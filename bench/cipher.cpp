@@ -0,0 +1,74 @@
+//ChaCha20Poly1305 as StreamCipher uses it:checks the RFC 8439 2.8.2 AEAD
+//vector,then seals and opens records of the given size in place
+//usage:cipher [record size] [MB]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "SysTime.h"
+#include "ChaCha20Poly1305.h"
+
+pthread_key_t g_systime_key;
+pthread_once_t g_systime_key_once = PTHREAD_ONCE_INIT;
+
+static const unsigned char rfc_ciphertext[] = {
+	0xd3,0x1a,0x8d,0x34,0x64,0x8e,0x60,0xdb,0x7b,0x86,0xaf,0xbc,0x53,0xef,0x7e,0xc2,
+	0xa4,0xad,0xed,0x51,0x29,0x6e,0x08,0xfe,0xa9,0xe2,0xb5,0xa7,0x36,0xee,0x62,0xd6,
+	0x3d,0xbe,0xa4,0x5e,0x8c,0xa9,0x67,0x12,0x82,0xfa,0xfb,0x69,0xda,0x92,0x72,0x8b,
+	0x1a,0x71,0xde,0x0a,0x9e,0x06,0x0b,0x29,0x05,0xd6,0xa5,0xb6,0x7e,0xcd,0x3b,0x36,
+	0x92,0xdd,0xbd,0x7f,0x2d,0x77,0x8b,0x8c,0x98,0x03,0xae,0xe3,0x28,0x09,0x1b,0x58,
+	0xfa,0xb3,0x24,0xe4,0xfa,0xd6,0x75,0x94,0x55,0x85,0x80,0x8b,0x48,0x31,0xd7,0xbc,
+	0x3f,0xf4,0xde,0xf0,0x8e,0x4b,0x7a,0x9d,0xe5,0x76,0xd2,0x65,0x86,0xce,0xc6,0x4b,
+	0x61,0x16
+};
+
+static const unsigned char rfc_tag[] = {
+	0x1a,0xe1,0x0b,0x59,0x4f,0x09,0xe2,0x6a,0x7e,0x90,0x2e,0xcb,0xd0,0x60,0x06,0x91
+};
+
+static bool check(){
+	const char *text = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip "
+		"for the future, sunscreen would be it.";
+	unsigned char key[32],nonce[12] = {0x07,0,0,0,0x40,0x41,0x42,0x43,0x44,0x45,0x46,0x47};
+	unsigned char aad[12] = {0x50,0x51,0x52,0x53,0xc0,0xc1,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7};
+	for(int i = 0; i < 32; ++i) key[i] = 0x80 + i;
+	size_t len = strlen(text);
+	std::vector<unsigned char> data(text,text + len);
+	unsigned char tag[16];
+	net::ChaCha20Poly1305 aead(key);
+	aead.Seal(nonce,aad,sizeof(aad),&data[0],len,tag);
+	if(len != sizeof(rfc_ciphertext) || memcmp(&data[0],rfc_ciphertext,len) != 0 || memcmp(tag,rfc_tag,16) != 0)
+		return false;
+	if(!aead.Open(nonce,aad,sizeof(aad),&data[0],len,tag) || memcmp(&data[0],text,len) != 0)
+		return false;
+	tag[0] ^= 1;
+	return !aead.Open(nonce,aad,sizeof(aad),&data[0],len,tag);
+}
+
+int main(int argc,char **argv){
+	size_t record = argc > 1 ? atoi(argv[1]) : 16384;
+	size_t mb     = argc > 2 ? atoi(argv[2]) : 512;
+	if(!check()){
+		printf("RFC 8439 vector failed\n");
+		return 1;
+	}
+	printf("RFC 8439 vector ok\n");
+	unsigned char key[32],nonce[12] = {0},tag[16],aad[4] = {0};
+	for(int i = 0; i < 32; ++i) key[i] = (unsigned char)rand();
+	std::vector<unsigned char> data(record,'x');
+	net::ChaCha20Poly1305 aead(key);
+	size_t count = mb*1024*1024/record;
+	uint64_t start = GetSystemMs64();
+	for(size_t i = 0; i < count; ++i){
+		memcpy(nonce + 4,&i,sizeof(i) < 8 ? sizeof(i) : 8);
+		aead.Seal(nonce,aad,4,&data[0],record,tag);
+		if(!aead.Open(nonce,aad,4,&data[0],record,tag)){
+			printf("open failed\n");
+			return 1;
+		}
+	}
+	uint64_t elapsed = GetSystemMs64() - start;
+	printf("%u byte records:%.0f MB/s sealed and opened\n",(unsigned int)record,
+		mb*1000.0/(elapsed ? elapsed : 1));
+	return 0;
+}
@@ -0,0 +1,59 @@
+--requests per second of lua/http.lua httpclient against a local keep-alive
+--stand-in server.worker 1 is the server,worker 2 runs CONCURRENCY request loops.
+--POOL=0 closes every connection after its response like the client used to
+--usage:POOL=1 ./LuaNet bench/http_client.lua
+if not C.WorkerId then
+	C.StartWorkers(2,"bench/http_client.lua")
+	return
+end
+
+local seconds     = tonumber(os.getenv("SECONDS")) or 5
+local concurrency = tonumber(os.getenv("CONCURRENCY")) or 16
+local pool        = os.getenv("POOL") ~= "0"
+
+local function server()
+	local response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\nok"
+	local listener = C.Listen("127.0.0.1",8014,nil,1024)
+	listener:DefaultBind(C.HttpDecoder(65535),function (s,req)
+		s:Send(C.NewRawPacket(response))
+		if not req:KeepAlive() then
+			s:Close()
+		end
+	end)
+	while true do
+		C.Run(10)
+	end
+end
+
+local function client()
+	local Http = require("lua.http")
+	if not pool then
+		Http.SetConnPool(0,concurrency)
+	end
+	local client  = Http.HttpClient("127.0.0.1",8014)
+	local done    = 0
+	local failed  = 0
+	local running = true
+	local function loop()
+		if not running then return end
+		local req = Http.HttpRequest("/")
+		req:End()
+		client:Get(req,function (rpk)
+			if rpk then done = done + 1 else failed = failed + 1 end
+			loop()
+		end)
+	end
+	for i = 1,concurrency do
+		loop()
+	end
+	local start = C.GetSysTick()
+	while C.GetSysTick() - start < seconds*1000 do
+		C.Run(10)
+	end
+	running = false
+	print(string.format("pool:%s concurrency:%d requests:%d failed:%d %.0f req/s",
+		tostring(pool),concurrency,done,failed,done*1000/(C.GetSysTick() - start)))
+	os.exit(0)
+end
+
+if C.WorkerId == 1 then server() else client() end
@@ -0,0 +1,153 @@
+//wrk style keep-alive http load generator for example/httpserver.lua
+//every connection keeps depth requests in flight(depth > 1 pipelines them)
+//usage:http_load ip port threads connections seconds [depth]
+#include <pthread.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include "SysTime.h"
+
+pthread_key_t g_systime_key;
+pthread_once_t g_systime_key_once = PTHREAD_ONCE_INIT;
+
+static struct sockaddr_in g_addr;
+static volatile int       g_stop = 0;
+static volatile long      g_responses = 0;
+static volatile long      g_errors = 0;
+static int                g_conns = 1;
+static int                g_depth = 1;
+static std::string        g_request;
+
+struct conn{
+	int         fd;
+	int         inflight;
+	std::string in;
+};
+
+static int dial(){
+	int fd = ::socket(AF_INET,SOCK_STREAM,IPPROTO_TCP);
+	if(fd < 0) return -1;
+	int on = 1;
+	setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&on,sizeof(on));
+	if(::connect(fd,(const sockaddr*)&g_addr,sizeof(g_addr)) != 0){
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool send_batch(conn &c){
+	std::string batch;
+	for(int i = 0; i < g_depth; ++i)
+		batch += g_request;
+	size_t off = 0;
+	while(off < batch.size()){
+		ssize_t n = ::send(c.fd,batch.data() + off,batch.size() - off,0);
+		if(n <= 0) return false;
+		off += n;
+	}
+	c.inflight = g_depth;
+	return true;
+}
+
+//consume every complete response in c.in
+static int parse(conn &c){
+	int done = 0;
+	for(;;){
+		size_t end = c.in.find("\r\n\r\n");
+		if(end == std::string::npos) break;
+		size_t body = 0;
+		size_t pos  = 0;
+		while(pos < end){
+			size_t eol = c.in.find("\r\n",pos);
+			if(eol - pos > 15 && strncasecmp(c.in.data() + pos,"Content-Length:",15) == 0)
+				body = strtoul(c.in.c_str() + pos + 15,NULL,10);
+			pos = eol + 2;
+		}
+		if(c.in.size() < end + 4 + body) break;
+		c.in.erase(0,end + 4 + body);
+		++done;
+	}
+	return done;
+}
+
+static void *routine(void*){
+	std::vector<conn> conns(g_conns);
+	std::vector<struct pollfd> fds(g_conns);
+	for(int i = 0; i < g_conns; ++i){
+		conns[i].fd = dial();
+		if(conns[i].fd < 0 || !send_batch(conns[i])){
+			__sync_add_and_fetch(&g_errors,1);
+			return NULL;
+		}
+		fds[i].fd     = conns[i].fd;
+		fds[i].events = POLLIN;
+	}
+	char buf[65536];
+	while(!g_stop){
+		if(::poll(&fds[0],fds.size(),100) <= 0) continue;
+		for(int i = 0; i < g_conns; ++i){
+			if(!fds[i].revents) continue;
+			conn &c = conns[i];
+			ssize_t n = ::recv(c.fd,buf,sizeof(buf),0);
+			if(n <= 0){
+				__sync_add_and_fetch(&g_errors,1);
+				::close(c.fd);
+				c.fd = fds[i].fd = dial();
+				c.in.clear();
+				if(c.fd < 0 || !send_batch(c)) return NULL;
+				continue;
+			}
+			c.in.append(buf,n);
+			int done = parse(c);
+			if(done){
+				__sync_add_and_fetch(&g_responses,done);
+				c.inflight -= done;
+				if(c.inflight <= 0 && !send_batch(c))
+					__sync_add_and_fetch(&g_errors,1);
+			}
+		}
+	}
+	for(int i = 0; i < g_conns; ++i)
+		if(conns[i].fd >= 0) ::close(conns[i].fd);
+	return NULL;
+}
+
+int main(int argc,char **argv){
+	if(argc < 6){
+		printf("usage http_load ip port threads connections seconds [depth]\n");
+		return 0;
+	}
+	memset(&g_addr,0,sizeof(g_addr));
+	g_addr.sin_family      = AF_INET;
+	g_addr.sin_addr.s_addr = inet_addr(argv[1]);
+	g_addr.sin_port        = htons(atoi(argv[2]));
+	int threads = atoi(argv[3]);
+	int total   = atoi(argv[4]);
+	int seconds = atoi(argv[5]);
+	g_depth     = argc > 6 ? atoi(argv[6]) : 1;
+	g_conns     = total/threads > 0 ? total/threads : 1;
+	g_request   = std::string("GET / HTTP/1.1\r\nHost: ") + argv[1] + "\r\n\r\n";
+	pthread_t *tids = new pthread_t[threads];
+	for(int i = 0; i < threads; ++i)
+		pthread_create(&tids[i],NULL,routine,NULL);
+	uint64_t start = GetSystemMs64();
+	sleepms(seconds*1000);
+	g_stop = 1;
+	for(int i = 0; i < threads; ++i)
+		pthread_join(tids[i],NULL);
+	double elapsed = (GetSystemMs64() - start)/1000.0;
+	printf("%d threads %d connections depth %d:%ld requests in %.1fs,%ld errors\n",
+		threads,g_conns*threads,g_depth,g_responses,elapsed,g_errors);
+	printf("Requests/sec:%.0f\n",g_responses/elapsed);
+	return 0;
+}
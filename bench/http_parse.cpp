@@ -0,0 +1,78 @@
+//cost of decoding http requests into HttpPackets and reading two headers:time
+//and heap allocations per request,fed through HttpDecoder like Socket::unpack does
+//usage:http_parse [count]
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <string>
+#include "SysTime.h"
+#include "HttpDecoder.h"
+
+pthread_key_t g_systime_key;
+pthread_once_t g_systime_key_once = PTHREAD_ONCE_INIT;
+
+static long g_allocs = 0;
+
+void *operator new(size_t size){
+	++g_allocs;
+	void *p = malloc(size ? size : 1);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) throw(){
+	free(p);
+}
+
+static const char request[] =
+	"GET /api/v1/items?id=12345&sort=desc HTTP/1.1\r\n"
+	"Host: www.example.com\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:91.0) Gecko/20100101 Firefox/91.0\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+	"Accept-Language: en-US,en;q=0.5\r\n"
+	"Accept-Encoding: gzip, deflate\r\n"
+	"Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n"
+	"Connection: keep-alive\r\n"
+	"Cache-Control: max-age=0\r\n"
+	"\r\n";
+
+int main(int argc,char **argv){
+	int count = argc > 1 ? atoi(argv[1]) : 1000000;
+	const int batch = 16;//pipelined requests per read
+	std::string input;
+	for(int i = 0; i < batch; ++i)
+		input += request;
+	std::vector<char> buf(input.begin(),input.end());
+	net::HttpDecoder decoder(65535,65535);
+	long allocs = g_allocs;
+	uint64_t start = GetSystemMs64();
+	int done = 0;
+	while(done < count){
+		size_t pos = 0;
+		while(pos < buf.size()){
+			size_t pklen;
+			int err;
+			net::Packet *packet = decoder.unpack(&buf[0],pos,buf.size() - pos,0,pklen,err);
+			if(err){
+				printf("parse error\n");
+				return 1;
+			}
+			pos += pklen;
+			if(packet){
+				//what a typical handler reads
+				net::HttpPacket *req = (net::HttpPacket*)packet;
+				const char *value;
+				size_t len;
+				req->GetHeader("Host",4,value,len);
+				req->GetHeader("Cookie",6,value,len);
+				delete packet;
+				++done;
+			}
+		}
+	}
+	uint64_t elapsed = GetSystemMs64() - start;
+	printf("%d requests in %llums,%.0f requests/s,%.2f allocations per request\n",
+		done,(unsigned long long)elapsed,done*1000.0/(elapsed ? elapsed : 1),
+		(double)(g_allocs - allocs)/done);
+	return 0;
+}
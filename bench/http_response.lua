@@ -0,0 +1,47 @@
+--cost of building one response:the old lua string concatenation against the
+--native C.HttpResponse writer,same status line,4 headers and a 64 byte body
+--usage:./LuaNet bench/http_response.lua
+local count   = 500000
+local headers = {"Content-Type: text/plain","Cache-Control: no-cache","Server: luanet","X-Request-Id: 42"}
+local body    = string.rep("x",64)
+
+local function concat()
+	local str = string.format("HTTP/1.1 %d %s\r\n",200,"OK")
+	for k,v in pairs(headers) do
+		str = str .. string.format("%s\r\n",v)
+	end
+	str = str .. "Connection: keep-alive\r\n"
+	return C.NewRawPacket(str .. string.format("Content-Length: %d\r\n\r\n%s",#body,body))
+end
+
+local function native()
+	local res = C.HttpResponse(200,"OK")
+	for k,v in pairs(headers) do
+		res:Header(v)
+	end
+	return res:Build(body,true)
+end
+
+local function run(name,build)
+	collectgarbage("collect")
+	collectgarbage("stop")
+	local garbage = 0
+	local last    = collectgarbage("count")
+	local start   = os.clock()
+	for i = 1,count do
+		build():Release()
+		if i % 10000 == 0 then
+			garbage = garbage + collectgarbage("count") - last
+			collectgarbage("collect")
+			last = collectgarbage("count")
+		end
+	end
+	local elapsed = os.clock() - start
+	garbage = garbage + collectgarbage("count") - last
+	collectgarbage("restart")
+	print(string.format("%-7s %8.0f responses/s %6.0f bytes of lua garbage each",
+		name,count/elapsed,garbage*1024/count))
+end
+
+run("concat",concat)
+run("native",native)
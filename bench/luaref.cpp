@@ -0,0 +1,78 @@
+//nanoseconds per luaRef operation:a shared ref taken from the stack and dropped
+//while another ref holds the value(one per bound client),the same for a value
+//held by nothing else,an unshared ref(a send callback),a copy and its
+//destruction,and a move.build it against an older LuaUtil.h with -I and
+//-DNO_SHARED to compare,a class without a move constructor copies
+//usage:luaref [iterations]
+#include <stdio.h>
+#include <stdlib.h>
+#include <utility>
+#include "LuaUtil.h"
+#include "SysTime.h"
+
+#ifdef NO_SHARED
+#define SHARED
+#else
+#define SHARED ,true
+#endif
+
+pthread_key_t g_systime_key;
+pthread_once_t g_systime_key_once = PTHREAD_ONCE_INIT;
+
+static int handler(lua_State*){
+	return 0;
+}
+
+static unsigned long long nsPer(uint64_t start,int n){
+	return (unsigned long long)(GetSystemMs64() - start)*1000000/(n > 0 ? n : 1);
+}
+
+int main(int argc,char **argv){
+	int n = argc > 1 ? atoi(argv[1]) : 2000000;
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	//a closure is a collectable function like a lua handler
+	lua_pushnil(L);
+	lua_pushcclosure(L,handler,1);
+	int fn = lua_gettop(L);
+	//the handler stays referenced,as by a listener
+	luaRef listener(L,fn SHARED);
+
+	uint64_t start = GetSystemMs64();
+	for(int i = 0; i < n; ++i){
+		luaRef r(L,fn SHARED);
+	}
+	printf("shared      %4llu ns\n",nsPer(start,n));
+
+	lua_pushnil(L);
+	lua_pushcclosure(L,handler,1);
+	int lone = lua_gettop(L);
+	start = GetSystemMs64();
+	for(int i = 0; i < n; ++i){
+		luaRef r(L,lone SHARED);
+	}
+	printf("shared,lone %4llu ns\n",nsPer(start,n));
+
+	start = GetSystemMs64();
+	for(int i = 0; i < n; ++i){
+		luaRef r(L,lone);
+	}
+	printf("unshared    %4llu ns\n",nsPer(start,n));
+
+	start = GetSystemMs64();
+	for(int i = 0; i < n; ++i){
+		luaRef r(listener);
+	}
+	printf("copy+drop   %4llu ns\n",nsPer(start,n));
+
+	start = GetSystemMs64();
+	for(int i = 0; i < n; ++i){
+		luaRef a(listener);
+		luaRef b(std::move(a));
+	}
+	printf("copy+move   %4llu ns\n",nsPer(start,n));
+
+	listener = luaRef(NULL,0);
+	lua_close(L);
+	return 0;
+}
@@ -0,0 +1,71 @@
+--bytes on the wire and cpu cost of per-connection compression for game packets:
+--an echo of count packets,each a table with repeated keys and small deltas,
+--with and without s:Compress(dict) negotiated after a handshake in the clear
+--usage:./LuaNet bench/packet_compress.lua
+local count = 20000
+local dict  = "playerid posx posy posz dir speed hp mp state buffs target skill timestamp"
+
+local function packet(i)
+	local wpk = C.NewWPacket(512)
+	wpk:WriteStr("move")
+	wpk:WriteTable({playerid = 1000 + i % 16,posx = 5000 + i % 97,posy = 300,posz = 7000 - i % 89,
+		dir = i % 8,speed = 12,hp = 900 - i % 50,mp = 400,state = "running",
+		buffs = {1,2,3},target = 0,skill = 0,timestamp = 1700000000 + i})
+	return wpk
+end
+
+local function run(compress,done)
+	local port = compress and 8051 or 8050
+	local server = C.Listen("127.0.0.1",port,function (s) end)
+	server:DefaultBind(C.PacketDecoder(),function (s,rpk)
+		local cmd = rpk:ReadStr()
+		if cmd == "compress" then
+			s:Send(C.NewWPacket(rpk))--"compress" back in the clear,then switch
+			s:Compress(dict)
+		else
+			s:Send(C.NewWPacket(rpk))
+		end
+	end)
+	local start  = os.clock()
+	local echoed = 0
+	C.Connect("127.0.0.1",port,function (s,success)
+		local function flood()
+			for i = 1,count do s:Send(packet(i)) end
+		end
+		s:Bind(C.PacketDecoder(),function (s,rpk)
+			if rpk:ReadStr() == "compress" then
+				s:Compress(dict)
+				flood()
+				return
+			end
+			echoed = echoed + 1
+			assert(rpk:ReadTable().timestamp == 1700000000 + echoed)
+			if echoed == count then
+				local st = s:CompressStats()
+				if st then
+					print(string.format("zlib   %8d bytes sent %8d on the wire(%.1f%%) %.2fs cpu,%dus in zlib",
+						st.out_plain,st.out_wire,st.out_wire*100/st.out_plain,os.clock() - start,st.usec))
+				else
+					print(string.format("plain  %8.2fs cpu",os.clock() - start))
+				end
+				s:Close()
+				done()
+			end
+		end,function () end)
+		if compress then
+			local wpk = C.NewWPacket(64)
+			wpk:WriteStr("compress")
+			s:Send(wpk)
+		else
+			flood()
+		end
+	end)
+end
+
+local finished = false
+run(false,function ()
+	run(true,function () finished = true end)
+end)
+while not finished do
+	C.Run(50)
+end
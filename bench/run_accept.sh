@@ -0,0 +1,25 @@
+#!/bin/sh
+#accepted connections per second with 1,2,4,8 worker reactors
+#usage:sh bench/run_accept.sh [client_threads] [seconds]
+#RUN_MS sets the worker's C.Run timeout.clients don't wait for the accept,so
+#once the accept queue is full their SYNs are dropped and each drop stalls a
+#client thread for a 1s retransmit:a run with listen overflows measures those
+#stalls,not the reactors.with fewer cores than client threads plus reactors it
+#measures the scheduler's share of the cpu as well
+THREADS=${1:-16}
+SECONDS_=${2:-10}
+overflows(){
+	awk '/^TcpExt:/{if(!n){for(i=1;i<=NF;i++)if($i=="ListenOverflows")c=i;n=1}else print $c}' /proc/net/netstat 2>/dev/null
+}
+for n in 1 2 4 8; do
+	WORKERS=$n ./LuaNet bench/accept_server.lua > /dev/null &
+	pid=$!
+	sleep 1
+	echo "reactors:$n"
+	before=$(overflows)
+	./accept_client 127.0.0.1 8011 $THREADS $SECONDS_ | tail -n 1
+	after=$(overflows)
+	[ -n "$before" ] && echo "listen overflows:$((after - before))"
+	kill $pid
+	wait $pid 2>/dev/null
+done
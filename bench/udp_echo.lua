@@ -0,0 +1,20 @@
+--datagram rate benchmark,server side:every datagram is echoed to its sender.
+--  ./LuaNet bench/udp_echo.lua
+--and drive it with bench/udp_load:
+--  ./udp_load 127.0.0.1 8012 4 10
+local count = 0
+local last  = C.GetSysTick()
+local echo = C.Udp("127.0.0.1",8012,function (s,rpk,ip,port)
+	s:SendTo(rpk,ip,port)
+	count = count + 1
+end)
+
+while true do
+	C.Run(100)
+	local now = C.GetSysTick()
+	if now - last >= 1000 then
+		print(string.format("%d datagrams/s",math.floor(count*1000/(now - last))))
+		count = 0
+		last  = now
+	end
+end
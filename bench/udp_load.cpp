@@ -0,0 +1,104 @@
+//datagram load generator for bench/udp_echo.lua:every thread keeps a window
+//of datagrams in flight on its own socket,sending and receiving them in
+//batches of 64 with sendmmsg/recvmmsg
+//usage:udp_load ip port threads seconds [size] [window]
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "SysTime.h"
+
+pthread_key_t g_systime_key;
+pthread_once_t g_systime_key_once = PTHREAD_ONCE_INIT;
+
+static const int          batch = 64;
+static struct sockaddr_in g_addr;
+static volatile int       g_stop = 0;
+static volatile long      g_sent = 0;
+static volatile long      g_recv = 0;
+static int                g_size = 64;
+static int                g_window = 256;
+
+static void *routine(void*){
+	int fd = ::socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
+	if(fd < 0 || ::connect(fd,(const sockaddr*)&g_addr,sizeof(g_addr)) < 0)
+		return NULL;
+	struct timeval tv = {0,10000};
+	setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+	char *out = new char[g_size];
+	char *in  = new char[batch*2048];
+	memset(out,'x',g_size);
+	struct mmsghdr smsgs[batch],rmsgs[batch];
+	struct iovec   siov[batch],riov[batch];
+	memset(smsgs,0,sizeof(smsgs));
+	memset(rmsgs,0,sizeof(rmsgs));
+	for(int i = 0; i < batch; ++i){
+		siov[i].iov_base = out;
+		siov[i].iov_len  = g_size;
+		smsgs[i].msg_hdr.msg_iov    = &siov[i];
+		smsgs[i].msg_hdr.msg_iovlen = 1;
+		riov[i].iov_base = in + i*2048;
+		riov[i].iov_len  = 2048;
+		rmsgs[i].msg_hdr.msg_iov    = &riov[i];
+		rmsgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int inflight = 0;
+	while(!g_stop){
+		while(inflight + batch <= g_window){
+			int n = ::sendmmsg(fd,smsgs,batch,0);
+			if(n <= 0) break;
+			inflight += n;
+			__sync_add_and_fetch(&g_sent,n);
+		}
+		int n = ::recvmmsg(fd,rmsgs,batch,0,NULL);
+		if(n > 0){
+			inflight -= n;
+			__sync_add_and_fetch(&g_recv,n);
+		}else if(errno == EAGAIN || errno == EWOULDBLOCK)
+			inflight = 0;//the rest was lost,start over
+	}
+	::close(fd);
+	delete[] out;
+	delete[] in;
+	return NULL;
+}
+
+int main(int argc,char **argv){
+	if(argc < 5){
+		printf("usage udp_load ip port threads seconds [size] [window]\n");
+		return 0;
+	}
+	memset(&g_addr,0,sizeof(g_addr));
+	g_addr.sin_family      = AF_INET;
+	g_addr.sin_addr.s_addr = inet_addr(argv[1]);
+	g_addr.sin_port        = htons(atoi(argv[2]));
+	int threads = atoi(argv[3]);
+	int seconds = atoi(argv[4]);
+	if(argc > 5) g_size   = atoi(argv[5]);
+	if(argc > 6) g_window = atoi(argv[6]);
+	if(g_size < 1 || g_size > 2048) g_size = 64;
+	if(g_window < batch) g_window = batch;
+	pthread_t *tids = new pthread_t[threads];
+	for(int i = 0; i < threads; ++i)
+		pthread_create(&tids[i],NULL,routine,NULL);
+	uint64_t start = GetSystemMs64();
+	long last = 0;
+	for(int i = 0; i < seconds; ++i){
+		sleepms(1000);
+		long now = g_recv;
+		printf("%ld echoed/s\n",now - last);
+		last = now;
+	}
+	g_stop = 1;
+	for(int i = 0; i < threads; ++i)
+		pthread_join(tids[i],NULL);
+	double elapsed = (GetSystemMs64() - start)/1000.0;
+	printf("total %ld sent %ld echoed,%.0f datagrams/s\n",(long)g_sent,(long)g_recv,g_recv/elapsed);
+	delete[] tids;
+	return 0;
+}
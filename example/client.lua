@@ -12,5 +12,4 @@ end)
 
 while true do
 	C.Run(50)
-	collectgarbage("collect")
 end
\ No newline at end of file
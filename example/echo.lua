@@ -1,12 +1,13 @@
 local recvcount = 0
 
-C.Listen("127.0.0.1",8010,function (s)
+local listener = C.Listen("127.0.0.1",8010,function (s)
 	print("new client",s)
-	C.Bind(s,C.PacketDecoder(),function (s,rpk)
-		print("recv packet",rpk:ReadStr(),recvcount)
-		recvcount = recvcount + 1;
-		C.Send(s,C.NewWPacket(rpk))
-	end)
+end)
+
+listener:DefaultBind(C.PacketDecoder(),function (s,rpk)
+	print("recv packet",rpk:ReadStr(),recvcount)
+	recvcount = recvcount + 1;
+	s:Send(C.NewWPacket(rpk))
 end)
 
 while true do
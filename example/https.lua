@@ -0,0 +1,22 @@
+--an https server and a client calling it over pooled,resumed tls connections.
+--make a certificate first:
+--openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 30
+--  -subj "/CN=localhost" -addext "subjectAltName=DNS:localhost"
+local Http = require("lua.http")
+
+local server_tls = assert(C.TlsContext({cert = "cert.pem",key = "key.pem"}))
+Http.HttpServer("127.0.0.1",8443,function(req,res)
+	res:WriteHead(200,"OK",{"Content-Type: text/plain"})
+	res:End("Hello over TLS\n")
+end,{tls = server_tls})
+
+--the self signed certificate is its own CA
+local client_tls = assert(C.TlsContext({ca = "cert.pem"}))
+local client = Http.HttpClient("localhost",8443,client_tls)
+client:Get(Http.HttpRequest("/"),function (result)
+	print(result and result:GetBody() or "request failed")
+end)
+
+while true do
+	C.Run(50)
+end
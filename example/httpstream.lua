@@ -0,0 +1,38 @@
+--streams a 64MB body(SIZE_MB) in 16KB chunks,writing only as fast as the client
+--reads.once done it prints the most that was queued and how often the reactor
+--looped,which stays near 20/s while the stream waits on the client:
+--  curl -s --limit-rate 2M http://127.0.0.1:8010/ -o /dev/null
+local Http = require("lua.http")
+
+local size_mb = tonumber(os.getenv("SIZE_MB")) or 64
+local loops   = 0
+
+Http.HttpServer("127.0.0.1",8010,function(req,res)
+	res:WriteHead(200,"OK",{"Content-Type: application/octet-stream"})
+	local piece = string.rep("x",16384)
+	local left  = size_mb*64
+	local peak  = 0
+	local start,startloops = C.GetSysTick(),loops
+	local function pump()
+		while left > 0 do
+			left = left - 1
+			local more = res:WriteChunk(piece)
+			local queued = res.queue.connection:Pending()
+			if queued > peak then peak = queued end
+			if not more then
+				return
+			end
+		end
+		res:Finish()
+		local ms = C.GetSysTick() - start
+		print(string.format("streamed %dMB in %dms,peak queued %dKB,%.0f loops/s",
+			size_mb,ms,peak//1024,(loops - startloops)*1000/math.max(ms,1)))
+	end
+	res:OnDrain(pump)
+	pump()
+end)
+
+while true do
+	C.Run(50)
+	loops = loops + 1
+end
@@ -0,0 +1,34 @@
+--two workers passing a packet back and forth through their reactor mailboxes.
+--run it directly,it starts the workers itself
+if not C.WorkerId then
+	C.StartWorkers(2,"example/message.lua")
+	return
+end
+
+local peer  = C.WorkerId == 1 and 2 or 1
+local count = 0
+local tick  = C.GetSysTick()
+
+C.OnMessage(function (from,rpk)
+	local n = rpk:ReadU32()
+	count = count + 1
+	local wpk = C.NewWPacket()
+	wpk:WriteU32(n + 1)
+	C.PostMessage(from,wpk)
+end)
+
+if C.WorkerId == 1 then
+	local wpk = C.NewWPacket()
+	wpk:WriteU32(0)
+	C.PostMessage(peer,wpk)
+end
+
+while true do
+	C.Run(50)
+	local now = C.GetSysTick()
+	if now - tick >= 1000 then
+		print(string.format("worker %d recv %.0f/s",C.WorkerId,count*1000/(now - tick)))
+		count = 0
+		tick  = now
+	end
+end
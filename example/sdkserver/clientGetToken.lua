@@ -31,5 +31,4 @@ end
 
 while true do
 	C.Run(50)
-	collectgarbage("collect")
 end
@@ -4,11 +4,8 @@ local Router = require("lua.router")
 require("sdkserver.getToken")
 require("sdkserver.loginServer")
 
-Http.HttpServer("192.168.1.117",8010,function(req,res)
-	return Router.Dispatch(req,res)
-end)
+Http.HttpServer("192.168.1.117",8010,Router.native)
 
 while true do
 	C.Run(50)
-	collectgarbage("collect")
 end
\ No newline at end of file
@@ -0,0 +1,25 @@
+--the echo server of echo.lua for browsers:the handler is the same,only the
+--decoder differs.binary messages arrive as rpackets,text ones as rawpackets.
+--from a browser console:
+--  ws = new WebSocket("ws://127.0.0.1:8020/"); ws.onmessage = e => console.log(e.data)
+--  ws.onopen = () => ws.send("hello")
+local recvcount = 0
+
+local listener = C.Listen("127.0.0.1",8020,function (s)
+	print("new client",s)
+end)
+
+listener:DefaultBind(C.WebSocketDecoder(65536),function (s,rpk)
+	recvcount = recvcount + 1
+	if rpk.ReadBinary then
+		print("recv text",rpk:ReadBinary(),recvcount)
+		s:Send(C.NewRawPacket(rpk))
+	else
+		print("recv packet",rpk:ReadStr(),recvcount)
+		s:Send(C.NewWPacket(rpk))
+	end
+end)
+
+while true do
+	C.Run(50)
+end
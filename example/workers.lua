@@ -0,0 +1,3 @@
+--run example/echo.lua in 4 threads,each with its own reactor and lua state.
+--the listening socket is shared,so accepted clients spread over the workers
+C.StartWorkers(4,"example/echo.lua")
@@ -1,44 +1,214 @@
-local socket = require "lua.socket"
+local server_decoder = C.HttpDecoder(65535)
+local client_decoder = C.HttpDecoder(65535*2)
+local client_stream_decoder = C.HttpDecoder({maxheader = 65535,maxbody = 0,stream = true})
+--keep-alive connections shared by every httpclient:at most 16 idle and 64 open
+--connections per host,idle ones are closed after 30s
+local client_pool    = C.HttpConnPool(16,64,30000)
+--a streaming response stops taking chunks once this much is queued on the
+--connection and asks for more when it is down to low_watermark
+local high_watermark = 256*1024
+local low_watermark  = 64*1024
 
 local http_response = {}
 
 function http_response:new()
   local o = {}
   o.__index = http_response
-  o.headers = {}      
   setmetatable(o,o)
   return o
 end
 
-function http_response:buildResponse()
-	local strResponse  = string.format("HTTP/1.1 %d %s\r\n",self.status,self.phase)
-	for k,v in pairs(self.headers) do
-		strResponse = strResponse .. string.format("%s\r\n",v)
-	end	
-	if self.body then
-		strResponse = strResponse .. string.format("Content-Length: %d \r\n\r\n%s",#self.body,self.body)
-	else
-		strResponse = strResponse .. "\r\n\r\n"
-	end
-	return strResponse
-end
-
+--status line and headers are written into a native buffer as they come,Date,
+--Connection and Content-Length are added when the response is sent
 function http_response:WriteHead(status,phase,heads)
-	self.status = status
-	self.phase = phase
-	self.headers = self.headers or {}
+	self.native = C.HttpResponse(status,phase)
 	if heads then
 		for k,v in pairs(heads) do
-			table.insert(self.headers,v)
+			self.native:Header(v)
+			--a body the handler encoded itself is left alone
+			if string.find(string.lower(v),"^content%-encoding:") then
+				self.encoding = nil
+			end
 		end
 	end
 end
 
+--responses of pipelined requests go out in request order:a response ended
+--before the ones ahead of it waits in the connection queue
 function http_response:End(body)
-	self.body = body
-	self.connection:Send(C.NewRawPacket(self:buildResponse()))
+	if not self.native then
+		self.native = C.HttpResponse(200)
+	end
+	if self.streaming then
+		self:WriteChunk(body)
+		return self:Finish()
+	end
+	self.body  = body
+	self.ended = true
+	self.queue:flush()
+end
+
+--answer with a file of files(a C.StaticFiles),path defaults to the request
+--path.the file goes out from native memory or with sendfile,returns the status
+function http_response:SendFile(files,req,path)
+	local status
+	status,self.native,self.file,self.length = files:Respond(req,path)
+	self.ended = true
+	self.queue:flush()
+	return status
 end
 
+--stream the body without knowing its length:chunked transfer-encoding,or to
+--an http/1.0 client raw bytes ended by closing the connection.returns false
+--when the chunk had to be held back(the response is behind an unfinished one
+--or the connection is over its high watermark),then wait for OnDrain before
+--writing more so memory stays bounded
+function http_response:WriteChunk(data)
+	if not self.native then
+		self.native = C.HttpResponse(200)
+	end
+	self.streaming = true
+	if data and #data > 0 then
+		table.insert(self.chunks,data)
+	end
+	self.queue:flush()
+	if #self.chunks == 0 and not self.queue.connection:Full() then
+		return true
+	end
+	self.want_drain = true
+	return false
+end
+
+--the last chunk,the response is complete
+function http_response:Finish()
+	self.streaming = true
+	self.ended     = true
+	self.queue:flush()
+end
+
+--on_drain() is called when a WriteChunk that returned false can go on
+function http_response:OnDrain(on_drain)
+	self.on_drain = on_drain
+end
+
+local response_queue = {}
+
+function response_queue:new(s)
+  local o = {}
+  o.__index = response_queue
+  setmetatable(o,o)
+  o.connection = s
+  o.first = 1
+  o.last  = 0
+  s:SetWatermark(high_watermark,low_watermark,function (_)
+    o:drain()
+  end)
+  return o
+end
+
+function response_queue:drain()
+	local response = self[self.first]
+	if response and response.want_drain and response.on_drain then
+		response.want_drain = false
+		response.on_drain()
+	end
+end
+
+function response_queue:push(response)
+	self.last = self.last + 1
+	self[self.last] = response
+	response.queue = self
+end
+
+function response_queue:flush()
+	--a drain callback fired by Send may write more,the running flush sends it
+	if self.flushing then
+		return
+	end
+	self.flushing = true
+	while not self.closed and not self.dispatching and self.first <= self.last do
+		local response = self[self.first]
+		local packet
+		if response.streaming then
+			--the head and the chunks so far go out at once,the response stays
+			--at the front of the queue until Finish
+			packet = self:stream(response)
+		elseif response.length then
+			--the body is a packet of its own,the head only announces its length
+			packet = response.native:BuildHead(response.length,response.keepalive)
+			if response.file then
+				self.connection:Send(packet)
+				packet = response.file
+			end
+		elseif response.ended then
+			local encoding = response.encoding
+			local body     = response.body
+			if encoding and (not body or #body < response.compress.minsize) then
+				encoding = nil
+			end
+			if response.compress and not encoding then
+				response.native:Header("Vary: Accept-Encoding")
+			end
+			packet = response.native:Build(body,response.keepalive,encoding,response.compress and response.compress.level)
+		end
+		if not packet then
+			break
+		end
+		self[self.first] = nil
+		self.first = self.first + 1
+		if response.keepalive then
+			self.connection:Send(packet)
+		else
+			--the client asked to close,whatever it pipelined after this is dropped
+			self.closed = true
+			self.connection:Send(packet,function (s) s:Close() end)
+		end
+	end
+	self.flushing = false
+	--a streaming response that was held back can write now
+	if not self.closed and not self.dispatching and not self.connection:Full() then
+		self:drain()
+	end
+end
+
+--send what a streaming response has,the last packet is returned once it
+--is finished
+function response_queue:stream(response)
+	local s = self.connection
+	if not response.headsent then
+		response.headsent = true
+		if not response.chunked then
+			response.keepalive = false
+		end
+		if response.encoding then
+			--every chunk goes through one deflate stream,flushed chunk by chunk
+			response.deflater = C.Deflater(response.encoding,response.compress.level)
+		elseif response.compress then
+			response.native:Header("Vary: Accept-Encoding")
+		end
+		s:Send(response.native:BuildStream(response.keepalive,response.chunked,response.encoding))
+	end
+	local deflater = response.deflater
+	while #response.chunks > 0 do
+		local chunks = response.chunks
+		response.chunks = {}
+		for i = 1,#chunks do
+			if deflater then
+				--the chunks at hand are compressed as one block
+				local packet = deflater:Chunk(chunks[i],response.chunked,i == #chunks)
+				if packet then s:Send(packet) end
+			else
+				s:Send(response.chunked and C.HttpChunk(chunks[i]) or C.NewRawPacket(chunks[i]))
+			end
+		end
+	end
+	if response.ended then
+		if deflater then
+			return deflater:Finish(response.chunked)
+		end
+		return response.chunked and C.HttpChunk() or C.NewRawPacket("")
+	end
+end
 
 local http_request = {}
 
@@ -64,6 +234,14 @@ function http_request:End(body)
 	self.body = body
 end
 
+--stream the response body:on_result gets the status and headers,then
+--on_data(chunk) every piece of the body and on_end(ok) when it is complete
+--or the connection was lost
+function http_request:OnBody(on_data,on_end)
+	self.on_data = on_data
+	self.on_end  = on_end
+end
+
 
 local http_server = {}
 
@@ -74,40 +252,151 @@ function http_server:new()
   return o
 end
 
-function http_server:CreateServer(ip,port,on_request)
-	self.socket = C.Listen(ip,port,function (s)
-		local connection = socket.New(s)
-		C.Bind(s,C.HttpDecoder(65535),function (_,rpk)
+local function not_found(req,res)
+	res:WriteHead(404,"Not Found",{"Content-Type: text/plain"})
+	res:End("not found\n")
+end
+
+--the body of a request decoded with options.stream,on_request gets it as its
+--third argument(a router handler as its fourth).on_data(chunk) is called for
+--every piece of the body and on_end() once it is complete,Pause and Resume
+--stop and restart reading the connection
+local body_stream = {}
+
+function body_stream:new(s)
+  local o = {}
+  o.__index = body_stream
+  setmetatable(o,o)
+  o.socket = s
+  return o
+end
+
+function body_stream:On(on_data,on_end)
+	self.on_data = on_data
+	self.on_end  = on_end
+end
+
+function body_stream:Pause()
+	self.socket:PauseRead()
+end
+
+function body_stream:Resume()
+	self.socket:ResumeRead()
+end
+
+--a handler serving the files under root,see C.StaticFiles for options.mounted
+--on a router pattern ending in "*path" it serves that part of the url,else
+--the whole request path
+local function Static(root,options)
+	local files = C.StaticFiles(root,options)
+	return function (req,res,params)
+		res:SendFile(files,req,type(params) == "table" and params.path or nil)
+	end
+end
+
+--requests decoded with a router are matched before they reach lua
+local function routed(on_request)
+	if type(on_request) ~= "userdata" then
+		return nil,on_request
+	end
+	return on_request,function (req,res,body)
+		local handler,params = req:Route()
+		return (handler or not_found)(req,res,params,body)
+	end
+end
+
+--on_request(req,res) returning true closes the connection once res is sent.
+--on_request may be a C.HttpRouter,its handlers are called as handler(req,res,params).
+--options:{maxheader=,maxbody=,stream=},see C.HttpDecoder.compress = {minsize=,level=}
+--(or just minsize) gzip/deflate encodes bodies of at least minsize bytes(1024)
+--and every streamed body for clients that accept it.tls = C.TlsContext({cert=,key=})
+--serves https
+function http_server:CreateServer(ip,port,on_request,options)
+	local router
+	router,on_request = routed(on_request)
+	local compress = options and options.compress
+	if compress then
+		if type(compress) ~= "table" then
+			compress = {minsize = tonumber(compress)}
+		end
+		compress = {minsize = compress.minsize or 1024,level = compress.level or 6}
+	end
+	local decoder = server_decoder
+	if router or options then
+		options = options or {}
+		decoder = C.HttpDecoder({maxheader = options.maxheader,maxbody = options.maxbody,
+			stream = options.stream,router = router})
+	end
+	local tls = options and options.tls
+	self.socket = C.Listen(ip,port,tls and function (s) s:StartTLS(tls) end)
+	if self.socket then
+		local queues = {}
+		local bodies = {}
+		self.socket:DefaultBind(decoder,function (s,rpk)
+			local part = rpk:Part()
+			if part == "body" or part == "end" then
+				local body = bodies[s]
+				if part == "body" then
+					if body and body.on_data then body.on_data(rpk:GetBody()) end
+				else
+					bodies[s] = nil
+					if body and body.on_end then body.on_end() end
+				end
+				return
+			end
+			local queue = queues[s]
+			if not queue then
+				queue = response_queue:new(s)
+				queues[s] = queue
+			end
 			local response = http_response:new()
-			response.connection = connection
-			if on_request(rpk,response) then
-				connection:Close()
+			response.keepalive = rpk:KeepAlive()
+			response.chunks    = {}
+			--chunked transfer-encoding came with http/1.1
+			local major,minor  = rpk:GetVersion()
+			response.chunked   = major > 1 or (major == 1 and minor >= 1)
+			if compress then
+				response.compress = compress
+				response.encoding = rpk:AcceptEncoding()
+			end
+			queue:push(response)
+			local body
+			if part == "head" then
+				body = body_stream:new(s)
+				bodies[s] = body
+			end
+			--a response ended inside on_request is sent once its keepalive is final
+			queue.dispatching = true
+			if on_request(rpk,response,body) then
+				response.keepalive = false
 			end
+			queue.dispatching = false
+			queue:flush()
 		end,
-		function (_)
-			connection = nil
+		function (s)
+			queues[s] = nil
+			bodies[s] = nil
 		end)
-	end)
-	if self.socket then
 		return self
 	else
 		return nil
 	end
 end
 
-local function HttpServer(ip,port,on_request)
-	return http_server:new():CreateServer(ip,port,on_request)
+local function HttpServer(ip,port,on_request,options)
+	return http_server:new():CreateServer(ip,port,on_request,options)
 end
 
 
 local httpclient = {}
 
-function httpclient:new(host,port)
+function httpclient:new(host,port,tls)
   local o = {}
   o.__index = httpclient      
   setmetatable(o,o)
   o.host    = host
-  o.port    = port or 80
+  o.port    = port or (tls and 443 or 80)
+  o.tls     = tls
   return o
 end
 
@@ -127,35 +416,53 @@ end
 
 
 function httpclient:request(method,request,on_result)
-	print(self.host,self.port)
-	if C.Connect(self.host,self.port,function (s,success)
-			if success then
-				print("connect success") 
-				local connection = socket.New(s)
-				C.Bind(s,C.HttpDecoder(65535*2),function (_,rpk)
-					on_result(rpk)
-					on_result = nil
-					if connection then
-						connection:Close()
-					end
-				end,
-				function (_)
-					if on_result then
-						on_result(nil)
-					end
-					connection = nil
-				end)
-				request.method = method
-				connection:Send(C.NewRawPacket(self:buildRequest(request)))
+	request.method = method
+	local strRequest = self:buildRequest(request)
+	local decoder = request.on_data and client_stream_decoder or client_decoder
+	client_pool:Acquire(self.host,self.port,function (s,success)
+		if not success then
+			print("connect failed")
+			on_result(nil)
+			return
+		end
+		local streaming = false
+		s:Bind(decoder,function (s,rpk)
+			local part = rpk:Part()
+			if part == "body" then
+				request.on_data(rpk:GetBody())
+				return
+			end
+			if part == "head" then
+				streaming = true
 			else
+				streaming = false
+				--back to the pool before the callback,so a request it makes can reuse s
+				client_pool:Release(s,rpk:KeepAlive())
+			end
+			if part == "end" then
+				if request.on_end then request.on_end(true) end
+				return
+			end
+			local cb = on_result
+			on_result = nil
+			cb(rpk)
+			if part == "message" and request.on_data then
+				--a response without a body to stream
+				if request.on_end then request.on_end(true) end
+			end
+		end,
+		function (_)
+			if on_result then
 				on_result(nil)
-				print("connect failed")
+				on_result = nil
+			elseif streaming and request.on_end then
+				streaming = false
+				request.on_end(false)
 			end
-		end) then
-		return true
-	else
-		return false
-	end	
+		end)
+		s:Send(C.NewRawPacket(strRequest))
+	end,self.tls)
+	return true
 end
 
 function httpclient:Post(request,on_result)
@@ -166,8 +473,14 @@ function httpclient:Get(request,on_result)
 	return self:request("GET",request,on_result)
 end
 
-local function HttpClient(host,port)
-	return httpclient:new(host,port)
+--tls a C.TlsContext for https,the port then defaults to 443
+local function HttpClient(host,port,tls)
+	return httpclient:new(host,port,tls)
+end
+
+--replace the client connection pool,maxidle 0 turns keep-alive off
+local function SetConnPool(maxidle,maxperhost,idletimeout)
+	client_pool = C.HttpConnPool(maxidle,maxperhost,idletimeout)
 end
 
 local function HttpRequest(path)
@@ -179,4 +492,6 @@ return {
 	HttpServer  = HttpServer,
 	HttpClient  = HttpClient,
 	HttpRequest = HttpRequest,
+	Static      = Static,
+	SetConnPool = SetConnPool,
 }
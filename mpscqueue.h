@@ -0,0 +1,70 @@
+/*
+ *侵入式的多生产者单消费者无锁队列(Dmitry Vyukov的算法)
+ *Push可在任意线程调用,Pop只能由唯一的消费者线程调用
+*/
+#ifndef _MPSCQUEUE_H
+#define _MPSCQUEUE_H
+
+#include <stdlib.h>
+
+#ifdef _WIN
+#include <Windows.h>
+#endif
+
+struct mpscnode{
+	mpscnode():next(NULL){}
+	mpscnode * volatile next;
+};
+
+class mpscqueue{
+public:
+	mpscqueue():head(&stub),tail(&stub){
+	}
+
+	void Push(mpscnode *n){
+		n->next = NULL;
+#ifdef _WIN
+		mpscnode *prev = (mpscnode*)InterlockedExchangePointer((PVOID volatile*)&head,n);
+#else
+		//__sync_lock_test_and_set is only an acquire barrier,the task must be
+		//visible before it is published
+		__sync_synchronize();
+		mpscnode *prev = __sync_lock_test_and_set(&head,n);
+#endif
+		//between the exchange and this store the queue is unlinked,Pop sees it as
+		//empty until the producer finishes
+		prev->next = n;
+	}
+
+	mpscnode *Pop(){
+		mpscnode *t    = tail;
+		mpscnode *next = t->next;
+		if(t == &stub){
+			if(!next) return NULL;
+			tail = next;
+			t    = next;
+			next = next->next;
+		}
+		if(next){
+			tail = next;
+			return t;
+		}
+		if(t != head) return NULL;
+		Push(&stub);
+		next = t->next;
+		if(next){
+			tail = next;
+			return t;
+		}
+		return NULL;
+	}
+
+private:
+	mpscqueue(const mpscqueue&);
+	mpscqueue& operator = (const mpscqueue&);
+	mpscnode * volatile head;
+	mpscnode           *tail;
+	mpscnode            stub;
+};
+
+#endif